@@ -0,0 +1,696 @@
+#include "codegen.h"
+#include "../common/xalloc.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Support code every generated program starts with
+static const char *runtime =
+    "#include <stdbool.h>\n"
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "typedef void (*cc_method)(void);\n"
+    "typedef struct cc_object { const cc_method *vtable; } cc_object;\n"
+    "typedef char cc_unit; // value of a Void expression\n"
+    "\n"
+    "static _Noreturn void cc_fail(const char *what) {\n"
+    "    fflush(stdout);\n"
+    "    fprintf(stderr, \"Runtime error: %s\\n\", what);\n"
+    "    exit(EXIT_FAILURE);\n"
+    "}\n"
+    "static inline int32_t cc_add(int32_t a, int32_t b) { return (int32_t)((uint32_t)a + (uint32_t)b); }\n"
+    "static inline int32_t cc_sub(int32_t a, int32_t b) { return (int32_t)((uint32_t)a - (uint32_t)b); }\n"
+    "static inline int32_t cc_mul(int32_t a, int32_t b) { return (int32_t)((uint32_t)a * (uint32_t)b); }\n"
+    "static inline int32_t cc_div(int32_t a, int32_t b) {\n"
+    "    if (b == 0) cc_fail(\"division by zero\");\n"
+    "    return a == INT32_MIN && b == -1 ? a : a / b;\n"
+    "}\n"
+    "static inline void cc_println(int32_t v) { printf(\"%d\\n\", (int)v); }\n"
+    "static inline cc_object *cc_nonnull(cc_object *o) {\n"
+    "    if (!o) cc_fail(\"method call on a null object\");\n"
+    "    return o;\n"
+    "}\n"
+    "static inline cc_method cc_lookup(const cc_object *o, int slot) {\n"
+    "    if (!o) cc_fail(\"method call on a null object\");\n"
+    "    return o->vtable[slot];\n"
+    "}\n"
+    "static inline cc_object *cc_new(size_t size, const cc_method *vtable) {\n"
+    "    cc_object *o = calloc(1, size);\n"
+    "    if (!o) cc_fail(\"out of memory\");\n"
+    "    o->vtable = vtable;\n"
+    "    return o;\n"
+    "}\n"
+    "// builds an object in storage of the calling frame\n"
+    "static inline cc_object *cc_place(void *storage, size_t size, const cc_method *vtable) {\n"
+    "    cc_object *o = memset(storage, 0, size);\n"
+    "    o->vtable = vtable;\n"
+    "    return o;\n"
+    "}\n";
+
+// Where the value of a lowered expression can be found
+typedef enum { OPND_TEMP, OPND_VAR, OPND_THIS, OPND_INT, OPND_BOOL, OPND_UNIT } OperandKind;
+typedef struct {
+    OperandKind kind;
+    int         value;        // temp number, slot, or constant
+    Symbol      sym;          // variable name for OPND_VAR
+} Operand;
+
+// A variable of the current body, by frame slot and name
+typedef struct {
+    int    slot;
+    Symbol sym;
+} VarRef;
+
+// Generator state for one program
+typedef struct {
+    FILE          *out;
+    const TypeEnv *env;
+    int            indent;
+    int            temps;     // temporaries used in the current function
+    Type           ret;       // return type of the current function
+    int            in_main;   // Return leaves the program
+    char          *emitted;   // per method entry: its body is generated
+    char          *live;      // per class: some New creates one, so its vtable is generated
+    Operand       *bound;     // per frame slot: what an inlined call's argument was lowered to
+    char          *binds;     // per frame slot: reads of it use 'bound'
+    VarRef        *reads;     // variables the current body reads, sorted
+    int            read_count, read_capacity;
+    int            reads_self;
+} Gen;
+
+static const char *name_of(const Gen *g, Symbol s) {
+    return symbol_name(g->env->names, s);
+}
+
+static void begin_line(Gen *g) {
+    fprintf(g->out, "%*s", g->indent * 4, "");
+}
+
+static void line(Gen *g, const char *fmt, ...) {
+    va_list ap;
+    begin_line(g);
+    va_start(ap, fmt);
+    vfprintf(g->out, fmt, ap);
+    va_end(ap);
+}
+
+// C type of a variable, parameter or field
+static const char *c_type(Type t) {
+    switch (t.kind) {
+    case TYPE_INT:     return "int32_t";
+    case TYPE_BOOLEAN: return "bool";
+    case TYPE_CLASS:   return "cc_object *";
+    default:           return "cc_unit";
+    }
+}
+
+// C return type of a method
+static const char *c_return_type(Type t) {
+    return t.kind == TYPE_VOID ? "void" : c_type(t);
+}
+
+static const char *zero_value(Type t) {
+    switch (t.kind) {
+    case TYPE_BOOLEAN: return "false";
+    case TYPE_CLASS:   return "NULL";
+    default:           return "0";
+    }
+}
+
+// Locals are named by frame slot as well, since the source may declare
+// one name twice in a scope
+static void print_var(const Gen *g, int slot, Symbol sym) {
+    fprintf(g->out, "v%d_%s", slot, name_of(g, sym));
+}
+
+static void print_operand(const Gen *g, Operand o) {
+    switch (o.kind) {
+    case OPND_TEMP: fprintf(g->out, "t%d", o.value); break;
+    case OPND_VAR:  print_var(g, o.value, o.sym); break;
+    case OPND_THIS: fputs("self", g->out); break;
+    case OPND_BOOL: fputs(o.value ? "true" : "false", g->out); break;
+    case OPND_UNIT: fputs("0", g->out); break;
+    case OPND_INT:
+        // literals past INT32_MAX have wrapped, like in the typechecker
+        if (o.value == INT32_MIN)
+            fputs("INT32_MIN", g->out);
+        else
+            fprintf(g->out, o.value < 0 ? "(%d)" : "%d", o.value);
+        break;
+    }
+}
+
+static Operand operand(OperandKind kind, int value) {
+    Operand o;
+    o.kind  = kind;
+    o.value = value;
+    o.sym   = NO_SYMBOL;
+    return o;
+}
+
+// Starts "T tN = " on a new line and returns tN
+static Operand new_temp(Gen *g, Type t) {
+    Operand o = operand(OPND_TEMP, g->temps++);
+    line(g, "%s%st%d = ", c_type(t), t.kind == TYPE_CLASS ? "" : " ", o.value);
+    return o;
+}
+
+static void print_method_name(const Gen *g, int id) {
+    const MethodEntry *m = &g->env->methods[id];
+    if (m->method_name == SYM_CTOR)
+        fprintf(g->out, "init_%s", name_of(g, m->class_name));
+    else
+        fprintf(g->out, "m%d_%s_%s", id, name_of(g, m->class_name), name_of(g, m->method_name));
+}
+
+// "RET (*)(cc_object *, T1, ...)" for a method's function pointer
+static void print_method_type(const Gen *g, const MethodSig *sig) {
+    fprintf(g->out, "%s (*)(cc_object *", c_return_type(sig->return_type));
+    for (int i = 0; i < sig->param_count; i++)
+        fprintf(g->out, ", %s", c_type(sig->param_types[i]));
+    fputc(')', g->out);
+}
+
+static void print_args(const Gen *g, const Operand *args, int count) {
+    for (int i = 0; i < count; i++) {
+        fputs(", ", g->out);
+        print_operand(g, args[i]);
+    }
+}
+
+static Operand lower_exp(Gen *g, const ASTNode *n);
+
+// Lowers the argument expressions kids[first..] in order
+static Operand *lower_args(Gen *g, const ASTNode *n, int first) {
+    int count = n->kid_count - first;
+    Operand *args = xmalloc((count + 1) * sizeof *args);
+    for (int i = 0; i < count; i++)
+        args[i] = lower_exp(g, n->kids[first + i]);
+    return args;
+}
+
+// (call e m args): an indexed load from the receiver's vtable and an
+// indirect call, or a direct call when devirtualize bound the site.
+// 'discard' drops the result of a call statement.
+static Operand lower_call(Gen *g, const ASTNode *n, int discard) {
+    Operand recv = lower_exp(g, n->kids[0]);
+    Operand *args = lower_args(g, n, 2);
+    int id = lookup_method(g->env, n->kids[0]->type.cls, n->kids[1]->sym);
+    const MethodEntry *m = &g->env->methods[id];
+    Operand result = operand(OPND_UNIT, 0);
+    if (m->sig.return_type.kind != TYPE_VOID && !discard)
+        result = new_temp(g, m->sig.return_type);
+    else
+        begin_line(g);
+    if (n->target >= 0) {
+        print_method_name(g, n->target);
+        fputc('(', g->out);
+        // 'this' is never null
+        if (recv.kind != OPND_THIS) fputs("cc_nonnull(", g->out);
+        print_operand(g, recv);
+        if (recv.kind != OPND_THIS) fputc(')', g->out);
+    } else {
+        fputs("((", g->out);
+        print_method_type(g, &m->sig);
+        fputs(")cc_lookup(", g->out);
+        print_operand(g, recv);
+        fprintf(g->out, ", %d))(", m->slot);
+        print_operand(g, recv);
+    }
+    print_args(g, args, n->kid_count - 2);
+    fprintf(g->out, "); // %s.%s\n", name_of(g, n->kids[0]->type.cls), name_of(g, m->method_name));
+    free(args);
+    return result;
+}
+
+static Operand lower_new(Gen *g, const ASTNode *n) {
+    Symbol cls = n->kids[0]->sym;
+    Operand *args = lower_args(g, n, 1);
+    Operand obj = new_temp(g, n->type);
+    if (n->alloc == ALLOC_HEAP)
+        fprintf(g->out, "cc_new(sizeof(struct c_%s), vt_%s);\n", name_of(g, cls), name_of(g, cls));
+    else
+        fprintf(g->out, "cc_place(&fo%d, sizeof fo%d, vt_%s);\n", n->alloc, n->alloc, name_of(g, cls));
+    line(g, "init_%s(", name_of(g, cls));
+    print_operand(g, obj);
+    print_args(g, args, n->kid_count - 1);
+    fputs(");\n", g->out);
+    free(args);
+    return obj;
+}
+
+// The arguments an inlined call binds are not variables: reads of one
+// use the operand it was lowered to, since nothing reassigns it before
+static Operand lower_inlined(Gen *g, const ASTNode *n) {
+    int last = n->kid_count - 1;
+    for (int i = 0; i < last; i++) {
+        const ASTNode *bind = n->kids[i];
+        if (bind->kind != NODE_ASSIGN) continue;
+        Operand v = lower_exp(g, bind->kids[1]);
+        g->bound[bind->kids[0]->slot] = v;
+        g->binds[bind->kids[0]->slot] = 1;
+    }
+    const ASTNode *recv = n->kids[0];
+    if (recv->kind == NODE_ASSIGN) recv = recv->kids[0];
+    const MethodEntry *m = &g->env->methods[n->target];
+    if (recv->kind == NODE_THIS) {
+        line(g, "// %s.%s inlined\n", name_of(g, m->class_name), name_of(g, m->method_name));
+    } else {
+        Operand r = lower_exp(g, recv);
+        line(g, "cc_nonnull(");
+        print_operand(g, r);
+        fprintf(g->out, "); // %s.%s inlined\n", name_of(g, m->class_name), name_of(g, m->method_name));
+    }
+    return lower_exp(g, n->kids[last]);
+}
+
+static Operand lower_binary(Gen *g, const ASTNode *n) {
+    Operand a = lower_exp(g, n->kids[0]);
+    Operand b = lower_exp(g, n->kids[1]);
+    Operand t = new_temp(g, n->type);
+    const char *fn = NULL, *op = NULL;
+    switch (n->kind) {
+    case NODE_ADD:  fn = "cc_add"; break;
+    case NODE_SUB:  fn = "cc_sub"; break;
+    case NODE_MUL:  fn = "cc_mul"; break;
+    case NODE_DIV:  fn = "cc_div"; break;
+    case NODE_LESS: op = " < ";    break;
+    default:        op = " == ";   break;
+    }
+    if (fn) fprintf(g->out, "%s(", fn);
+    print_operand(g, a);
+    fputs(fn ? ", " : op, g->out);
+    print_operand(g, b);
+    fputs(fn ? ");\n" : ";\n", g->out);
+    return t;
+}
+
+// Emits the code computing 'n' and says where its value ends up
+static Operand lower_exp(Gen *g, const ASTNode *n) {
+    switch (n->kind) {
+    case NODE_THIS:    return operand(OPND_THIS, 0);
+    case NODE_INT_LIT: return operand(OPND_INT, n->int_value);
+    case NODE_TRUE:    return operand(OPND_BOOL, 1);
+    case NODE_FALSE:   return operand(OPND_BOOL, 0);
+    case NODE_IDENT: {
+        if (g->binds[n->slot]) return g->bound[n->slot];
+        Operand o = operand(OPND_VAR, n->slot);
+        o.sym = n->sym;
+        return o;
+    }
+    case NODE_PRINTLN: {
+        Operand v = lower_exp(g, n->kids[0]);
+        line(g, "cc_println(");
+        print_operand(g, v);
+        fputs(");\n", g->out);
+        return operand(OPND_UNIT, 0);
+    }
+    case NODE_CALL: return lower_call(g, n, 0);
+    case NODE_NEW:  return lower_new(g, n);
+    case NODE_INLINED: return lower_inlined(g, n);
+    default:        return lower_binary(g, n);
+    }
+}
+
+// Whether control can reach the end of statement 'n'
+static int falls_through(const ASTNode *n) {
+    switch (n->kind) {
+    case NODE_RETURN:
+    case NODE_BREAK:
+        return 0;
+    case NODE_STMTLIST:
+        for (int i = 0; i < n->kid_count; i++)
+            if (!falls_through(n->kids[i])) return 0;
+        return 1;
+    case NODE_IF:
+        return n->kid_count < 3 || falls_through(n->kids[1]) || falls_through(n->kids[2]);
+    default:
+        return 1;
+    }
+}
+
+// Records the variables the code of 'n' reads; the targets of Assigns are
+// only written, and an inlined call on 'this' does not read it
+static void collect_reads(Gen *g, const ASTNode *n) {
+    int first = 0;
+    switch (n->kind) {
+    case NODE_THIS:
+    case NODE_SUPERCALL:
+        g->reads_self = 1;
+        break;
+    case NODE_IDENT:
+        if (n->slot < 0) return;
+        if (g->read_count == g->read_capacity) {
+            g->read_capacity = g->read_capacity ? g->read_capacity * 2 : 16;
+            g->reads = xrealloc(g->reads, g->read_capacity * sizeof *g->reads);
+        }
+        g->reads[g->read_count].slot  = n->slot;
+        g->reads[g->read_count++].sym = n->sym;
+        return;
+    case NODE_VARDEC:
+        return;
+    case NODE_ASSIGN:
+        first = 1;
+        break;
+    case NODE_INLINED:
+        first = n->kids[0]->kind == NODE_THIS;
+        break;
+    default:
+        break;
+    }
+    for (int i = first; i < n->kid_count; i++)
+        collect_reads(g, n->kids[i]);
+}
+
+static int compare_vars(const void *a, const void *b) {
+    const VarRef *x = a, *y = b;
+    if (x->slot != y->slot) return x->slot < y->slot ? -1 : 1;
+    return (x->sym > y->sym) - (x->sym < y->sym);
+}
+
+// Whether the current body reads the variable; one it never reads gets a
+// (void) use, so the generated C compiles without unused warnings
+static int is_read(const Gen *g, int slot, Symbol sym) {
+    VarRef key;
+    key.slot = slot;
+    key.sym  = sym;
+    // reads stays NULL until something is read, and bsearch wants an array
+    if (g->read_count == 0) return 0;
+    return bsearch(&key, g->reads, g->read_count, sizeof key, compare_vars) != NULL;
+}
+
+static void lower_stmt(Gen *g, const ASTNode *n) {
+    switch (n->kind) {
+    case NODE_VARDEC: {
+        const ASTNode *var = n->kids[1];
+        line(g, "%s%s", c_type(n->kids[0]->type), n->kids[0]->type.kind == TYPE_CLASS ? "" : " ");
+        print_var(g, var->slot, var->sym);
+        fprintf(g->out, " = %s;\n", zero_value(n->kids[0]->type));
+        if (!is_read(g, var->slot, var->sym)) {
+            line(g, "(void)");
+            print_var(g, var->slot, var->sym);
+            fputs(";\n", g->out);
+        }
+        return;
+    }
+    case NODE_ASSIGN: {
+        Operand v = lower_exp(g, n->kids[1]);
+        begin_line(g);
+        print_var(g, n->kids[0]->slot, n->kids[0]->sym);
+        fputs(" = ", g->out);
+        print_operand(g, v);
+        fputs(";\n", g->out);
+        return;
+    }
+    case NODE_IF: {
+        Operand c = lower_exp(g, n->kids[0]);
+        line(g, "if (");
+        print_operand(g, c);
+        fputs(") {\n", g->out);
+        g->indent++;
+        lower_stmt(g, n->kids[1]);
+        g->indent--;
+        if (n->kid_count == 3) {
+            line(g, "} else {\n");
+            g->indent++;
+            lower_stmt(g, n->kids[2]);
+            g->indent--;
+        }
+        line(g, "}\n");
+        return;
+    }
+    case NODE_WHILE: {
+        // the condition's code runs on every iteration
+        line(g, "for (;;) {\n");
+        g->indent++;
+        Operand c = lower_exp(g, n->kids[0]);
+        line(g, "if (!");
+        print_operand(g, c);
+        fputs(") break;\n", g->out);
+        for (int i = 1; i < n->kid_count; i++)
+            lower_stmt(g, n->kids[i]);
+        g->indent--;
+        line(g, "}\n");
+        return;
+    }
+    case NODE_RETURN: {
+        Operand v = operand(OPND_UNIT, 0);
+        if (n->kid_count == 1) v = lower_exp(g, n->kids[0]);
+        if (g->in_main) {
+            line(g, "return 0;\n");
+        } else if (g->ret.kind == TYPE_VOID) {
+            line(g, "return;\n");
+        } else {
+            line(g, "return ");
+            print_operand(g, v);
+            fputs(";\n", g->out);
+        }
+        return;
+    }
+    case NODE_BREAK:
+        line(g, "break;\n");
+        return;
+    case NODE_STMTLIST:
+        for (int i = 0; i < n->kid_count; i++)
+            lower_stmt(g, n->kids[i]);
+        return;
+    case NODE_CALL:
+        lower_call(g, n, 1);
+        return;
+    default: {
+        // an expression statement's value goes unused
+        Operand v = lower_exp(g, n);
+        if (v.kind == OPND_TEMP) line(g, "(void)t%d;\n", v.value);
+    }
+    }
+}
+
+// Prototype or definition header of a method or constructor
+static void print_signature(Gen *g, int id) {
+    const MethodEntry *m = &g->env->methods[id];
+    fprintf(g->out, "static %s ", c_return_type(m->sig.return_type));
+    print_method_name(g, id);
+    fputs("(cc_object *self", g->out);
+    for (int i = 0; i < m->def->param_count; i++) {
+        const ASTNode *p = m->def->kids[i];
+        fprintf(g->out, ", %s%s", c_type(p->kids[0]->type), p->kids[0]->type.kind == TYPE_CLASS ? "" : " ");
+        print_var(g, p->kids[1]->slot, p->kids[1]->sym);
+    }
+    fputc(')', g->out);
+}
+
+// Storage for the objects escape analysis placed in the frame, declared
+// once at the top so each New reuses its own on every run
+static void declare_frame_objects(Gen *g, const ASTNode *n) {
+    if (n->kind == NODE_NEW && n->alloc != ALLOC_HEAP)
+        line(g, "struct c_%s fo%d;\n", name_of(g, n->kids[0]->sym), n->alloc);
+    for (int i = 0; i < n->kid_count; i++)
+        declare_frame_objects(g, n->kids[i]);
+}
+
+// Clears what inlined calls bound, for 'body' of 'frame_size' slots, and
+// collects what it reads
+static void begin_body(Gen *g, const ASTNode *body, int frame_size) {
+    free(g->bound);
+    free(g->binds);
+    g->bound = xcalloc(frame_size + 1, sizeof *g->bound);
+    g->binds = xcalloc(frame_size + 1, 1);
+    g->temps = 0;
+    g->read_count = 0;
+    g->reads_self = 0;
+    collect_reads(g, body);
+    if (g->read_count > 1)
+        qsort(g->reads, g->read_count, sizeof *g->reads, compare_vars);
+}
+
+static void emit_function(Gen *g, int id) {
+    const MethodEntry *m = &g->env->methods[id];
+    const ASTNode *def = m->def;
+    begin_body(g, def, def->frame_size);
+    g->ret   = m->sig.return_type;
+    print_signature(g, id);
+    fputs(" {\n", g->out);
+    g->indent = 1;
+    if (!g->reads_self) line(g, "(void)self;\n");
+    for (int p = 0; p < def->param_count; p++) {
+        const ASTNode *var = def->kids[p]->kids[1];
+        if (is_read(g, var->slot, var->sym)) continue;
+        line(g, "(void)");
+        print_var(g, var->slot, var->sym);
+        fputs(";\n", g->out);
+    }
+    declare_frame_objects(g, def);
+    int i = def->param_count;
+    if (m->method_name == SYM_CTOR) {
+        if (i < def->kid_count && def->kids[i]->kind == NODE_SUPERCALL) {
+            const ASTNode *sup = def->kids[i++];
+            Operand *args = lower_args(g, sup, 0);
+            const ClassEntry *c = &g->env->classes[class_number(g->env, m->class_name)];
+            line(g, "init_%s(self", name_of(g, c->superclass));
+            print_args(g, args, sup->kid_count);
+            fputs(");\n", g->out);
+            free(args);
+        }
+    } else {
+        i++;   // the return type
+    }
+    int reaches_end = 1;
+    for (; i < def->kid_count; i++) {
+        lower_stmt(g, def->kids[i]);
+        if (!falls_through(def->kids[i])) reaches_end = 0;
+    }
+    if (m->sig.return_type.kind != TYPE_VOID && reaches_end)
+        line(g, "cc_fail(\"%s.%s returned no value\");\n",
+             name_of(g, m->class_name), name_of(g, m->method_name));
+    g->indent = 0;
+    fputs("}\n\n", g->out);
+}
+
+// Object layout: the vtable pointer, then the fields of each class from
+// the root down, numbered so a subclass repeats its prefix verbatim
+static void emit_struct(Gen *g, int c) {
+    const ClassEntry *classes = g->env->classes;
+    int chain[64], depth = 0;
+    int *path = chain;
+    for (int k = c; k >= 0; k = classes[k].super_index) depth++;
+    if (depth > 64) path = xmalloc(depth * sizeof(int));
+    int k = c;
+    for (int d = depth - 1; d >= 0; d--, k = classes[k].super_index) path[d] = k;
+
+    fprintf(g->out, "struct c_%s {\n    const cc_method *vtable;\n", name_of(g, classes[c].name));
+    int field = 0;
+    for (int d = 0; d < depth; d++) {
+        const ASTNode *def = classes[path[d]].def;
+        for (int i = 1; i < def->kid_count; i++) {
+            const ASTNode *f = def->kids[i];
+            if (f->kind != NODE_VARDEC) continue;
+            Type t = f->kids[0]->type;
+            fprintf(g->out, "    %s%sf%d_%s;   // %s\n", c_type(t), t.kind == TYPE_CLASS ? "" : " ",
+                    field++, name_of(g, f->kids[1]->sym), name_of(g, classes[path[d]].name));
+        }
+    }
+    fputs("};\n", g->out);
+    if (path != chain) free(path);
+}
+
+// Worklist of the functions found to be needed whose code is not yet
+// scanned
+typedef struct {
+    int *ids;
+    int  count;
+} Pending;
+
+static void need_method(Gen *g, Pending *p, int id) {
+    if (id < 0 || g->emitted[id]) return;
+    g->emitted[id] = 1;
+    p->ids[p->count++] = id;
+}
+
+// A created class needs its vtable, with every method in it, and its
+// constructor
+static void need_class(Gen *g, Pending *p, int k) {
+    if (g->live[k]) return;
+    g->live[k] = 1;
+    const ClassEntry *c = &g->env->classes[k];
+    for (int s = 0; s < c->vtable_len; s++) need_method(g, p, c->vtable[s]);
+    need_method(g, p, lookup_method(g->env, c->name, SYM_CTOR));
+}
+
+// Marks what the code of 'n', in class 'cls', refers to: the classes it
+// creates and the functions it calls without a vtable
+static void mark_uses(Gen *g, Pending *p, const ASTNode *n, Symbol cls) {
+    switch (n->kind) {
+    case NODE_NEW:
+        need_class(g, p, class_number(g->env, n->kids[0]->sym));
+        break;
+    case NODE_CALL:
+        need_method(g, p, n->target);
+        break;
+    case NODE_SUPERCALL: {
+        const ClassEntry *c = &g->env->classes[class_number(g->env, cls)];
+        need_method(g, p, lookup_method(g->env, c->superclass, SYM_CTOR));
+        break;
+    }
+    default:
+        break;
+    }
+    for (int i = 0; i < n->kid_count; i++)
+        mark_uses(g, p, n->kids[i], cls);
+}
+
+int generate_c(FILE *out, const ASTNode *root, const TypeEnv *env) {
+    Gen g;
+    memset(&g, 0, sizeof g);
+    g.out     = out;
+    g.env     = env;
+    g.emitted = xcalloc(env->method_count + 1, 1);
+    g.live    = xcalloc(env->class_count + 1, 1);
+
+    // only what main reaches is generated: a function or vtable nothing
+    // refers to would be an unused static
+    const ASTNode *body = NULL;
+    for (int i = 0; i < root->kid_count && !body; i++)
+        if (root->kids[i]->kind == NODE_STMTLIST) body = root->kids[i];
+    Pending pending;
+    pending.ids   = xmalloc((env->method_count + 1) * sizeof *pending.ids);
+    pending.count = 0;
+    if (body) mark_uses(&g, &pending, body, NO_SYMBOL);
+    while (pending.count > 0) {
+        const MethodEntry *m = &env->methods[pending.ids[--pending.count]];
+        mark_uses(&g, &pending, m->def, m->class_name);
+    }
+    free(pending.ids);
+
+    fputs(runtime, out);
+    fputs("\n// Classes\n", out);
+    for (int k = 0; k < env->class_preorder_len; k++)
+        emit_struct(&g, env->class_preorder[k]);
+
+    fputs("\n// Methods and constructors\n", out);
+    for (int id = 0; id < env->method_count; id++) {
+        if (!g.emitted[id]) continue;
+        print_signature(&g, id);
+        fputs(";\n", out);
+    }
+
+    // read-only tables; objects only ever store a pointer to them
+    fputs("\n// Vtables\n", out);
+    for (int k = 0; k < env->class_preorder_len; k++) {
+        if (!g.live[env->class_preorder[k]]) continue;
+        const ClassEntry *c = &env->classes[env->class_preorder[k]];
+        fprintf(out, "static const cc_method vt_%s[] = {", name_of(&g, c->name));
+        for (int s = 0; s < c->vtable_len; s++) {
+            fprintf(out, "%s\n    (cc_method)", s ? "," : "");
+            print_method_name(&g, c->vtable[s]);
+        }
+        fputs(c->vtable_len ? "\n};\n" : " NULL };\n", out);
+    }
+    fputc('\n', out);
+
+    for (int id = 0; id < env->method_count; id++)
+        if (g.emitted[id]) emit_function(&g, id);
+
+    // the statements after the classes are the entry point
+    fputs("int main(void) {\n", out);
+    g.indent  = 1;
+    g.in_main = 1;
+    g.ret.kind = TYPE_VOID;
+    g.ret.cls  = NO_SYMBOL;
+    if (body) {
+        begin_body(&g, body, root->frame_size);
+        declare_frame_objects(&g, body);
+        lower_stmt(&g, body);
+    }
+    if (!body || falls_through(body)) fputs("    return 0;\n", out);
+    fputs("}\n", out);
+    free(g.emitted);
+    free(g.live);
+    free(g.reads);
+    free(g.bound);
+    free(g.binds);
+    return ferror(out) ? -1 : 0;
+}
@@ -0,0 +1,23 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include "../typechecker/typeenv.h"
+#include <stdio.h>
+
+// C code generator. Every class becomes a struct whose first member is
+// a vtable pointer, followed by the fields of its ancestors (root first)
+// and then its own, so an object is also a valid object of each of its
+// superclasses. Vtables are static const arrays built from the slots
+// typecheck_program assigned; a call loads the function pointer at the
+// method's slot and calls it. Objects are never freed.
+//
+// Expressions are lowered into one temporary per operation, so the
+// generated program evaluates operands left to right like the source.
+// Only the functions and vtables main can reach are emitted, and the
+// output compiles without warnings under -Wall -Wextra.
+
+// Writes the translation of a program that typecheck_program accepted,
+// with 'env' its environment. Returns 0, or -1 if writing failed.
+int generate_c(FILE *out, const ASTNode *root, const TypeEnv *env);
+
+#endif // CODEGEN_H
@@ -0,0 +1,80 @@
+#include "../compiler/compiler.h"
+#include "../tokenizer/source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Typechecks a program and writes its C translation.
+//
+//   ./main_codegen [-O0] [-v] [source [output.c]]
+//   cc -O2 -o program output.c && ./program
+//
+// -O0 skips the optimization passes, -v reports what they did on stderr.
+int main(int argc, char **argv) {
+    int optimize = 1, verbose = 0;
+    const char *files[2] = { "../typechecker/sample_typecheck_input.txt", NULL };
+    int file_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-O0") == 0)
+            optimize = 0;
+        else if (strcmp(argv[i], "-v") == 0)
+            verbose = 1;
+        else if (file_count < 2)
+            files[file_count++] = argv[i];
+        else {
+            fprintf(stderr, "usage: main_codegen [-O0] [-v] [source [output.c]]\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    SourceFile src;
+    if (load_source(files[0], &src) != 0) {
+        perror(files[0]);
+        return EXIT_FAILURE;
+    }
+    FILE *out = stdout;
+    if (files[1] && !(out = fopen(files[1], "w"))) {
+        perror(files[1]);
+        release_source(&src);
+        return EXIT_FAILURE;
+    }
+
+    CompilerContext *ctx = compiler_create(NULL);
+    int status = EXIT_SUCCESS;
+    if (compile_source(ctx, src.data) != 0) {
+        print_diagnostic(stderr, &ctx->diag);
+        status = EXIT_FAILURE;
+    } else {
+        OptReport report;
+        if (optimize) {
+            compiler_optimize(ctx, &report);
+            if (verbose) {
+                fprintf(stderr, "folded %d operators and %d variable reads, pruned %d branches "
+                        "and %d dead statements: %d nodes removed\n", report.fold.folded,
+                        report.fold.propagated, report.fold.branches_pruned,
+                        report.fold.dead_statements, report.fold.nodes_removed);
+                fprintf(stderr, "devirtualized %d of %d call sites\n",
+                        report.devirt.devirtualized, report.devirt.call_sites);
+                fprintf(stderr, "inlined %d of %d bound calls; %d callees over max_size, %d calls over max_depth\n",
+                        report.inlining.inlined, report.inlining.bound_calls, report.inlining.too_large,
+                        report.inlining.too_deep);
+                fprintf(stderr, "placed %d of %d allocation sites in their frame\n",
+                        report.escape.in_frame, report.escape.sites);
+                print_escape_sites(stderr, ctx->ast, ctx->types);
+            }
+        }
+        if (compiler_emit_c(ctx, out) != 0) {
+            perror(files[1] ? files[1] : "stdout");
+            status = EXIT_FAILURE;
+        }
+    }
+
+    // Cleanup
+    if (out != stdout && fclose(out) != 0) {
+        perror(files[1]);
+        status = EXIT_FAILURE;
+    }
+    compiler_destroy(ctx);
+    release_source(&src);
+    return status;
+}
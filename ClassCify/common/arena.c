@@ -0,0 +1,49 @@
+#include "arena.h"
+#include "xalloc.h"
+#include <stdlib.h>
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t used, size;
+    char   data[];
+};
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    ArenaChunk *head = arena->head;
+    if (!head || head->used + size > head->size) {
+        size_t chunk = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        ArenaChunk *c = xmalloc(sizeof(ArenaChunk) + chunk);
+        c->next = head;
+        c->used = 0;
+        c->size = chunk;
+        arena->head = head = c;
+    }
+    void *p = head->data + head->used;
+    head->used += size;
+    return p;
+}
+
+void arena_free(Arena *arena) {
+    while (arena->head) {
+        ArenaChunk *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+}
+
+void arena_adopt(Arena *dst, Arena *src) {
+    if (!src->head) return;
+    if (!dst->head) {
+        dst->head = src->head;
+    } else {
+        // splice in behind dst's head, which stays the chunk being filled
+        ArenaChunk *tail = src->head;
+        while (tail->next) tail = tail->next;
+        tail->next = dst->head->next;
+        dst->head->next = src->head;
+    }
+    src->head = NULL;
+}
@@ -0,0 +1,24 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator: allocations are carved out of a list of chunks and
+// released together by arena_free. An arena belongs to one thread.
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct {
+    ArenaChunk *head;      // chunk currently being filled
+} Arena;
+
+#define ARENA_INIT { NULL }
+
+// 16-byte aligned; exits on out-of-memory
+void *arena_alloc(Arena *arena, size_t size);
+// Releases every allocation; the arena can be reused afterwards
+void  arena_free(Arena *arena);
+// Moves every chunk of 'src' into 'dst' and leaves 'src' empty, so
+// allocations made on another thread live as long as 'dst'
+void  arena_adopt(Arena *dst, Arena *src);
+
+#endif // ARENA_H
@@ -0,0 +1,25 @@
+#include "diagnostic.h"
+
+void clear_diagnostic(Diagnostic *d) {
+    d->phase       = DIAG_NONE;
+    d->message     = NULL;
+    d->near        = NULL;
+    d->near_length = 0;
+}
+
+void print_diagnostic(FILE *out, const Diagnostic *d) {
+    switch (d->phase) {
+    case DIAG_PARSE:
+        if (!d->near)
+            fprintf(out, "Parse error at end of input: %s\n", d->message);
+        else
+            fprintf(out, "Parse error at token '%.*s': %s\n",
+                    d->near_length, d->near, d->message);
+        break;
+    case DIAG_TYPE:
+        fprintf(out, "Type error at '%.*s': %s\n", d->near_length, d->near, d->message);
+        break;
+    case DIAG_NONE:
+        break;
+    }
+}
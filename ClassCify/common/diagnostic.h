@@ -0,0 +1,27 @@
+#ifndef DIAGNOSTIC_H
+#define DIAGNOSTIC_H
+
+#include <stdio.h>
+
+// Which stage rejected the program
+typedef enum {
+    DIAG_NONE,
+    DIAG_PARSE,
+    DIAG_TYPE
+} DiagPhase;
+
+// The first error a stage ran into. The library stops at that point and
+// hands this back instead of printing and exiting. 'near' points into the
+// source text or the AST, so it is valid for as long as they are.
+typedef struct {
+    DiagPhase   phase;
+    const char *message;     // static text
+    const char *near;        // offending token or node label, NULL at end of input
+    int         near_length;
+} Diagnostic;
+
+void clear_diagnostic(Diagnostic *d);
+// Same wording the command-line tools have always printed
+void print_diagnostic(FILE *out, const Diagnostic *d);
+
+#endif // DIAGNOSTIC_H
@@ -0,0 +1,213 @@
+#include "threadpool.h"
+#include "xalloc.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    TaskFn     fn;
+    void      *arg;
+    TaskGroup *group;
+} Task;
+
+// Ring buffer of tasks: the owner pushes and pops at 'tail', thieves
+// take from 'head'. A mutex per deque keeps it simple; contention only
+// happens while stealing.
+typedef struct {
+    pthread_mutex_t lock;
+    Task *buf;
+    int   cap;
+    long  head, tail;
+} Deque;
+
+struct ThreadPool {
+    int              nthreads;
+    pthread_t       *threads;
+    Deque           *deques;     // one per worker
+    pthread_mutex_t  sleep_lock;
+    pthread_cond_t   wake;       // new work, a finished group, or shutdown
+    atomic_int       queued;     // tasks sitting in deques
+    atomic_int       stop;
+    atomic_uint      next;       // round-robin target for outside submitters
+};
+
+typedef struct {
+    ThreadPool *pool;
+    int         index;
+} WorkerArg;
+
+// Which pool and deque the current thread works for, if any
+static _Thread_local ThreadPool *current_pool  = NULL;
+static _Thread_local int         current_index = -1;
+
+int default_thread_count(void) {
+    const char *env = getenv("CLASSCIFY_THREADS");
+    if (env && atoi(env) > 0) return atoi(env);
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+static void deque_push(Deque *d, Task t) {
+    pthread_mutex_lock(&d->lock);
+    if (d->tail - d->head == d->cap) {
+        int   cap = d->cap ? d->cap * 2 : 64;
+        Task *buf = xmalloc(cap * sizeof *buf);
+        for (long i = d->head; i < d->tail; i++)
+            buf[i % cap] = d->buf[i % d->cap];
+        free(d->buf);
+        d->buf = buf;
+        d->cap = cap;
+    }
+    d->buf[d->tail % d->cap] = t;
+    d->tail++;
+    pthread_mutex_unlock(&d->lock);
+}
+
+// Newest task, for the owner
+static int deque_pop(Deque *d, Task *out) {
+    int ok = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head) {
+        d->tail--;
+        *out = d->buf[d->tail % d->cap];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+// Oldest task, for thieves
+static int deque_steal(Deque *d, Task *out) {
+    int ok = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head) {
+        *out = d->buf[d->head % d->cap];
+        d->head++;
+        ok = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+// Own deque first, then sweep the others starting after 'self'
+static int take_task(ThreadPool *pool, int self, Task *out) {
+    if (atomic_load(&pool->queued) == 0) return 0;
+    if (self >= 0 && deque_pop(&pool->deques[self], out)) {
+        atomic_fetch_sub(&pool->queued, 1);
+        return 1;
+    }
+    for (int i = 1; i <= pool->nthreads; i++) {
+        int victim = ((self < 0 ? 0 : self) + i) % pool->nthreads;
+        if (deque_steal(&pool->deques[victim], out)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void run_task(ThreadPool *pool, Task t) {
+    t.fn(t.arg);
+    if (atomic_fetch_sub(&t.group->pending, 1) == 1) {
+        // last task of the group: wake anyone in threadpool_wait
+        pthread_mutex_lock(&pool->sleep_lock);
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->sleep_lock);
+    }
+}
+
+static void *worker_main(void *p) {
+    WorkerArg  *w    = p;
+    ThreadPool *pool = w->pool;
+    current_pool  = pool;
+    current_index = w->index;
+    free(w);
+
+    while (!atomic_load(&pool->stop)) {
+        Task t;
+        if (take_task(pool, current_index, &t)) {
+            run_task(pool, t);
+            continue;
+        }
+        pthread_mutex_lock(&pool->sleep_lock);
+        while (atomic_load(&pool->queued) == 0 && !atomic_load(&pool->stop))
+            pthread_cond_wait(&pool->wake, &pool->sleep_lock);
+        pthread_mutex_unlock(&pool->sleep_lock);
+    }
+    return NULL;
+}
+
+ThreadPool *threadpool_create(int threads) {
+    if (threads <= 0) threads = default_thread_count();
+    ThreadPool *pool = xcalloc(1, sizeof *pool);
+    pool->nthreads = threads;
+    pool->threads  = xcalloc(threads, sizeof *pool->threads);
+    pool->deques   = xcalloc(threads, sizeof *pool->deques);
+    pthread_mutex_init(&pool->sleep_lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->stop, 0);
+    atomic_init(&pool->next, 0);
+    for (int i = 0; i < threads; i++)
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    for (int i = 0; i < threads; i++) {
+        WorkerArg *w = xmalloc(sizeof *w);
+        w->pool  = pool;
+        w->index = i;
+        pthread_create(&pool->threads[i], NULL, worker_main, w);
+    }
+    return pool;
+}
+
+void threadpool_destroy(ThreadPool *pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->sleep_lock);
+    atomic_store(&pool->stop, 1);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->sleep_lock);
+    for (int i = 0; i < pool->nthreads; i++)
+        pthread_join(pool->threads[i], NULL);
+    for (int i = 0; i < pool->nthreads; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].buf);
+    }
+    pthread_mutex_destroy(&pool->sleep_lock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}
+
+int threadpool_size(const ThreadPool *pool) {
+    return pool->nthreads;
+}
+
+void threadpool_submit(ThreadPool *pool, TaskGroup *group, TaskFn fn, void *arg) {
+    Task t = { fn, arg, group };
+    atomic_fetch_add(&group->pending, 1);
+    // workers keep their own tasks local; everyone else spreads them out
+    int target = current_pool == pool
+               ? current_index
+               : (int)(atomic_fetch_add(&pool->next, 1) % (unsigned)pool->nthreads);
+    // counted first, so a thief's decrement never takes it below zero
+    atomic_fetch_add(&pool->queued, 1);
+    deque_push(&pool->deques[target], t);
+    pthread_mutex_lock(&pool->sleep_lock);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->sleep_lock);
+}
+
+void threadpool_wait(ThreadPool *pool, TaskGroup *group) {
+    int self = current_pool == pool ? current_index : -1;
+    while (atomic_load(&group->pending) > 0) {
+        Task t;
+        if (take_task(pool, self, &t)) {
+            run_task(pool, t);
+            continue;
+        }
+        pthread_mutex_lock(&pool->sleep_lock);
+        while (atomic_load(&group->pending) > 0 && atomic_load(&pool->queued) == 0)
+            pthread_cond_wait(&pool->wake, &pool->sleep_lock);
+        pthread_mutex_unlock(&pool->sleep_lock);
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdatomic.h>
+
+// Work-stealing thread pool. Each worker owns a deque: it runs its own
+// tasks newest-first and, when that runs dry, steals the oldest task
+// from another worker. Threads blocked in threadpool_wait run tasks too,
+// so waiting inside a task cannot deadlock the pool.
+
+typedef void (*TaskFn)(void *arg);
+
+// Tasks are counted per group so callers can wait for just their own
+typedef struct {
+    atomic_int pending;
+} TaskGroup;
+
+typedef struct ThreadPool ThreadPool;
+
+// 'threads' <= 0 picks default_thread_count()
+ThreadPool *threadpool_create(int threads);
+void        threadpool_destroy(ThreadPool *pool);
+int         threadpool_size(const ThreadPool *pool);
+
+void threadpool_submit(ThreadPool *pool, TaskGroup *group, TaskFn fn, void *arg);
+// Returns once every task submitted to 'group' has finished
+void threadpool_wait(ThreadPool *pool, TaskGroup *group);
+
+// CLASSCIFY_THREADS if set, otherwise the number of online CPUs
+int default_thread_count(void);
+
+#endif // THREADPOOL_H
@@ -0,0 +1,53 @@
+#include "xalloc.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 'empty': nothing was asked for, so NULL is a valid answer
+static void *checked(void *p, int empty) {
+    if (!p && !empty) {
+        fprintf(stderr, "Out of memory!\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+void *xmalloc(size_t size) {
+    return checked(malloc(size), size == 0);
+}
+
+void *xcalloc(size_t count, size_t size) {
+    return checked(calloc(count, size), count == 0 || size == 0);
+}
+
+void *xrealloc(void *p, size_t size) {
+    return checked(realloc(p, size), size == 0);
+}
+
+char *xstrdup(const char *s) {
+    size_t size = strlen(s) + 1;
+    return memcpy(xmalloc(size), s, size);
+}
+
+char *xformat(const char *fmt, ...) {
+    // measure into a local buffer, which is all most names need
+    char small[64];
+    va_list ap, again;
+    va_start(ap, fmt);
+    va_copy(again, ap);
+    int length = vsnprintf(small, sizeof small, fmt, ap);
+    va_end(ap);
+    if (length < 0) {
+        fprintf(stderr, "Bad format string: %s\n", fmt);
+        exit(EXIT_FAILURE);
+    }
+    size_t size = (size_t)length + 1;
+    char *s = xmalloc(size);
+    if (size <= sizeof small)
+        memcpy(s, small, size);
+    else
+        vsnprintf(s, size, fmt, again);
+    va_end(again);
+    return s;
+}
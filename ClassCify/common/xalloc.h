@@ -0,0 +1,17 @@
+#ifndef XALLOC_H
+#define XALLOC_H
+
+#include <stddef.h>
+
+// malloc, calloc and realloc for memory the caller cannot do without:
+// on failure they print "Out of memory!" and exit instead of returning
+// NULL. A zero-byte request may still return NULL, as the library's can.
+void *xmalloc(size_t size);
+void *xcalloc(size_t count, size_t size);
+void *xrealloc(void *p, size_t size);
+char *xstrdup(const char *s);
+
+// a newly allocated string formatted as by printf
+char *xformat(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#endif // XALLOC_H
@@ -0,0 +1,88 @@
+#include "compiler.h"
+#include "../common/xalloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+CompilerContext *compiler_create(ThreadPool *pool) {
+    CompilerContext *ctx = xcalloc(1, sizeof *ctx);
+    ctx->names = create_intern_table();
+    ctx->pool  = pool;
+    ctx->inline_budget = (InlineBudget)DEFAULT_INLINE_BUDGET;
+    clear_diagnostic(&ctx->diag);
+    return ctx;
+}
+
+void compiler_destroy(CompilerContext *ctx) {
+    if (!ctx) return;
+    compiler_reset(ctx);
+    free_intern_table(ctx->names);
+    free(ctx);
+}
+
+void compiler_reset(CompilerContext *ctx) {
+    free_type_env(ctx->types);
+    ctx->types = NULL;
+    ctx->ast   = NULL;
+    arena_free(&ctx->arena);
+    close_ast_cache(&ctx->cache);
+    // symbol ids are per unit, so names do not pile up across files
+    if (symbol_count(ctx->names) > SYM_PREDEFINED_COUNT) {
+        free_intern_table(ctx->names);
+        ctx->names = create_intern_table();
+    }
+    clear_diagnostic(&ctx->diag);
+}
+
+int compiler_parse(CompilerContext *ctx, const char *source) {
+    compiler_reset(ctx);
+    char path[4096];
+    size_t length = 0;
+    uint64_t hash = 0;
+    if (ctx->cache_dir) {
+        length = strlen(source);
+        hash   = source_hash(source, length);
+        if (ast_cache_path(path, sizeof path, ctx->cache_dir, hash) >= (int)sizeof path)
+            path[0] = '\0';
+        else if (open_ast_cache(path, hash, source, length, &ctx->cache) == 0) {
+            ctx->ast = load_cached_ast(&ctx->cache, &ctx->arena, ctx->names);
+            return 0;
+        }
+    }
+    Parser parser;
+    init_parser(&parser, source, ctx->names, &ctx->arena);
+    ctx->ast  = parse_program_parallel(&parser, ctx->pool);
+    ctx->diag = parser.diag;
+    free_parser(&parser);
+    // a failed write only costs the next run a parse
+    if (ctx->ast && ctx->cache_dir && path[0])
+        write_ast_cache(path, ctx->ast, ctx->names, hash, source, length);
+    return ctx->ast ? 0 : -1;
+}
+
+int compiler_check(CompilerContext *ctx) {
+    if (!ctx->ast) return -1;
+    free_type_env(ctx->types);
+    ctx->types = typecheck_program(ctx->ast, ctx->names, ctx->pool, &ctx->diag);
+    return ctx->types ? 0 : -1;
+}
+
+int compile_source(CompilerContext *ctx, const char *source) {
+    if (compiler_parse(ctx, source) != 0) return -1;
+    return compiler_check(ctx);
+}
+
+int compiler_optimize(CompilerContext *ctx, OptReport *report) {
+    if (!ctx->types) return -1;
+    // folding first: calls in dead code need no binding
+    fold_constants(ctx->ast, &ctx->arena, &report->fold);
+    devirtualize(ctx->ast, ctx->types, &report->devirt);
+    inline_calls(ctx->ast, ctx->types, &ctx->arena, &ctx->inline_budget, &report->inlining);
+    analyze_escapes(ctx->ast, ctx->types, &report->escape);
+    return 0;
+}
+
+int compiler_emit_c(CompilerContext *ctx, FILE *out) {
+    if (!ctx->types) return -1;
+    return generate_c(out, ctx->ast, ctx->types);
+}
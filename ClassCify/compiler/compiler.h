@@ -0,0 +1,50 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "../parser/parser.h"
+#include "../parser/astcache.h"
+#include "../typechecker/typechecker.h"
+#include "../codegen/codegen.h"
+#include "../opt/opt.h"
+
+// Owns everything a compilation touches: interned names, the AST arena
+// and the class environment. Contexts share no state, so a process can
+// compile any number of files back to back, or on several threads with
+// one context each.
+typedef struct {
+    InternTable *names;
+    Arena        arena;     // nodes of the current unit
+    ASTNode     *ast;       // current program, NULL until parsed
+    TypeEnv     *types;     // set once the current program typechecks
+    ThreadPool  *pool;      // borrowed, may be NULL; see typecheck_program
+    Diagnostic   diag;      // why the last call failed
+    const char  *cache_dir; // AST cache directory, NULL to always parse
+    AstCache     cache;     // mapping the current AST was loaded from
+    InlineBudget inline_budget; // compiler_optimize's; starts as DEFAULT_INLINE_BUDGET
+} CompilerContext;
+
+// What compiler_optimize did, per pass
+typedef struct {
+    FoldStats   fold;
+    DevirtStats devirt;
+    InlineStats inlining;
+    EscapeStats escape;
+} OptReport;
+
+CompilerContext *compiler_create(ThreadPool *pool);
+void             compiler_destroy(CompilerContext *ctx);
+// Drops the current unit; diagnostics pointing into it become invalid
+void             compiler_reset(CompilerContext *ctx);
+
+// Each returns 0 on success, or -1 with ctx->diag set. 'source' must be
+// NUL-terminated and stay alive while the unit is in use.
+// With a cache_dir, compiler_parse loads the AST cached for an identical
+// source instead of parsing, and caches what it does parse.
+int compiler_parse(CompilerContext *ctx, const char *source); // starts a new unit
+int compiler_check(CompilerContext *ctx);                     // typechecks ctx->ast
+int compile_source(CompilerContext *ctx, const char *source); // both
+int compiler_emit_c(CompilerContext *ctx, FILE *out);         // C for a checked unit
+// Runs the whole-program passes on a checked unit, before emitting it
+int compiler_optimize(CompilerContext *ctx, OptReport *report);
+
+#endif // COMPILER_H
@@ -0,0 +1,73 @@
+#!/bin/sh
+# Differential tests: runs every program in this directory on each
+# backend and compares what it prints with <name>.out. A program that
+# must stop with a runtime error also has <name>.err, the message it
+# prints on stderr; every other one must exit 0 with stderr empty.
+#
+#   ./run.sh [bindir]
+#
+# bindir holds main_vm, main_ir and main_codegen. Without it they are
+# built from the sources into a temporary directory with $CC (cc). The
+# backends are the bytecode VM, the unoptimized tree walker, the IR
+# interpreter checking SSA after every pass, and the generated C.
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$here")
+CC=${CC:-cc}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+bin=$1
+if [ -z "$bin" ]; then
+    bin=$work
+    lib=$(find "$root" -name '*.c' ! -name 'main*' ! -name 'bench_*' ! -path "$here/*")
+    for tool in vm/main_vm ir/main_ir codegen/main_codegen; do
+        $CC -O2 -pthread -o "$bin/$(basename $tool)" "$root/$tool.c" $lib || exit 1
+    done
+fi
+
+# run <name> <program> <command...>: stdout to $work/stdout, stderr to
+# $work/stderr, and fails unless both and the exit status are as expected
+run() {
+    name=$1 program=$2
+    shift 2
+    "$@" >"$work/stdout" 2>"$work/stderr"
+    status=$?
+    base=${program%.txt}
+    if [ -f "$base.err" ]; then
+        [ $status -ne 0 ] && cmp -s "$base.err" "$work/stderr"
+    else
+        [ $status -eq 0 ] && [ ! -s "$work/stderr" ]
+    fi || {
+        echo "FAIL $(basename "$program") ($name): exit $status"
+        cat "$work/stderr"
+        return 1
+    }
+    diff "$base.out" "$work/stdout" >"$work/diff" || {
+        echo "FAIL $(basename "$program") ($name): stdout differs"
+        cat "$work/diff"
+        return 1
+    }
+}
+
+# the generated C, compiled
+run_c() {
+    "$bin/main_codegen" "$1" "$work/prog.c" &&
+        $CC -O2 -o "$work/prog" "$work/prog.c" &&
+        "$work/prog"
+}
+
+passed=0 failed=0
+for program in "$here"/*.txt; do
+    for backend in vm tree ir c; do
+        case $backend in
+        vm)   run vm   "$program" "$bin/main_vm" "$program" ;;
+        tree) run tree "$program" "$bin/main_vm" -t -O0 "$program" ;;
+        ir)   run ir   "$program" "$bin/main_ir" -V "$program" ;;
+        c)    run c    "$program" run_c "$program" ;;
+        esac
+        if [ $? -eq 0 ]; then passed=$((passed + 1)); else failed=$((failed + 1)); fi
+    done
+done
+echo "$passed passed, $failed failed"
+[ $failed -eq 0 ]
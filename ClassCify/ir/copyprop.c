@@ -0,0 +1,45 @@
+#include "pass.h"
+#include "../common/xalloc.h"
+#include <stdlib.h>
+
+static int find(const int *map, int v) {
+    while (map[v] != v) v = map[v];
+    return v;
+}
+
+// A copy is its operand, and a phi whose operands are all itself or one
+// other value is that value. Replacing one can leave another phi with a
+// single operand, so this repeats until nothing changes.
+int copy_propagation(IRFunction *fn, const IRProgram *prog) {
+    (void)prog;
+    int *map = xmalloc((fn->value_count + 1) * sizeof *map);
+    for (int id = 0; id < fn->value_count; id++) map[id] = id;
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (int id = 0; id < fn->value_count; id++) {
+            const IRValue *v = &fn->values[id];
+            if (v->dead || map[id] != id) continue;
+            int same = -1;
+            if (v->op == IR_COPY) {
+                same = find(map, v->args[0]);
+            } else if (v->op == IR_PHI) {
+                for (int a = 0; a < v->argc; a++) {
+                    int arg = find(map, v->args[a]);
+                    if (arg == same || arg == id) continue;
+                    if (same >= 0) {
+                        same = -1;
+                        break;
+                    }
+                    same = arg;
+                }
+            }
+            if (same >= 0 && same != id) {
+                map[id] = same;
+                changed = 1;
+            }
+        }
+    }
+    int replaced = ir_replace_values(fn, map);
+    free(map);
+    return replaced;
+}
@@ -0,0 +1,55 @@
+#include "pass.h"
+#include "../common/xalloc.h"
+#include <stdlib.h>
+
+// Whether 'v' must stay even when nothing uses it
+static int has_effect(const IRFunction *fn, const IRValue *v) {
+    switch (v->op) {
+    case IR_PRINT: case IR_CALL: case IR_CALLV: case IR_CHECK:
+        return 1;
+    case IR_DIV: {
+        // a division traps unless its divisor is known not to be zero
+        const IRValue *d = &fn->values[v->args[1]];
+        return d->op != IR_CONST || d->imm == 0;
+    }
+    default:
+        return IR_IS_TERMINATOR(v->op);
+    }
+}
+
+// Mark and sweep: values with an effect are live, and so is everything
+// a live value uses. Dead cycles of phis go too.
+int dead_code_elimination(IRFunction *fn, const IRProgram *prog) {
+    (void)prog;
+    char *live  = xcalloc(fn->value_count + 1, 1);
+    int  *stack = xmalloc((fn->value_count + 1) * sizeof *stack);
+    int top = 0;
+    for (int id = 0; id < fn->value_count; id++) {
+        const IRValue *v = &fn->values[id];
+        if (!v->dead && has_effect(fn, v)) {
+            live[id] = 1;
+            stack[top++] = id;
+        }
+    }
+    while (top) {
+        const IRValue *v = &fn->values[stack[--top]];
+        for (int a = 0; a < v->argc; a++) {
+            if (!live[v->args[a]]) {
+                live[v->args[a]] = 1;
+                stack[top++] = v->args[a];
+            }
+        }
+    }
+    int removed = 0;
+    for (int id = 0; id < fn->value_count; id++) {
+        IRValue *v = &fn->values[id];
+        if (!v->dead && !live[id]) {
+            v->dead = 1;
+            removed++;
+        }
+    }
+    if (removed) ir_compact(fn);
+    free(stack);
+    free(live);
+    return removed;
+}
@@ -0,0 +1,155 @@
+#include "pass.h"
+#include "../common/xalloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Dominator-based value numbering: walks the dominator tree keeping a
+// table of the values available at each block, keyed by what they
+// compute. A value that matches one in the table is replaced by it,
+// since the earlier one dominates it. Entries are undone on the way back
+// up, so the table only ever holds dominating values.
+
+typedef struct {
+    IRFunction *fn;
+    int        *map;      // value -> the value it is replaced by
+    int        *heads;    // hash bucket -> newest value in it, -1 if empty
+    unsigned    mask;
+    int        *next;     // value -> the value under it in its bucket
+    unsigned   *hash;
+    int        *undo;     // values in insertion order
+    int         undo_count;
+} Numbering;
+
+static int numbered(IROp op) {
+    switch (op) {
+    case IR_CONST: case IR_NIL: case IR_PHI:
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_LT: case IR_EQ:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int commutative(IROp op) {
+    return op == IR_ADD || op == IR_MUL || op == IR_EQ;
+}
+
+static unsigned hash_value(const IRValue *v) {
+    unsigned h = v->op * 0x9e3779b1u;
+    h = (h ^ v->type.kind) * 0x85ebca6bu;
+    h = (h ^ (unsigned)v->type.cls) * 0x85ebca6bu;
+    h = (h ^ (unsigned)v->imm) * 0xc2b2ae35u;
+    // phis in different blocks merge different edges
+    if (v->op == IR_PHI) h = (h ^ (unsigned)v->block) * 0xc2b2ae35u;
+    for (int a = 0; a < v->argc; a++) h = (h ^ (unsigned)v->args[a]) * 0x9e3779b1u;
+    return h ^ (h >> 15);
+}
+
+static int same_value(const IRValue *a, const IRValue *b) {
+    if (a->op != b->op || a->type.kind != b->type.kind || a->type.cls != b->type.cls || a->imm != b->imm ||
+        a->argc != b->argc || (a->op == IR_PHI && a->block != b->block))
+        return 0;
+    for (int i = 0; i < a->argc; i++)
+        if (a->args[i] != b->args[i]) return 0;
+    return 1;
+}
+
+static void number_block(Numbering *n, int block) {
+    IRFunction *fn = n->fn;
+    const IRBlock *b = &fn->blocks[block];
+    for (int i = 0; i < b->inst_count; i++) {
+        int id = b->insts[i];
+        IRValue *v = &fn->values[id];
+        // operands in terms of the values that stay
+        for (int a = 0; a < v->argc; a++) v->args[a] = n->map[v->args[a]];
+        if (!numbered(v->op)) continue;
+        if (commutative(v->op) && v->args[0] > v->args[1]) {
+            int t = v->args[0];
+            v->args[0] = v->args[1];
+            v->args[1] = t;
+        }
+        unsigned h = hash_value(v);
+        int found = n->heads[h & n->mask];
+        while (found >= 0 && !same_value(&fn->values[found], v)) found = n->next[found];
+        if (found >= 0) {
+            n->map[id] = found;
+            continue;
+        }
+        n->hash[id] = h;
+        n->next[id] = n->heads[h & n->mask];
+        n->heads[h & n->mask] = id;
+        n->undo[n->undo_count++] = id;
+    }
+}
+
+// Takes out the entries made since the table held 'mark' of them
+static void unwind(Numbering *n, int mark) {
+    while (n->undo_count > mark) {
+        int id = n->undo[--n->undo_count];
+        n->heads[n->hash[id] & n->mask] = n->next[id];
+    }
+}
+
+int global_value_numbering(IRFunction *fn, const IRProgram *prog) {
+    (void)prog;
+    int blocks = fn->block_count, values = fn->value_count;
+    int *idom  = xmalloc(blocks * sizeof *idom);
+    int *rpo   = xmalloc(blocks * sizeof *rpo);
+    ir_dominators(fn, idom, rpo);
+
+    // dominator tree as child lists
+    int *first_child  = xmalloc(blocks * sizeof *first_child);
+    int *next_sibling = xmalloc(blocks * sizeof *next_sibling);
+    for (int b = 0; b < blocks; b++) first_child[b] = -1;
+    for (int b = blocks - 1; b > 0; b--) {
+        if (idom[b] < 0) continue;
+        next_sibling[b] = first_child[idom[b]];
+        first_child[idom[b]] = b;
+    }
+
+    Numbering n;
+    n.fn   = fn;
+    n.mask = 15;
+    while (n.mask < (unsigned)values) n.mask = n.mask * 2 + 1;
+    n.heads = xmalloc((n.mask + 1) * sizeof *n.heads);
+    memset(n.heads, -1, (n.mask + 1) * sizeof *n.heads);
+    n.map   = xmalloc(values * sizeof *n.map);
+    n.next  = xmalloc(values * sizeof *n.next);
+    n.hash  = xmalloc(values * sizeof *n.hash);
+    n.undo  = xmalloc(values * sizeof *n.undo);
+    n.undo_count = 0;
+    for (int id = 0; id < values; id++) n.map[id] = id;
+
+    // preorder walk; a block's entry on the stack is ~block once its
+    // children are pushed, and its table entries go when that pops
+    int *stack = xmalloc(2 * blocks * sizeof *stack);
+    int *mark  = xmalloc(blocks * sizeof *mark);
+    int top = 0;
+    stack[top++] = 0;
+    while (top) {
+        int b = stack[--top];
+        if (b < 0) {
+            unwind(&n, mark[~b]);
+            continue;
+        }
+        mark[b] = n.undo_count;
+        number_block(&n, b);
+        stack[top++] = ~b;
+        for (int c = first_child[b]; c >= 0; c = next_sibling[c])
+            stack[top++] = c;
+    }
+
+    int replaced = ir_replace_values(fn, n.map);
+    free(mark);
+    free(stack);
+    free(n.undo);
+    free(n.hash);
+    free(n.next);
+    free(n.map);
+    free(n.heads);
+    free(next_sibling);
+    free(first_child);
+    free(rpo);
+    free(idom);
+    return replaced;
+}
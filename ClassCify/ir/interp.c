@@ -0,0 +1,159 @@
+#include "ir.h"
+#include "../common/arena.h"
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Reference interpreter for the IR, to check lowering and passes against
+// the other backends. Calls recurse on the C stack, as in the tree walker.
+#define MAX_DEPTH 10000
+
+typedef struct {
+    int32_t class_index;   // TypeEnv class entry
+} Object;
+
+typedef union {
+    int32_t i;
+    Object *obj;
+} Cell;
+
+typedef struct {
+    const IRProgram *prog;
+    FILE            *out;
+    Arena            heap;     // objects live until the program ends
+    Cell            *stack;    // values of the active calls
+    int              stack_top, stack_cap;
+    int              depth;
+    const char      *error;
+    jmp_buf          bail;
+} Interp;
+
+static _Noreturn void fail(Interp *in, const char *msg) {
+    in->error = msg;
+    longjmp(in->bail, 1);
+}
+
+static Cell call(Interp *in, int f, const Cell *args);
+
+static Cell invoke(Interp *in, const IRValue *v, int base) {
+    Cell args[v->argc + 1];
+    for (int a = 0; a < v->argc; a++) args[a] = in->stack[base + v->args[a]];
+    if (!args[0].obj) fail(in, "method call on a null object");
+    int f = v->imm;
+    if (v->op == IR_CALLV) f = in->prog->env->classes[args[0].obj->class_index].vtable[v->imm];
+    return call(in, f, args);
+}
+
+static Cell call(Interp *in, int f, const Cell *args) {
+    static _Thread_local char message[256];
+    const IRFunction *fn = &in->prog->functions[f];
+    if (in->depth == MAX_DEPTH) fail(in, "stack overflow");
+    in->depth++;
+    // the stack may move during nested calls, so values go through 'base'
+    int base = in->stack_top;
+    if (base + fn->value_count > in->stack_cap) {
+        while (base + fn->value_count > in->stack_cap) in->stack_cap = in->stack_cap ? in->stack_cap * 2 : 1024;
+        Cell *grown = realloc(in->stack, in->stack_cap * sizeof *in->stack);
+        if (!grown) fail(in, "out of memory");
+        in->stack = grown;
+    }
+    in->stack_top += fn->value_count;
+    #define VAL(id) in->stack[base + (id)]
+
+    int block = 0, from = -1;
+    for (;;) {
+        const IRBlock *b = &fn->blocks[block];
+        int i = 0;
+        if (from >= 0) {
+            // phis read their operands as the edge left them, together
+            int k = 0;
+            while (b->preds[k] != from) k++;
+            int phis = 0;
+            while (phis < b->inst_count && fn->values[b->insts[phis]].op == IR_PHI) phis++;
+            Cell incoming[phis + 1];
+            for (int p = 0; p < phis; p++) incoming[p] = VAL(fn->values[b->insts[p]].args[k]);
+            for (int p = 0; p < phis; p++) VAL(b->insts[p]) = incoming[p];
+            i = phis;
+        }
+        for (; i < b->inst_count; i++) {
+            int id = b->insts[i];
+            const IRValue *v = &fn->values[id];
+            #define ARG(n) VAL(v->args[n])
+            switch ((IROp)v->op) {
+            case IR_CONST: VAL(id).i = v->imm; break;
+            case IR_NIL:   VAL(id).obj = NULL; break;
+            case IR_PARAM: VAL(id) = args[v->imm]; break;
+            case IR_COPY:  VAL(id) = ARG(0); break;
+            case IR_PHI:   break;
+            case IR_ADD: VAL(id).i = (int32_t)((uint32_t)ARG(0).i + (uint32_t)ARG(1).i); break;
+            case IR_SUB: VAL(id).i = (int32_t)((uint32_t)ARG(0).i - (uint32_t)ARG(1).i); break;
+            case IR_MUL: VAL(id).i = (int32_t)((uint32_t)ARG(0).i * (uint32_t)ARG(1).i); break;
+            case IR_DIV: {
+                int32_t x = ARG(0).i, y = ARG(1).i;
+                if (y == 0) fail(in, "division by zero");
+                VAL(id).i = x == INT32_MIN && y == -1 ? x : x / y;
+                break;
+            }
+            case IR_LT: VAL(id).i = ARG(0).i < ARG(1).i; break;
+            case IR_EQ: VAL(id).i = ARG(0).i == ARG(1).i; break;
+            case IR_PRINT:
+                fprintf(in->out, "%d\n", (int)ARG(0).i);
+                VAL(id).i = 0;
+                break;
+            case IR_NEW: {
+                Object *o = arena_alloc(&in->heap, sizeof *o);
+                o->class_index = v->imm;
+                VAL(id).obj = o;
+                break;
+            }
+            case IR_CALL:
+            case IR_CALLV: {
+                Cell result = invoke(in, v, base);
+                VAL(id) = result;
+                break;
+            }
+            case IR_CHECK:
+                if (!ARG(0).obj) fail(in, "method call on a null object");
+                VAL(id).i = 0;
+                break;
+            case IR_JUMP:
+                from  = block;
+                block = b->succs[0];
+                break;
+            case IR_BRANCH:
+                from  = block;
+                block = b->succs[ARG(0).i ? 0 : 1];
+                break;
+            case IR_RET: {
+                Cell result = { 0 };
+                if (v->argc) result = ARG(0);
+                in->stack_top = base;
+                in->depth--;
+                return result;
+            }
+            case IR_NORET:
+                snprintf(message, sizeof message, "%s returned no value", fn->name);
+                fail(in, message);
+            default:
+                fail(in, "bad instruction");
+            }
+            #undef ARG
+        }
+    }
+    #undef VAL
+}
+
+int run_ir(const IRProgram *prog, FILE *out, const char **error) {
+    Interp in;
+    memset(&in, 0, sizeof in);
+    in.prog = prog;
+    in.out  = out;
+    in.heap = (Arena)ARENA_INIT;
+    if (setjmp(in.bail) == 0)
+        call(&in, prog->main, NULL);
+    int status = in.error ? -1 : 0;
+    if (in.error) *error = in.error;
+    free(in.stack);
+    arena_free(&in.heap);
+    return status;
+}
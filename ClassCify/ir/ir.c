@@ -0,0 +1,392 @@
+#include "ir.h"
+#include "../common/xalloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define IR_OP_NAME(name) #name,
+const char *const ir_op_names[IR_OP_COUNT] = { IR_OPS(IR_OP_NAME) };
+#undef IR_OP_NAME
+
+// Grows '*array' of 'size'-byte elements to hold one more than 'count'
+static void reserve(void *array, int count, int *cap, size_t size) {
+    void **p = array;
+    if (count < *cap) return;
+    *cap = *cap ? *cap * 2 : 4;
+    *p = xrealloc(*p, *cap * size);
+}
+
+int ir_block(IRFunction *fn) {
+    reserve(&fn->blocks, fn->block_count, &fn->block_cap, sizeof *fn->blocks);
+    IRBlock *b = &fn->blocks[fn->block_count];
+    memset(b, 0, sizeof *b);
+    return fn->block_count++;
+}
+
+int ir_value(IRFunction *fn, int block, IROp op, Type type, int32_t imm) {
+    reserve(&fn->values, fn->value_count, &fn->value_cap, sizeof *fn->values);
+    int id = fn->value_count++;
+    IRValue *v = &fn->values[id];
+    memset(v, 0, sizeof *v);
+    v->op    = (uint8_t)op;
+    v->type  = type;
+    v->block = block;
+    v->imm   = imm;
+
+    IRBlock *b = &fn->blocks[block];
+    reserve(&b->insts, b->inst_count, &b->inst_cap, sizeof *b->insts);
+    int at = b->inst_count;
+    if (op == IR_PHI) {
+        at = 0;
+        while (at < b->inst_count && fn->values[b->insts[at]].op == IR_PHI) at++;
+        memmove(b->insts + at + 1, b->insts + at, (b->inst_count - at) * sizeof *b->insts);
+    }
+    b->insts[at] = id;
+    b->inst_count++;
+    return id;
+}
+
+void ir_add_arg(IRFunction *fn, int value, int arg) {
+    IRValue *v = &fn->values[value];
+    reserve(&v->args, v->argc, &v->argcap, sizeof *v->args);
+    v->args[v->argc++] = arg;
+}
+
+void ir_make_const(IRFunction *fn, int value, int32_t imm) {
+    IRValue *v = &fn->values[value];
+    v->op   = v->type.kind == TYPE_CLASS ? IR_NIL : IR_CONST;
+    v->imm  = imm;
+    v->argc = 0;
+}
+
+void ir_add_edge(IRFunction *fn, int from, int to) {
+    IRBlock *f = &fn->blocks[from];
+    f->succs[f->succ_count++] = to;
+    IRBlock *t = &fn->blocks[to];
+    reserve(&t->preds, t->pred_count, &t->pred_cap, sizeof *t->preds);
+    t->preds[t->pred_count++] = from;
+}
+
+void ir_remove_edge(IRFunction *fn, int from, int to) {
+    IRBlock *f = &fn->blocks[from];
+    for (int s = 0; s < f->succ_count; s++) {
+        if (f->succs[s] == to) {
+            f->succs[s] = f->succs[--f->succ_count];
+            break;
+        }
+    }
+    IRBlock *t = &fn->blocks[to];
+    int k = 0;
+    while (k < t->pred_count && t->preds[k] != from) k++;
+    if (k == t->pred_count) return;
+    memmove(t->preds + k, t->preds + k + 1, (t->pred_count - k - 1) * sizeof *t->preds);
+    t->pred_count--;
+    for (int i = 0; i < t->inst_count; i++) {
+        IRValue *v = &fn->values[t->insts[i]];
+        if (v->op != IR_PHI || v->dead) continue;
+        memmove(v->args + k, v->args + k + 1, (v->argc - k - 1) * sizeof *v->args);
+        v->argc--;
+    }
+}
+
+int ir_remove_unreachable(IRFunction *fn) {
+    if (fn->block_count == 0) return 0;
+    char *seen = xcalloc(fn->block_count, 1);
+    int *stack = xmalloc(fn->block_count * sizeof *stack);
+    int top = 0;
+    stack[top++] = 0;
+    seen[0] = 1;
+    while (top) {
+        const IRBlock *b = &fn->blocks[stack[--top]];
+        for (int s = 0; s < b->succ_count; s++) {
+            if (!seen[b->succs[s]]) {
+                seen[b->succs[s]] = 1;
+                stack[top++] = b->succs[s];
+            }
+        }
+    }
+    int removed = 0;
+    for (int id = 0; id < fn->block_count; id++) {
+        IRBlock *b = &fn->blocks[id];
+        if (seen[id] || b->dead) continue;
+        while (b->succ_count) ir_remove_edge(fn, id, b->succs[0]);
+        for (int i = 0; i < b->inst_count; i++) fn->values[b->insts[i]].dead = 1;
+        b->inst_count = b->pred_count = 0;
+        b->dead = 1;
+        removed++;
+    }
+    free(stack);
+    free(seen);
+    return removed;
+}
+
+static int resolve(int *map, int v) {
+    int r = v;
+    while (map[r] != r) r = map[r];
+    // shorten the chain for later lookups
+    while (map[v] != r) {
+        int next = map[v];
+        map[v] = r;
+        v = next;
+    }
+    return r;
+}
+
+int ir_replace_values(IRFunction *fn, int *map) {
+    int replaced = 0;
+    for (int id = 0; id < fn->value_count; id++) {
+        IRValue *v = &fn->values[id];
+        if (v->dead) continue;
+        if (resolve(map, id) != id) {
+            v->dead = 1;
+            replaced++;
+            continue;
+        }
+        for (int a = 0; a < v->argc; a++) v->args[a] = resolve(map, v->args[a]);
+    }
+    ir_compact(fn);
+    return replaced;
+}
+
+void ir_compact(IRFunction *fn) {
+    int *rest = NULL, cap = 0;
+    for (int id = 0; id < fn->block_count; id++) {
+        IRBlock *b = &fn->blocks[id];
+        if (b->inst_count > cap) {
+            cap  = b->inst_count;
+            rest = xrealloc(rest, cap * sizeof *rest);
+        }
+        // phis keep their order ahead of everything else
+        int phis = 0, others = 0;
+        for (int i = 0; i < b->inst_count; i++) {
+            int v = b->insts[i];
+            if (fn->values[v].dead) continue;
+            if (fn->values[v].op == IR_PHI)
+                b->insts[phis++] = v;
+            else
+                rest[others++] = v;
+        }
+        if (others) memcpy(b->insts + phis, rest, others * sizeof *rest);
+        b->inst_count = phis + others;
+    }
+    free(rest);
+}
+
+// Cooper, Harvey and Kennedy's iterative algorithm over reverse post-order
+static int intersect(const int *idom, const int *number, int a, int b) {
+    while (a != b) {
+        while (number[a] > number[b]) a = idom[a];
+        while (number[b] > number[a]) b = idom[b];
+    }
+    return a;
+}
+
+int ir_dominators(const IRFunction *fn, int *idom, int *rpo) {
+    int n = fn->block_count;
+    int *number = xmalloc((n + 1) * sizeof *number);
+    int *stack  = xmalloc((n + 1) * sizeof *stack);
+    int *next   = xcalloc(n + 1, sizeof *next);
+    char *seen  = xcalloc(n + 1, 1);
+    for (int b = 0; b < n; b++) idom[b] = -1;
+
+    // iterative DFS; a block is numbered once all its successors are done
+    int count = 0, top = 0;
+    stack[top++] = 0;
+    seen[0] = 1;
+    while (top) {
+        int b = stack[top - 1];
+        const IRBlock *blk = &fn->blocks[b];
+        if (next[b] < blk->succ_count) {
+            int s = blk->succs[next[b]++];
+            if (!seen[s]) {
+                seen[s] = 1;
+                stack[top++] = s;
+            }
+            continue;
+        }
+        top--;
+        rpo[count++] = b;
+    }
+    for (int i = 0; i < count / 2; i++) {
+        int t = rpo[i];
+        rpo[i] = rpo[count - 1 - i];
+        rpo[count - 1 - i] = t;
+    }
+    for (int i = 0; i < count; i++) number[rpo[i]] = i;
+
+    idom[0] = 0;
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (int i = 1; i < count; i++) {
+            int b = rpo[i];
+            const IRBlock *blk = &fn->blocks[b];
+            int new_idom = -1;
+            for (int k = 0; k < blk->pred_count; k++) {
+                int p = blk->preds[k];
+                if (idom[p] < 0) continue;
+                new_idom = new_idom < 0 ? p : intersect(idom, number, p, new_idom);
+            }
+            if (new_idom != idom[b]) {
+                idom[b] = new_idom;
+                changed = 1;
+            }
+        }
+    }
+    free(seen);
+    free(next);
+    free(stack);
+    free(number);
+    return count;
+}
+
+// Whether block 'a' dominates block 'b'
+static int dominates(const int *idom, int a, int b) {
+    for (;;) {
+        if (a == b) return 1;
+        if (b == 0) return 0;
+        b = idom[b];
+    }
+}
+
+const char *verify_ir(const IRFunction *fn) {
+    if (fn->block_count == 0) return NULL;
+    const char *error = NULL;
+    int *idom = xmalloc(fn->block_count * sizeof *idom);
+    int *rpo  = xmalloc(fn->block_count * sizeof *rpo);
+    int *position = xmalloc((fn->value_count + 1) * sizeof *position);
+    ir_dominators(fn, idom, rpo);
+    for (int id = 0; id < fn->value_count; id++) position[id] = -1;
+    for (int b = 0; b < fn->block_count; b++) {
+        const IRBlock *blk = &fn->blocks[b];
+        if (blk->dead) continue;
+        if (idom[b] < 0) {
+            error = "a live block is unreachable";
+            goto done;
+        }
+        for (int i = 0; i < blk->inst_count; i++) position[blk->insts[i]] = i;
+    }
+    for (int b = 0; b < fn->block_count && !error; b++) {
+        const IRBlock *blk = &fn->blocks[b];
+        if (blk->dead) continue;
+        if (blk->inst_count == 0 || !IR_IS_TERMINATOR(fn->values[blk->insts[blk->inst_count - 1]].op)) {
+            error = "a block does not end in a terminator";
+            break;
+        }
+        for (int k = 0; k < blk->pred_count; k++) {
+            const IRBlock *p = &fn->blocks[blk->preds[k]];
+            int found = 0;
+            for (int s = 0; s < p->succ_count; s++) found += p->succs[s] == b;
+            for (int j = 0; j < k; j++)
+                if (blk->preds[j] == blk->preds[k]) found = 0;
+            if (found != 1 || p->dead) error = "predecessor and successor lists disagree";
+        }
+        int seen_other = 0;
+        for (int i = 0; i < blk->inst_count && !error; i++) {
+            int id = blk->insts[i];
+            const IRValue *v = &fn->values[id];
+            if (v->dead || v->block != b) {
+                error = "a block lists a value it does not own";
+            } else if (IR_IS_TERMINATOR(v->op) && i != blk->inst_count - 1) {
+                error = "a terminator in the middle of a block";
+            } else if (v->op == IR_PHI && seen_other) {
+                error = "a phi after the start of its block";
+            } else if (v->op == IR_PHI && v->argc != blk->pred_count) {
+                error = "a phi without one operand per predecessor";
+            }
+            seen_other |= v->op != IR_PHI;
+            for (int a = 0; a < v->argc && !error; a++) {
+                int arg = v->args[a];
+                const IRValue *def = &fn->values[arg];
+                if (arg < 0 || arg >= fn->value_count || def->dead || position[arg] < 0) {
+                    error = "an operand is not a live value";
+                } else if (v->op == IR_PHI) {
+                    if (!dominates(idom, def->block, blk->preds[a]))
+                        error = "a phi operand does not dominate its predecessor";
+                } else if (def->block == b ? position[arg] >= i : !dominates(idom, def->block, b)) {
+                    error = "an operand does not dominate its use";
+                }
+            }
+        }
+    }
+done:
+    free(position);
+    free(rpo);
+    free(idom);
+    return error;
+}
+
+static void print_type(FILE *out, const IRProgram *prog, Type t) {
+    switch (t.kind) {
+    case TYPE_INT:     fputs("Int", out); break;
+    case TYPE_BOOLEAN: fputs("Boolean", out); break;
+    case TYPE_VOID:    fputs("Void", out); break;
+    case TYPE_CLASS:   fputs(symbol_name(prog->env->names, t.cls), out); break;
+    default:           fputs("?", out); break;
+    }
+}
+
+void print_ir_function(FILE *out, const IRProgram *prog, const IRFunction *fn) {
+    fprintf(out, "function %s (%d params) -> ", fn->name, fn->param_count);
+    print_type(out, prog, fn->ret);
+    fputc('\n', out);
+    for (int b = 0; b < fn->block_count; b++) {
+        const IRBlock *blk = &fn->blocks[b];
+        if (blk->dead) continue;
+        fprintf(out, "b%d:", b);
+        if (blk->pred_count) {
+            fputs("  ; preds", out);
+            for (int k = 0; k < blk->pred_count; k++) fprintf(out, " b%d", blk->preds[k]);
+        }
+        fputc('\n', out);
+        for (int i = 0; i < blk->inst_count; i++) {
+            int id = blk->insts[i];
+            const IRValue *v = &fn->values[id];
+            fputs("    ", out);
+            if (!IR_IS_TERMINATOR(v->op)) fprintf(out, "v%d = ", id);
+            fputs(ir_op_names[v->op], out);
+            switch (v->op) {
+            case IR_CONST: case IR_PARAM: case IR_NEW: case IR_CALL: case IR_CALLV:
+                fprintf(out, " #%d", v->imm);
+                break;
+            default:
+                break;
+            }
+            for (int a = 0; a < v->argc; a++) {
+                fprintf(out, "%s v%d", a || v->op == IR_CALL || v->op == IR_CALLV ? "," : "", v->args[a]);
+                if (v->op == IR_PHI) fprintf(out, " b%d", blk->preds[a]);
+            }
+            for (int s = 0; s < blk->succ_count && IR_IS_TERMINATOR(v->op); s++)
+                fprintf(out, "%s b%d", v->argc || s ? "," : "", blk->succs[s]);
+            if (!IR_IS_TERMINATOR(v->op)) {
+                fputs(" : ", out);
+                print_type(out, prog, v->type);
+            }
+            fputc('\n', out);
+        }
+    }
+}
+
+void print_ir(FILE *out, const IRProgram *prog) {
+    for (int f = 0; f < prog->function_count; f++) {
+        const IRFunction *fn = &prog->functions[f];
+        if (fn->block_count == 0) continue;
+        print_ir_function(out, prog, fn);
+        fputc('\n', out);
+    }
+}
+
+void free_ir(IRProgram *prog) {
+    if (!prog) return;
+    for (int f = 0; f < prog->function_count; f++) {
+        IRFunction *fn = &prog->functions[f];
+        for (int id = 0; id < fn->value_count; id++) free(fn->values[id].args);
+        for (int b = 0; b < fn->block_count; b++) {
+            free(fn->blocks[b].insts);
+            free(fn->blocks[b].preds);
+        }
+        free(fn->values);
+        free(fn->blocks);
+        free(fn->name);
+    }
+    free(prog->functions);
+    free(prog);
+}
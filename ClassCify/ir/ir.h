@@ -0,0 +1,116 @@
+#ifndef IR_H
+#define IR_H
+
+#include "../typechecker/typeenv.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// SSA intermediate representation. Each method, constructor and the
+// program body becomes an IRFunction: a control-flow graph of basic
+// blocks holding typed SSA values. Block 0 is the entry. A block starts
+// with its phis, whose operands line up with its predecessors, and ends
+// with exactly one terminator; no block lists the same predecessor twice.
+
+#define IR_OPS(X) \
+    X(CONST)    /* imm: an Int, a Boolean 0/1, or the Void value 0 */    \
+    X(NIL)      /* the null object */                                   \
+    X(PARAM)    /* imm: 0 is this, then the parameters */                \
+    X(COPY)     /* args[0] */                                           \
+    X(PHI)      /* args[k] when entered from preds[k] */                \
+    X(ADD)      /* args[0] + args[1], wrapping */                       \
+    X(SUB)                                                              \
+    X(MUL)                                                              \
+    X(DIV)      /* traps on a zero divisor */                           \
+    X(LT)                                                               \
+    X(EQ)                                                               \
+    X(PRINT)    /* println args[0]; the Void value */                   \
+    X(NEW)      /* object of class imm, fields zeroed */                \
+    X(CALL)     /* method entry imm on receiver args[0], args args[1..] */ \
+    X(CALLV)    /* the same through vtable slot imm */                  \
+    X(CHECK)    /* traps if args[0] is null; the Void value */          \
+    X(JUMP)     /* to succs[0] */                                       \
+    X(BRANCH)   /* to succs[0] if args[0], else succs[1] */             \
+    X(RET)      /* args[0], or nothing for Void */                      \
+    X(NORET)    /* fell off the end of a non-Void method */
+
+#define IR_OP_ENUM(name) IR_##name,
+typedef enum { IR_OPS(IR_OP_ENUM) IR_OP_COUNT } IROp;
+#undef IR_OP_ENUM
+
+extern const char *const ir_op_names[IR_OP_COUNT];
+
+#define IR_IS_TERMINATOR(op) ((op) >= IR_JUMP)
+
+typedef struct {
+    uint8_t op;          // IROp
+    uint8_t dead;        // deleted; no live value uses it
+    Type    type;
+    int     block;
+    int32_t imm;
+    int    *args;        // value ids
+    int     argc, argcap;
+} IRValue;
+
+typedef struct {
+    int *insts;          // value ids in execution order
+    int  inst_count, inst_cap;
+    int *preds;
+    int  pred_count, pred_cap;
+    int  succs[2];
+    int  succ_count;
+    int  dead;           // removed from the graph
+} IRBlock;
+
+typedef struct {
+    char    *name;          // "Class.method", "Class.<init>" or "<main>"
+    int      method;        // TypeEnv method entry, -1 for the program body
+    int      param_count;   // 'this' included; 0 for the program body
+    Type     ret;
+    IRValue *values;
+    int      value_count, value_cap;
+    IRBlock *blocks;        // none when the method is never lowered
+    int      block_count, block_cap;
+} IRFunction;
+
+typedef struct {
+    const TypeEnv *env;
+    IRFunction    *functions;   // indexed by method entry; the program body last
+    int            function_count;
+    int            main;
+} IRProgram;
+
+// Lowers a typechecked program. Calls devirtualize bound become CALL,
+// the rest CALLV.
+IRProgram *lower_to_ir(const ASTNode *root, const TypeEnv *env);
+void       free_ir(IRProgram *prog);
+void       print_ir(FILE *out, const IRProgram *prog);
+void       print_ir_function(FILE *out, const IRProgram *prog, const IRFunction *fn);
+// NULL when the SSA invariants hold, else the first one broken
+const char *verify_ir(const IRFunction *fn);
+
+// Reference interpreter; the same contract as run_bytecode
+int run_ir(const IRProgram *prog, FILE *out, const char **error);
+
+// Construction and editing, for the lowering and the passes
+
+int  ir_block(IRFunction *fn);
+// Appends a value to 'block'; phis go after the block's other phis
+int  ir_value(IRFunction *fn, int block, IROp op, Type type, int32_t imm);
+void ir_add_arg(IRFunction *fn, int value, int arg);
+// Turns 'value' into a CONST in place, dropping its operands
+void ir_make_const(IRFunction *fn, int value, int32_t imm);
+void ir_add_edge(IRFunction *fn, int from, int to);
+// Drops the edge and the phi operands that came in along it
+void ir_remove_edge(IRFunction *fn, int from, int to);
+// Deletes blocks the entry cannot reach; returns how many
+int  ir_remove_unreachable(IRFunction *fn);
+// Rewrites every operand through 'map' (value -> replacement, or itself)
+// and deletes the replaced values; returns how many
+int  ir_replace_values(IRFunction *fn, int *map);
+// Drops deleted values from the block lists and moves phis first
+void ir_compact(IRFunction *fn);
+// Immediate dominators of the live blocks (the entry is its own, -1 for
+// dead blocks) and their reverse post-order; returns the order's length
+int  ir_dominators(const IRFunction *fn, int *idom, int *rpo);
+
+#endif // IR_H
@@ -0,0 +1,388 @@
+#include "ir.h"
+#include "../common/xalloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+// SSA construction straight from the AST, after Braun et al., "Simple and
+// Efficient Construction of Static Single Assignment Form": every frame
+// slot is a variable, each block remembers the value it last wrote to
+// each slot, and reads that miss look through the predecessors, placing
+// phis where they meet. A block is sealed once all its predecessors are
+// known; phis asked for before that get their operands at sealing.
+
+typedef struct {
+    int phi, slot;
+} Pending;
+
+typedef struct {
+    int     *defs;      // slot -> value last written here, -1 if none
+    int      sealed;
+    Pending *pending;   // phis placed before sealing
+    int      pending_count, pending_cap;
+} BlockInfo;
+
+typedef struct {
+    const TypeEnv *env;
+    IRFunction    *fn;
+    BlockInfo     *info;         // per block of fn
+    int            info_cap;
+    int            slots;        // frame slots of the body
+    Type          *slot_types;   // declared type of the variable in each slot
+    int            cur;          // block being filled
+    int            in_main;
+    int           *exits;        // exit blocks of the enclosing loops
+    int            exit_count, exit_cap;
+} Lowerer;
+
+static const Type VOID_TYPE = { TYPE_VOID, NO_SYMBOL };
+
+static int new_block(Lowerer *l, int sealed) {
+    int id = ir_block(l->fn);
+    if (id == l->info_cap) {
+        l->info_cap = l->info_cap ? l->info_cap * 2 : 16;
+        l->info     = xrealloc(l->info, l->info_cap * sizeof *l->info);
+    }
+    BlockInfo *bi = &l->info[id];
+    memset(bi, 0, sizeof *bi);
+    bi->defs = xmalloc(l->slots * sizeof *bi->defs);
+    for (int s = 0; s < l->slots; s++) bi->defs[s] = -1;
+    bi->sealed = sealed;
+    return id;
+}
+
+static int emit(Lowerer *l, IROp op, Type type, int32_t imm) {
+    return ir_value(l->fn, l->cur, op, type, imm);
+}
+
+// The value every backend starts a variable of type 't' at
+static int zero(Lowerer *l, int block, Type t) {
+    return ir_value(l->fn, block, t.kind == TYPE_CLASS ? IR_NIL : IR_CONST, t, 0);
+}
+
+static void write_var(Lowerer *l, int slot, int block, int value) {
+    l->info[block].defs[slot] = value;
+}
+
+static int read_var(Lowerer *l, int slot, int block);
+
+// A phi whose operands are all itself or one other value is that value.
+// It becomes a COPY in place, since values may already use it.
+static int remove_trivial_phi(Lowerer *l, int phi) {
+    IRValue *v = &l->fn->values[phi];
+    int same = -1;
+    for (int a = 0; a < v->argc; a++) {
+        int arg = v->args[a];
+        if (arg == same || arg == phi) continue;
+        if (same >= 0) return phi;
+        same = arg;
+    }
+    if (same < 0) {
+        // only reachable through itself
+        ir_make_const(l->fn, phi, 0);
+        return phi;
+    }
+    v->op      = IR_COPY;
+    v->args[0] = same;
+    v->argc    = 1;
+    return same;
+}
+
+static int add_phi_operands(Lowerer *l, int slot, int phi) {
+    int block = l->fn->values[phi].block;
+    for (int k = 0; k < l->fn->blocks[block].pred_count; k++)
+        ir_add_arg(l->fn, phi, read_var(l, slot, l->fn->blocks[block].preds[k]));
+    return remove_trivial_phi(l, phi);
+}
+
+static int read_var(Lowerer *l, int slot, int block) {
+    int value = l->info[block].defs[slot];
+    if (value >= 0) return value;
+    const IRBlock *b = &l->fn->blocks[block];
+    Type t = l->slot_types[slot];
+    if (!l->info[block].sealed) {
+        value = ir_value(l->fn, block, IR_PHI, t, 0);
+        BlockInfo *bi = &l->info[block];
+        if (bi->pending_count == bi->pending_cap) {
+            bi->pending_cap = bi->pending_cap ? bi->pending_cap * 2 : 4;
+            bi->pending     = xrealloc(bi->pending, bi->pending_cap * sizeof *bi->pending);
+        }
+        bi->pending[bi->pending_count++] = (Pending){ value, slot };
+    } else if (b->pred_count == 0) {
+        // only dead code after a Return or Break gets here
+        value = zero(l, block, t);
+    } else if (b->pred_count == 1) {
+        value = read_var(l, slot, b->preds[0]);
+    } else {
+        // written first so that loops through here find the phi
+        value = ir_value(l->fn, block, IR_PHI, t, 0);
+        write_var(l, slot, block, value);
+        value = add_phi_operands(l, slot, value);
+    }
+    write_var(l, slot, block, value);
+    return value;
+}
+
+static void seal(Lowerer *l, int block) {
+    BlockInfo *bi = &l->info[block];
+    for (int i = 0; i < bi->pending_count; i++)
+        add_phi_operands(l, bi->pending[i].slot, bi->pending[i].phi);
+    bi->pending_count = 0;
+    bi->sealed = 1;
+}
+
+static void jump(Lowerer *l, int to) {
+    emit(l, IR_JUMP, VOID_TYPE, 0);
+    ir_add_edge(l->fn, l->cur, to);
+}
+
+// Code after a Return or Break goes to a block nothing reaches
+static void start_dead_block(Lowerer *l) {
+    l->cur = new_block(l, 1);
+}
+
+static int lower_exp(Lowerer *l, const ASTNode *n);
+
+// Emits a call on 'recv' with the arguments n->kids[first..]
+static int lower_call(Lowerer *l, IROp op, Type type, int32_t imm, int recv, const ASTNode *n, int first) {
+    int count = n->kid_count - first;
+    int args[count + 1];
+    for (int i = 0; i < count; i++) args[i] = lower_exp(l, n->kids[first + i]);
+    int call = emit(l, op, type, imm);
+    ir_add_arg(l->fn, call, recv);
+    for (int i = 0; i < count; i++) ir_add_arg(l->fn, call, args[i]);
+    return call;
+}
+
+static int lower_exp(Lowerer *l, const ASTNode *n) {
+    const TypeEnv *env = l->env;
+    switch (n->kind) {
+    case NODE_INT_LIT:
+        return emit(l, IR_CONST, n->type, n->int_value);
+    case NODE_TRUE:
+    case NODE_FALSE:
+        return emit(l, IR_CONST, n->type, n->kind == NODE_TRUE);
+    case NODE_THIS:
+        return read_var(l, 0, l->cur);
+    case NODE_IDENT:
+        return read_var(l, n->slot, l->cur);
+    case NODE_PRINTLN: {
+        int arg = lower_exp(l, n->kids[0]);
+        int v = emit(l, IR_PRINT, VOID_TYPE, 0);
+        ir_add_arg(l->fn, v, arg);
+        return v;
+    }
+    case NODE_CALL: {
+        int recv = lower_exp(l, n->kids[0]);
+        if (n->target >= 0) return lower_call(l, IR_CALL, n->type, n->target, recv, n, 2);
+        int id = lookup_method(env, n->kids[0]->type.cls, n->kids[1]->sym);
+        return lower_call(l, IR_CALLV, n->type, env->methods[id].slot, recv, n, 2);
+    }
+    case NODE_INLINED: {
+        int last = n->kid_count - 1;
+        for (int i = 0; i < last; i++) {
+            const ASTNode *bind = n->kids[i];
+            if (bind->kind != NODE_ASSIGN) continue;
+            int slot = bind->kids[0]->slot;
+            l->slot_types[slot] = bind->kids[0]->type;
+            write_var(l, slot, l->cur, lower_exp(l, bind->kids[1]));
+        }
+        const ASTNode *recv = n->kids[0];
+        if (recv->kind == NODE_ASSIGN) recv = recv->kids[0];
+        if (recv->kind != NODE_THIS)
+            ir_add_arg(l->fn, emit(l, IR_CHECK, VOID_TYPE, 0), lower_exp(l, recv));
+        return lower_exp(l, n->kids[last]);
+    }
+    case NODE_NEW: {
+        Symbol cls = n->kids[0]->sym;
+        int obj = emit(l, IR_NEW, n->type, class_number(env, cls));
+        lower_call(l, IR_CALL, VOID_TYPE, lookup_method(env, cls, SYM_CTOR), obj, n, 1);
+        return obj;
+    }
+    default: {
+        int a = lower_exp(l, n->kids[0]);
+        int b = lower_exp(l, n->kids[1]);
+        IROp op;
+        switch (n->kind) {
+        case NODE_ADD:  op = IR_ADD; break;
+        case NODE_SUB:  op = IR_SUB; break;
+        case NODE_MUL:  op = IR_MUL; break;
+        case NODE_DIV:  op = IR_DIV; break;
+        case NODE_LESS: op = IR_LT;  break;
+        default:        op = IR_EQ;  break;
+        }
+        int v = emit(l, op, n->type, 0);
+        ir_add_arg(l->fn, v, a);
+        ir_add_arg(l->fn, v, b);
+        return v;
+    }
+    }
+}
+
+static void lower_stmt(Lowerer *l, const ASTNode *n) {
+    switch (n->kind) {
+    case NODE_VARDEC: {
+        int slot = n->kids[1]->slot;
+        l->slot_types[slot] = n->kids[0]->type;
+        write_var(l, slot, l->cur, zero(l, l->cur, n->kids[0]->type));
+        return;
+    }
+    case NODE_ASSIGN:
+        write_var(l, n->kids[0]->slot, l->cur, lower_exp(l, n->kids[1]));
+        return;
+    case NODE_IF: {
+        int cond = lower_exp(l, n->kids[0]);
+        ir_add_arg(l->fn, emit(l, IR_BRANCH, VOID_TYPE, 0), cond);
+        int from   = l->cur;
+        int then   = new_block(l, 1);
+        int join   = new_block(l, 0);
+        int other  = n->kid_count == 3 ? new_block(l, 1) : join;
+        ir_add_edge(l->fn, from, then);
+        ir_add_edge(l->fn, from, other);
+        l->cur = then;
+        lower_stmt(l, n->kids[1]);
+        jump(l, join);
+        if (other != join) {
+            l->cur = other;
+            lower_stmt(l, n->kids[2]);
+            jump(l, join);
+        }
+        seal(l, join);
+        l->cur = join;
+        return;
+    }
+    case NODE_WHILE: {
+        // the header waits for the back edge before it is sealed
+        int header = new_block(l, 0);
+        jump(l, header);
+        l->cur = header;
+        int cond = lower_exp(l, n->kids[0]);
+        ir_add_arg(l->fn, emit(l, IR_BRANCH, VOID_TYPE, 0), cond);
+        int body = new_block(l, 1);
+        int exit = new_block(l, 0);
+        ir_add_edge(l->fn, header, body);
+        ir_add_edge(l->fn, header, exit);
+        if (l->exit_count == l->exit_cap) {
+            l->exit_cap = l->exit_cap ? l->exit_cap * 2 : 8;
+            l->exits    = xrealloc(l->exits, l->exit_cap * sizeof *l->exits);
+        }
+        l->exits[l->exit_count++] = exit;
+        l->cur = body;
+        for (int i = 1; i < n->kid_count; i++)
+            lower_stmt(l, n->kids[i]);
+        jump(l, header);
+        l->exit_count--;
+        seal(l, header);
+        seal(l, exit);
+        l->cur = exit;
+        return;
+    }
+    case NODE_BREAK:
+        jump(l, l->exits[l->exit_count - 1]);
+        start_dead_block(l);
+        return;
+    case NODE_RETURN: {
+        int value = n->kid_count == 1 ? lower_exp(l, n->kids[0]) : -1;
+        int ret = emit(l, IR_RET, VOID_TYPE, 0);
+        if (value >= 0 && !l->in_main && l->fn->ret.kind != TYPE_VOID)
+            ir_add_arg(l->fn, ret, value);
+        start_dead_block(l);
+        return;
+    }
+    case NODE_STMTLIST:
+        for (int i = 0; i < n->kid_count; i++)
+            lower_stmt(l, n->kids[i]);
+        return;
+    default:
+        // Call or Println for its effect
+        lower_exp(l, n);
+        return;
+    }
+}
+
+// Lowers the statements body->kids[first..] into 'fn', which is set up
+// with its name, return type and parameter count
+static void lower_body(Lowerer *l, IRFunction *fn, const MethodEntry *m, const ASTNode *body,
+                       int first, int frame_size) {
+    l->fn         = fn;
+    l->slots      = frame_size + 1;
+    l->slot_types = xmalloc(l->slots * sizeof *l->slot_types);
+    for (int s = 0; s < l->slots; s++) l->slot_types[s] = VOID_TYPE;
+    l->cur = new_block(l, 1);
+
+    if (m) {
+        const ASTNode *def = m->def;
+        l->slot_types[0] = (Type){ TYPE_CLASS, m->class_name };
+        write_var(l, 0, l->cur, emit(l, IR_PARAM, l->slot_types[0], 0));
+        for (int i = 0; i < def->param_count; i++) {
+            const ASTNode *param = def->kids[i];
+            int slot = param->kids[1]->slot;
+            l->slot_types[slot] = param->kids[0]->type;
+            write_var(l, slot, l->cur, emit(l, IR_PARAM, param->kids[0]->type, i + 1));
+        }
+        if (m->method_name == SYM_CTOR && first < def->kid_count && def->kids[first]->kind == NODE_SUPERCALL) {
+            const ASTNode *sup = def->kids[first++];
+            const ClassEntry *cls = &l->env->classes[class_number(l->env, m->class_name)];
+            lower_call(l, IR_CALL, VOID_TYPE, lookup_method(l->env, cls->superclass, SYM_CTOR),
+                       read_var(l, 0, l->cur), sup, 0);
+        }
+    }
+    for (int i = first; i < body->kid_count; i++)
+        lower_stmt(l, body->kids[i]);
+    emit(l, fn->ret.kind == TYPE_VOID ? IR_RET : IR_NORET, VOID_TYPE, 0);
+
+    for (int b = 0; b < fn->block_count; b++) {
+        free(l->info[b].defs);
+        free(l->info[b].pending);
+    }
+    free(l->slot_types);
+    ir_remove_unreachable(fn);
+    ir_compact(fn);
+}
+
+IRProgram *lower_to_ir(const ASTNode *root, const TypeEnv *env) {
+    IRProgram *prog = xcalloc(1, sizeof *prog);
+    prog->env            = env;
+    prog->function_count = env->method_count + 1;
+    prog->main           = env->method_count;
+    prog->functions      = xcalloc(prog->function_count, sizeof *prog->functions);
+
+    Lowerer l;
+    memset(&l, 0, sizeof l);
+    l.env = env;
+
+    // the methods reachable through a vtable or a new, as in the VM
+    for (int k = 0; k < env->class_preorder_len; k++) {
+        const ClassEntry *cls = &env->classes[env->class_preorder[k]];
+        int ctor = lookup_method(env, cls->name, SYM_CTOR);
+        for (int s = -1; s < cls->vtable_len; s++) {
+            int id = s < 0 ? ctor : cls->vtable[s];
+            if (id < 0 || prog->functions[id].name) continue;
+            const MethodEntry *m = &env->methods[id];
+            IRFunction *fn = &prog->functions[id];
+            int is_ctor = m->method_name == SYM_CTOR;
+            fn->name        = xformat("%s.%s", symbol_name(env->names, m->class_name),
+                                     is_ctor ? "<init>" : symbol_name(env->names, m->method_name));
+            fn->method      = id;
+            fn->param_count = m->def->param_count + 1;
+            fn->ret         = is_ctor ? VOID_TYPE : m->sig.return_type;
+            l.in_main = 0;
+            lower_body(&l, fn, m, m->def, m->def->param_count + !is_ctor, m->def->frame_size);
+        }
+    }
+
+    // the statements after the classes are the entry point
+    IRFunction *main_fn = &prog->functions[prog->main];
+    main_fn->name   = xformat("<main>");
+    main_fn->method = -1;
+    main_fn->ret    = VOID_TYPE;
+    l.in_main = 1;
+    const ASTNode *stmts = NULL;
+    for (int i = 0; i < root->kid_count && !stmts; i++)
+        if (root->kids[i]->kind == NODE_STMTLIST) stmts = root->kids[i];
+    static const ASTNode empty = { .kind = NODE_STMTLIST };
+    lower_body(&l, main_fn, NULL, stmts ? stmts : &empty, 0, root->frame_size);
+
+    free(l.info);
+    free(l.exits);
+    return prog;
+}
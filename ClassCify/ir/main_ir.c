@@ -0,0 +1,90 @@
+#include "ir.h"
+#include "pass.h"
+#include "../compiler/compiler.h"
+#include "../tokenizer/source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Typechecks a program, lowers it to SSA, optimizes the IR and runs it
+// on the IR interpreter.
+//
+//   ./main_ir [-O0] [-p passes] [-d] [-t] [-V] [source]
+//
+// -O0 skips the AST passes and the IR pipeline, -p replaces the default
+// pipeline (DEFAULT_IR_PIPELINE) with comma-separated pass names, -d
+// prints the IR after the passes instead of running it, -t prints how
+// long each pass took and what it changed, -V checks the SSA invariants
+// after every pass.
+int main(int argc, char **argv) {
+    int optimize = 1, dump = 0, timing = 0, verify = 0;
+    const char *pipeline = DEFAULT_IR_PIPELINE;
+    const char *path = "../typechecker/sample_typecheck_input.txt";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-O0") == 0)
+            optimize = 0;
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            pipeline = argv[++i];
+        else if (strcmp(argv[i], "-d") == 0)
+            dump = 1;
+        else if (strcmp(argv[i], "-t") == 0)
+            timing = 1;
+        else if (strcmp(argv[i], "-V") == 0)
+            verify = 1;
+        else
+            path = argv[i];
+    }
+
+    PassManager pm;
+    init_pass_manager(&pm, verify);
+    if (optimize && add_passes(&pm, pipeline) != 0) {
+        fprintf(stderr, "%s\n", pm.error);
+        for (int i = 0; i < ir_pass_count; i++)
+            fprintf(stderr, "  %-10s %s\n", ir_passes[i].name, ir_passes[i].description);
+        return EXIT_FAILURE;
+    }
+
+    SourceFile src;
+    if (load_source(path, &src) != 0) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    CompilerContext *ctx = compiler_create(NULL);
+    int status = EXIT_SUCCESS;
+    if (compile_source(ctx, src.data) != 0) {
+        print_diagnostic(stderr, &ctx->diag);
+        status = EXIT_FAILURE;
+    } else {
+        OptReport report;
+        if (optimize) compiler_optimize(ctx, &report);
+        IRProgram *prog = lower_to_ir(ctx->ast, ctx->types);
+        for (int f = 0; f < prog->function_count && verify; f++) {
+            const char *broken = verify_ir(&prog->functions[f]);
+            if (broken) {
+                fprintf(stderr, "after lowering in %s: %s\n", prog->functions[f].name, broken);
+                status = EXIT_FAILURE;
+            }
+        }
+        if (status == EXIT_SUCCESS && run_passes(&pm, prog) != 0) {
+            fprintf(stderr, "%s\n", pm.error);
+            status = EXIT_FAILURE;
+        }
+        if (timing) print_pass_report(stderr, &pm);
+        if (status == EXIT_SUCCESS && dump) {
+            print_ir(stdout, prog);
+        } else if (status == EXIT_SUCCESS) {
+            const char *error = NULL;
+            if (run_ir(prog, stdout, &error) != 0) {
+                fprintf(stderr, "Runtime error: %s\n", error);
+                status = EXIT_FAILURE;
+            }
+        }
+        free_ir(prog);
+    }
+
+    // Cleanup
+    compiler_destroy(ctx);
+    release_source(&src);
+    return status;
+}
@@ -0,0 +1,53 @@
+#ifndef PASS_H
+#define PASS_H
+
+#include "ir.h"
+
+// A pass rewrites one function in place and returns how many changes it
+// made. Passes leave the SSA invariants verify_ir checks intact.
+typedef int (*IRPassFn)(IRFunction *fn, const IRProgram *prog);
+
+typedef struct {
+    const char *name;
+    const char *description;
+    IRPassFn    run;
+} IRPass;
+
+// Replaces copies and phis of a single value with that value
+int copy_propagation(IRFunction *fn, const IRProgram *prog);
+// Merges values that compute the same thing from the same operands
+int global_value_numbering(IRFunction *fn, const IRProgram *prog);
+// Constants through phis over the edges that can run (Wegman and Zadeck)
+int sparse_conditional_constants(IRFunction *fn, const IRProgram *prog);
+// Deletes values nothing observable uses
+int dead_code_elimination(IRFunction *fn, const IRProgram *prog);
+
+extern const IRPass ir_passes[];
+extern const int    ir_pass_count;
+
+// NULL for an unknown name
+const IRPass *find_ir_pass(const char *name);
+
+#define DEFAULT_IR_PIPELINE "sccp,copyprop,gvn,copyprop,dce"
+#define MAX_IR_PASSES       32
+
+// An ordered pipeline of passes with the time and changes of each
+typedef struct {
+    const IRPass *passes[MAX_IR_PASSES];
+    double        seconds[MAX_IR_PASSES];
+    long          changes[MAX_IR_PASSES];
+    int           count;
+    int           verify;        // run verify_ir after every pass
+    char          error[256];    // set when a step fails
+} PassManager;
+
+void init_pass_manager(PassManager *pm, int verify);
+// Appends the comma-separated pass names in 'list'; -1 and pm->error
+// on an unknown name or too many passes
+int  add_passes(PassManager *pm, const char *list);
+// Runs each pass over every function in turn; -1 and pm->error when
+// verification fails
+int  run_passes(PassManager *pm, IRProgram *prog);
+void print_pass_report(FILE *out, const PassManager *pm);
+
+#endif // PASS_H
@@ -0,0 +1,83 @@
+#include "pass.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+const IRPass ir_passes[] = {
+    { "copyprop", "copy propagation", copy_propagation },
+    { "gvn",      "global value numbering", global_value_numbering },
+    { "sccp",     "sparse conditional constant propagation", sparse_conditional_constants },
+    { "dce",      "dead code elimination", dead_code_elimination },
+};
+const int ir_pass_count = (int)(sizeof ir_passes / sizeof *ir_passes);
+
+const IRPass *find_ir_pass(const char *name) {
+    for (int i = 0; i < ir_pass_count; i++)
+        if (strcmp(ir_passes[i].name, name) == 0) return &ir_passes[i];
+    return NULL;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void init_pass_manager(PassManager *pm, int verify) {
+    memset(pm, 0, sizeof *pm);
+    pm->verify = verify;
+}
+
+int add_passes(PassManager *pm, const char *list) {
+    const char *p = list;
+    while (*p) {
+        size_t length = strcspn(p, ",");
+        char name[64];
+        if (length >= sizeof name) length = sizeof name - 1;
+        memcpy(name, p, length);
+        name[length] = '\0';
+        p += length + (p[length] == ',');
+        if (length == 0) continue;
+        const IRPass *pass = find_ir_pass(name);
+        if (!pass) {
+            snprintf(pm->error, sizeof pm->error, "unknown pass '%s'", name);
+            return -1;
+        }
+        if (pm->count == MAX_IR_PASSES) {
+            snprintf(pm->error, sizeof pm->error, "more than %d passes", MAX_IR_PASSES);
+            return -1;
+        }
+        pm->passes[pm->count++] = pass;
+    }
+    return 0;
+}
+
+int run_passes(PassManager *pm, IRProgram *prog) {
+    for (int p = 0; p < pm->count; p++) {
+        const IRPass *pass = pm->passes[p];
+        for (int f = 0; f < prog->function_count; f++) {
+            IRFunction *fn = &prog->functions[f];
+            if (fn->block_count == 0) continue;
+            // verification is not part of a pass's time
+            double start = now();
+            pm->changes[p] += pass->run(fn, prog);
+            pm->seconds[p] += now() - start;
+            const char *broken = pm->verify ? verify_ir(fn) : NULL;
+            if (broken) {
+                snprintf(pm->error, sizeof pm->error, "after %s in %s: %s", pass->name, fn->name, broken);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+void print_pass_report(FILE *out, const PassManager *pm) {
+    double total = 0;
+    for (int p = 0; p < pm->count; p++) {
+        fprintf(out, "%-10s %8ld changes %10.3f ms  %s\n", pm->passes[p]->name, pm->changes[p],
+                pm->seconds[p] * 1e3, pm->passes[p]->description);
+        total += pm->seconds[p];
+    }
+    fprintf(out, "%-10s %16s %10.3f ms\n", "total", "", total * 1e3);
+}
@@ -0,0 +1,225 @@
+#include "pass.h"
+#include "../common/xalloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Sparse conditional constant propagation (Wegman and Zadeck). Values
+// start unknown and only move down the lattice; a phi meets just the
+// operands of the edges found to run, and a branch on a constant makes
+// only one of its edges run. Constants replace the values afterwards,
+// constant branches become jumps and the blocks nothing runs go away.
+
+enum { UNKNOWN, CONSTANT, VARYING };
+
+typedef struct {
+    uint8_t state;
+    int32_t value;
+} Cell;
+
+typedef struct {
+    IRFunction *fn;
+    Cell       *cells;      // per value
+    char       *visited;    // per block: its instructions ran once
+    char       *edge_runs;  // per block predecessor, from edge_base
+    int        *edge_base;
+    int        *use_base;   // users of value v: users[use_base[v]..use_base[v + 1]]
+    int        *users;
+    int        *flow;       // edges to mark, as (from, to) pairs
+    int         flow_count, flow_cap;
+    int        *ssa;        // values whose operands moved
+    int         ssa_count, ssa_cap;
+    char       *queued;     // per value, on the ssa list
+} Propagator;
+
+static void push_edge(Propagator *p, int from, int to) {
+    if (p->flow_count + 2 > p->flow_cap) {
+        p->flow_cap = p->flow_cap ? p->flow_cap * 2 : 32;
+        p->flow     = xrealloc(p->flow, p->flow_cap * sizeof *p->flow);
+    }
+    p->flow[p->flow_count++] = from;
+    p->flow[p->flow_count++] = to;
+}
+
+static void lower_to(Propagator *p, int id, Cell cell) {
+    Cell *old = &p->cells[id];
+    if (old->state == cell.state && (cell.state != CONSTANT || old->value == cell.value)) return;
+    *old = cell;
+    for (int u = p->use_base[id]; u < p->use_base[id + 1]; u++) {
+        int user = p->users[u];
+        if (p->queued[user]) continue;
+        if (p->ssa_count == p->ssa_cap) {
+            p->ssa_cap = p->ssa_cap ? p->ssa_cap * 2 : 32;
+            p->ssa     = xrealloc(p->ssa, p->ssa_cap * sizeof *p->ssa);
+        }
+        p->queued[user] = 1;
+        p->ssa[p->ssa_count++] = user;
+    }
+}
+
+static Cell meet(Cell a, Cell b) {
+    if (a.state == UNKNOWN) return b;
+    if (b.state == UNKNOWN) return a;
+    if (a.state == CONSTANT && b.state == CONSTANT && a.value == b.value) return a;
+    return (Cell){ VARYING, 0 };
+}
+
+static Cell evaluate(const IRValue *v, const Cell *cells) {
+    Cell varying = { VARYING, 0 };
+    switch (v->op) {
+    case IR_CONST:
+        return (Cell){ CONSTANT, v->imm };
+    case IR_COPY:
+        return cells[v->args[0]];
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_LT: case IR_EQ: {
+        Cell x = cells[v->args[0]], y = cells[v->args[1]];
+        if (x.state == VARYING || y.state == VARYING) return varying;
+        if (x.state == UNKNOWN || y.state == UNKNOWN) return (Cell){ UNKNOWN, 0 };
+        int32_t a = x.value, b = y.value;
+        // the same wrapping arithmetic as the backends
+        switch (v->op) {
+        case IR_ADD: return (Cell){ CONSTANT, (int32_t)((uint32_t)a + (uint32_t)b) };
+        case IR_SUB: return (Cell){ CONSTANT, (int32_t)((uint32_t)a - (uint32_t)b) };
+        case IR_MUL: return (Cell){ CONSTANT, (int32_t)((uint32_t)a * (uint32_t)b) };
+        case IR_DIV:
+            if (b == 0) return varying;   // still traps at run time
+            return (Cell){ CONSTANT, a == INT32_MIN && b == -1 ? a : a / b };
+        case IR_LT:  return (Cell){ CONSTANT, a < b };
+        default:     return (Cell){ CONSTANT, a == b };
+        }
+    }
+    default:
+        return varying;
+    }
+}
+
+static void visit(Propagator *p, int id) {
+    const IRFunction *fn = p->fn;
+    const IRValue *v = &fn->values[id];
+    const IRBlock *b = &fn->blocks[v->block];
+    switch (v->op) {
+    case IR_PHI: {
+        Cell cell = { UNKNOWN, 0 };
+        const char *runs = p->edge_runs + p->edge_base[v->block];
+        for (int k = 0; k < v->argc; k++)
+            if (runs[k]) cell = meet(cell, p->cells[v->args[k]]);
+        lower_to(p, id, cell);
+        return;
+    }
+    case IR_JUMP:
+        push_edge(p, v->block, b->succs[0]);
+        return;
+    case IR_BRANCH: {
+        Cell cond = p->cells[v->args[0]];
+        if (cond.state == CONSTANT) {
+            push_edge(p, v->block, b->succs[cond.value ? 0 : 1]);
+        } else if (cond.state == VARYING) {
+            push_edge(p, v->block, b->succs[0]);
+            push_edge(p, v->block, b->succs[1]);
+        }
+        return;
+    }
+    default:
+        lower_to(p, id, evaluate(v, p->cells));
+        return;
+    }
+}
+
+static void mark_edge(Propagator *p, int from, int to) {
+    const IRBlock *b = &p->fn->blocks[to];
+    char *runs = p->edge_runs + p->edge_base[to];
+    int k = 0;
+    while (b->preds[k] != from) k++;
+    if (runs[k]) return;
+    runs[k] = 1;
+    // a block's phis see each new edge; the rest runs once
+    for (int i = 0; i < b->inst_count; i++) {
+        int id = b->insts[i];
+        if (p->visited[to] && p->fn->values[id].op != IR_PHI) break;
+        visit(p, id);
+    }
+    p->visited[to] = 1;
+}
+
+// Users of each value, in compressed rows
+static void collect_users(Propagator *p) {
+    const IRFunction *fn = p->fn;
+    int n = fn->value_count;
+    p->use_base = xcalloc(n + 2, sizeof *p->use_base);
+    for (int id = 0; id < n; id++) {
+        const IRValue *v = &fn->values[id];
+        if (v->dead) continue;
+        for (int a = 0; a < v->argc; a++) p->use_base[v->args[a] + 2]++;
+    }
+    for (int id = 0; id < n; id++) p->use_base[id + 2] += p->use_base[id + 1];
+    p->users = xmalloc((p->use_base[n + 1] + 1) * sizeof *p->users);
+    for (int id = 0; id < n; id++) {
+        const IRValue *v = &fn->values[id];
+        if (v->dead) continue;
+        for (int a = 0; a < v->argc; a++) p->users[p->use_base[v->args[a] + 1]++] = id;
+    }
+}
+
+int sparse_conditional_constants(IRFunction *fn, const IRProgram *prog) {
+    (void)prog;
+    Propagator p;
+    memset(&p, 0, sizeof p);
+    p.fn        = fn;
+    p.cells     = xcalloc(fn->value_count + 1, sizeof *p.cells);
+    p.queued    = xcalloc(fn->value_count + 1, 1);
+    p.visited   = xcalloc(fn->block_count, 1);
+    p.edge_base = xmalloc((fn->block_count + 1) * sizeof *p.edge_base);
+    int edges = 0;
+    for (int b = 0; b < fn->block_count; b++) {
+        p.edge_base[b] = edges;
+        edges += fn->blocks[b].pred_count;
+    }
+    p.edge_runs = xcalloc(edges + 1, 1);
+    collect_users(&p);
+
+    // the entry runs without an edge into it
+    p.visited[0] = 1;
+    for (int i = 0; i < fn->blocks[0].inst_count; i++) visit(&p, fn->blocks[0].insts[i]);
+    while (p.flow_count || p.ssa_count) {
+        if (p.flow_count) {
+            p.flow_count -= 2;
+            mark_edge(&p, p.flow[p.flow_count], p.flow[p.flow_count + 1]);
+            continue;
+        }
+        int id = p.ssa[--p.ssa_count];
+        p.queued[id] = 0;
+        if (p.visited[fn->values[id].block]) visit(&p, id);
+    }
+
+    int changes = 0;
+    for (int b = 0; b < fn->block_count; b++) {
+        IRBlock *blk = &fn->blocks[b];
+        if (!p.visited[b] || blk->dead) continue;
+        for (int i = 0; i < blk->inst_count; i++) {
+            int id = blk->insts[i];
+            IRValue *v = &fn->values[id];
+            const Cell *cell = &p.cells[id];
+            if (v->op == IR_BRANCH && p.cells[v->args[0]].state == CONSTANT) {
+                ir_remove_edge(fn, b, blk->succs[p.cells[v->args[0]].value ? 1 : 0]);
+                v->op   = IR_JUMP;
+                v->argc = 0;
+                changes++;
+            } else if (cell->state == CONSTANT && v->op != IR_CONST && !IR_IS_TERMINATOR(v->op)) {
+                ir_make_const(fn, id, cell->value);
+                changes++;
+            }
+        }
+    }
+    changes += ir_remove_unreachable(fn);
+    ir_compact(fn);
+
+    free(p.users);
+    free(p.use_base);
+    free(p.edge_runs);
+    free(p.edge_base);
+    free(p.visited);
+    free(p.queued);
+    free(p.cells);
+    free(p.flow);
+    free(p.ssa);
+    return changes;
+}
@@ -0,0 +1,60 @@
+#include "opt.h"
+#include "../common/xalloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const TypeEnv *env;
+    char         **uniform;   // [class][slot]: the same entry throughout the subtree
+    DevirtStats   *stats;
+} Devirt;
+
+// Children come after their parent in pre-order, so walking it backwards
+// finishes every subtree before the class at its top
+static void find_uniform_slots(Devirt *d) {
+    const TypeEnv *env = d->env;
+    d->uniform = xcalloc(env->class_count + 1, sizeof *d->uniform);
+    for (int k = 0; k < env->class_preorder_len; k++) {
+        int c = env->class_preorder[k];
+        d->uniform[c] = xmalloc(env->classes[c].vtable_len + 1);
+        memset(d->uniform[c], 1, env->classes[c].vtable_len);
+    }
+    for (int k = env->class_preorder_len - 1; k >= 0; k--) {
+        const ClassEntry *c = &env->classes[env->class_preorder[k]];
+        if (c->super_index < 0) continue;
+        const ClassEntry *s = &env->classes[c->super_index];
+        char *up = d->uniform[c->super_index];
+        const char *mine = d->uniform[env->class_preorder[k]];
+        for (int slot = 0; slot < s->vtable_len; slot++) {
+            if (!mine[slot] || c->vtable[slot] != s->vtable[slot])
+                up[slot] = 0;
+        }
+    }
+}
+
+static void bind_calls(Devirt *d, ASTNode *n) {
+    for (int i = 0; i < n->kid_count; i++)
+        bind_calls(d, n->kids[i]);
+    if (n->kind != NODE_CALL) return;
+    const TypeEnv *env = d->env;
+    int c  = class_number(env, n->kids[0]->type.cls);
+    int id = lookup_method(env, n->kids[0]->type.cls, n->kids[1]->sym);
+    d->stats->call_sites++;
+    n->target = -1;
+    if (c >= 0 && id >= 0 && d->uniform[c][env->methods[id].slot]) {
+        n->target = id;
+        d->stats->devirtualized++;
+    }
+}
+
+void devirtualize(ASTNode *root, const TypeEnv *env, DevirtStats *stats) {
+    Devirt d;
+    d.env   = env;
+    d.stats = stats;
+    memset(stats, 0, sizeof *stats);
+    find_uniform_slots(&d);
+    bind_calls(&d, root);
+    for (int c = 0; c < env->class_count; c++)
+        free(d.uniform[c]);
+    free(d.uniform);
+}
@@ -0,0 +1,192 @@
+#include "opt.h"
+#include "../common/xalloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Objects can only be kept by frames: there are no fields to read or
+// write and no globals. So the one way an object outlives the frame
+// that made it is by being returned, directly or through a call whose
+// callee returns an argument. Each method gets a summary of which of
+// its parameters (0 is 'this') it may return, iterated to a fixed point
+// over the whole program; a New is then placed in its frame unless it
+// reaches its method's return value.
+//
+// Analysis is flow-insensitive over frame slots, so a slot that two
+// sibling scopes share counts as one variable; that only makes it
+// conservative.
+
+#define MARKED (-2)   // NODE_NEW reached a return during the analysis
+
+typedef struct {
+    const TypeEnv *env;
+    char         **returns;    // [method entry][param]: may be returned
+    char          *escaping;   // [slot] of the body being scanned
+    int            grew;       // 'escaping' gained a slot this scan
+} Escape;
+
+static void mark(Escape *e, ASTNode *n);
+
+// The arguments of call 'n' that method 'id' may return
+static void mark_call(Escape *e, ASTNode *n, int id) {
+    const char *returns = e->returns[id];
+    for (int p = 0; p <= e->env->methods[id].sig.param_count; p++)
+        if (returns[p]) mark(e, n->kids[p == 0 ? 0 : p + 1]);
+}
+
+// 'n' is an expression whose value may leave the frame
+static void mark(Escape *e, ASTNode *n) {
+    if (n->type.kind != TYPE_CLASS) return;
+    switch (n->kind) {
+    case NODE_THIS:
+    case NODE_IDENT:
+        if (n->slot >= 0 && !e->escaping[n->slot]) {
+            e->escaping[n->slot] = 1;
+            e->grew = 1;
+        }
+        return;
+    case NODE_NEW:
+        n->alloc = MARKED;
+        return;
+    case NODE_INLINED:
+        // its bindings are Assigns that scan sees
+        mark(e, n->kids[n->kid_count - 1]);
+        return;
+    case NODE_CALL: {
+        // its bound target, or the method in its slot in every class
+        // under the receiver's static class
+        const TypeEnv *env = e->env;
+        if (n->target >= 0) {
+            mark_call(e, n, n->target);
+            return;
+        }
+        int c  = class_number(env, n->kids[0]->type.cls);
+        int id = lookup_method(env, n->kids[0]->type.cls, n->kids[1]->sym);
+        if (c < 0 || id < 0) return;
+        int slot = env->methods[id].slot;
+        const ClassEntry *top = &env->classes[c];
+        for (int k = 0; k < env->class_preorder_len; k++) {
+            const ClassEntry *sub = &env->classes[env->class_preorder[k]];
+            if (sub->pre >= top->pre && sub->post <= top->post)
+                mark_call(e, n, sub->vtable[slot]);
+        }
+        return;
+    }
+    default:
+        return;
+    }
+}
+
+static void scan(Escape *e, ASTNode *n, int in_main) {
+    switch (n->kind) {
+    case NODE_RETURN:
+        // the program body's frame lasts as long as the program
+        if (n->kid_count == 1 && !in_main) mark(e, n->kids[0]);
+        break;
+    case NODE_ASSIGN:
+        if (e->escaping[n->kids[0]->slot]) mark(e, n->kids[1]);
+        break;
+    default:
+        break;
+    }
+    for (int i = 0; i < n->kid_count; i++)
+        scan(e, n->kids[i], in_main);
+}
+
+// Marks what reaches a return of 'body', until no more slots join
+static void scan_body(Escape *e, ASTNode *body, int frame_size, int in_main) {
+    memset(e->escaping, 0, frame_size + 1);
+    do {
+        e->grew = 0;
+        scan(e, body, in_main);
+    } while (e->grew);
+}
+
+// Numbers the News left unmarked in 'n' as objects of its frame
+static void place(ASTNode *n, int *objects, EscapeStats *stats) {
+    for (int i = 0; i < n->kid_count; i++)
+        place(n->kids[i], objects, stats);
+    if (n->kind != NODE_NEW) return;
+    stats->sites++;
+    if (n->alloc == MARKED) {
+        n->alloc = ALLOC_HEAP;
+    } else {
+        n->alloc = (*objects)++;
+        stats->in_frame++;
+    }
+}
+
+static void reset(ASTNode *n) {
+    if (n->kind == NODE_NEW) n->alloc = 0;
+    for (int i = 0; i < n->kid_count; i++)
+        reset(n->kids[i]);
+}
+
+void analyze_escapes(ASTNode *root, const TypeEnv *env, EscapeStats *stats) {
+    Escape e;
+    e.env = env;
+    memset(stats, 0, sizeof *stats);
+    reset(root);
+
+    int largest = root->frame_size;
+    e.returns = xmalloc((env->method_count + 1) * sizeof *e.returns);
+    for (int id = 0; id < env->method_count; id++) {
+        const MethodEntry *m = &env->methods[id];
+        e.returns[id] = xcalloc(m->sig.param_count + 1, 1);
+        if (m->def->frame_size > largest) largest = m->def->frame_size;
+    }
+    e.escaping = xmalloc(largest + 1);
+
+    // summaries only grow, so this ends
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (int id = 0; id < env->method_count; id++) {
+            ASTNode *def = env->methods[id].def;
+            scan_body(&e, def, def->frame_size, 0);
+            char *returns = e.returns[id];
+            if (e.escaping[0] && !returns[0]) returns[0] = changed = 1;
+            for (int p = 0; p < def->param_count; p++) {
+                if (e.escaping[def->kids[p]->kids[1]->slot] && !returns[p + 1])
+                    returns[p + 1] = changed = 1;
+            }
+        }
+    }
+
+    for (int id = 0; id < env->method_count; id++) {
+        int objects = 0;
+        place(env->methods[id].def, &objects, stats);
+    }
+    for (int i = 0; i < root->kid_count; i++) {
+        if (root->kids[i]->kind != NODE_STMTLIST) continue;
+        scan_body(&e, root->kids[i], root->frame_size, 1);
+        int objects = 0;
+        place(root->kids[i], &objects, stats);
+    }
+
+    for (int id = 0; id < env->method_count; id++)
+        free(e.returns[id]);
+    free(e.returns);
+    free(e.escaping);
+}
+
+static void print_sites(FILE *out, const ASTNode *n, const char *cls, const char *method, const TypeEnv *env) {
+    if (n->kind == NODE_NEW) {
+        fprintf(out, "%s%s%s: new %s -> ", cls, *cls ? "." : "", method,
+                symbol_name(env->names, n->kids[0]->sym));
+        if (n->alloc == ALLOC_HEAP)
+            fputs("heap\n", out);
+        else
+            fprintf(out, "frame object %d\n", n->alloc);
+    }
+    for (int i = 0; i < n->kid_count; i++)
+        print_sites(out, n->kids[i], cls, method, env);
+}
+
+void print_escape_sites(FILE *out, const ASTNode *root, const TypeEnv *env) {
+    for (int id = 0; id < env->method_count; id++) {
+        const MethodEntry *m = &env->methods[id];
+        print_sites(out, m->def, symbol_name(env->names, m->class_name),
+                    m->method_name == SYM_CTOR ? "<init>" : symbol_name(env->names, m->method_name), env);
+    }
+    for (int i = 0; i < root->kid_count; i++)
+        if (root->kids[i]->kind == NODE_STMTLIST) print_sites(out, root->kids[i], "", "<main>", env);
+}
@@ -0,0 +1,273 @@
+#include "opt.h"
+#include "../common/xalloc.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What is known about a frame slot at one point of a body
+typedef struct {
+    char known;
+    int  value;     // Int, or 0/1 for a Boolean
+} Known;
+
+typedef struct {
+    Arena     *arena;   // labels of folded literals
+    int        slots;   // Known entries per body
+    FoldStats *stats;
+} Folder;
+
+static int count_nodes(const ASTNode *n) {
+    int count = 1;
+    for (int i = 0; i < n->kid_count; i++)
+        count += count_nodes(n->kids[i]);
+    return count;
+}
+
+static int is_constant(const ASTNode *n) {
+    return n->kind == NODE_INT_LIT || n->kind == NODE_TRUE || n->kind == NODE_FALSE;
+}
+
+static int constant_value(const ASTNode *n) {
+    return n->kind == NODE_INT_LIT ? n->int_value : n->kind == NODE_TRUE;
+}
+
+// Turns 'n' into a literal of its own type; its kids drop out of the tree
+static void make_constant(Folder *f, ASTNode *n, int value) {
+    n->kids      = NULL;
+    n->kid_count = 0;
+    n->sym       = NO_SYMBOL;
+    n->depth     = n->slot = -1;
+    n->target    = -1;
+    if (n->type.kind == TYPE_BOOLEAN) {
+        n->kind  = value ? NODE_TRUE : NODE_FALSE;
+        n->label = value ? "true" : "false";
+    } else {
+        char digits[16];
+        int length = snprintf(digits, sizeof digits, "%d", value);
+        char *label = arena_alloc(f->arena, length + 1);
+        memcpy(label, digits, length + 1);
+        n->kind      = NODE_INT_LIT;
+        n->int_value = value;
+        n->label     = label;
+    }
+}
+
+static void fold_exp(Folder *f, ASTNode *n, const Known *env) {
+    switch (n->kind) {
+    case NODE_IDENT:
+        if (n->slot >= 0 && env[n->slot].known) {
+            make_constant(f, n, env[n->slot].value);
+            f->stats->propagated++;
+        }
+        return;
+    case NODE_CALL:
+        // kids[1] is the method name
+        fold_exp(f, n->kids[0], env);
+        for (int i = 2; i < n->kid_count; i++)
+            fold_exp(f, n->kids[i], env);
+        return;
+    case NODE_NEW:
+        for (int i = 1; i < n->kid_count; i++)
+            fold_exp(f, n->kids[i], env);
+        return;
+    case NODE_PRINTLN:
+    case NODE_SUPERCALL:
+        for (int i = 0; i < n->kid_count; i++)
+            fold_exp(f, n->kids[i], env);
+        return;
+    case NODE_ADD:
+    case NODE_SUB:
+    case NODE_MUL:
+    case NODE_DIV:
+    case NODE_LESS:
+    case NODE_EQUAL: {
+        fold_exp(f, n->kids[0], env);
+        fold_exp(f, n->kids[1], env);
+        if (!is_constant(n->kids[0]) || !is_constant(n->kids[1])) return;
+        int32_t a = n->kids[0]->int_value, b = n->kids[1]->int_value;
+        int value;
+        // the same wrapping arithmetic as the generated code
+        switch (n->kind) {
+        case NODE_ADD: value = (int32_t)((uint32_t)a + (uint32_t)b); break;
+        case NODE_SUB: value = (int32_t)((uint32_t)a - (uint32_t)b); break;
+        case NODE_MUL: value = (int32_t)((uint32_t)a * (uint32_t)b); break;
+        case NODE_DIV:
+            if (b == 0) return;   // still traps at run time
+            value = a == INT32_MIN && b == -1 ? a : a / b;
+            break;
+        case NODE_LESS: value = a < b;  break;
+        default:        value = a == b; break;
+        }
+        make_constant(f, n, value);
+        f->stats->folded++;
+        return;
+    }
+    default:
+        return;
+    }
+}
+
+// A loop body's assignments reach its condition through the back edge,
+// so nothing is known about their slots inside or after the loop
+static void forget_assigned(const ASTNode *n, Known *env) {
+    if (n->kind == NODE_ASSIGN || n->kind == NODE_VARDEC) {
+        env[n->kids[n->kind == NODE_VARDEC]->slot].known = 0;
+        return;
+    }
+    for (int i = 0; i < n->kid_count; i++)
+        forget_assigned(n->kids[i], env);
+}
+
+// Whether a Break in 'n' leaves the loop around it
+static int breaks_out(const ASTNode *n) {
+    if (n->kind == NODE_BREAK) return 1;
+    if (n->kind == NODE_WHILE) return 0;
+    for (int i = 0; i < n->kid_count; i++)
+        if (breaks_out(n->kids[i])) return 1;
+    return 0;
+}
+
+static ASTNode *fold_stmt(Folder *f, ASTNode *n, Known *env, int *stops);
+
+// Folds the statements n->kids[first..] in order, dropping the ones
+// nothing reaches; returns whether control stops within them
+static int fold_list(Folder *f, ASTNode *n, int first, Known *env) {
+    int out = first, stopped = 0;
+    for (int i = first; i < n->kid_count; i++) {
+        if (stopped) {
+            f->stats->dead_statements++;
+            continue;
+        }
+        ASTNode *s = fold_stmt(f, n->kids[i], env, &stopped);
+        if (s && !(s->kind == NODE_STMTLIST && s->kid_count == 0))
+            n->kids[out++] = s;
+    }
+    n->kid_count = out;
+    return stopped;
+}
+
+// An If branch needs a statement even when nothing is left of it
+static ASTNode *fold_branch(Folder *f, ASTNode *n, Known *env, int *stops) {
+    ASTNode *s = fold_stmt(f, n, env, stops);
+    if (s) return s;
+    n->kind      = NODE_STMTLIST;
+    n->label     = "StmtList";
+    n->kids      = NULL;
+    n->kid_count = 0;
+    return n;
+}
+
+// Folds one statement, updating 'env' to what holds after it. Returns
+// the statement that replaces it, NULL for none, and sets '*stops' when
+// control never gets past it.
+static ASTNode *fold_stmt(Folder *f, ASTNode *n, Known *env, int *stops) {
+    *stops = 0;
+    switch (n->kind) {
+    case NODE_VARDEC: {
+        // every backend starts locals at zero
+        TypeKind t = n->kids[0]->type.kind;
+        Known *k = &env[n->kids[1]->slot];
+        k->known = t == TYPE_INT || t == TYPE_BOOLEAN;
+        k->value = 0;
+        return n;
+    }
+    case NODE_ASSIGN: {
+        ASTNode *value = n->kids[1];
+        fold_exp(f, value, env);
+        Known *k = &env[n->kids[0]->slot];
+        k->known = is_constant(value);
+        k->value = k->known ? constant_value(value) : 0;
+        return n;
+    }
+    case NODE_IF: {
+        fold_exp(f, n->kids[0], env);
+        if (is_constant(n->kids[0])) {
+            f->stats->branches_pruned++;
+            int taken = constant_value(n->kids[0]) ? 1 : 2;
+            // a lone VarDec branch declares a name nothing can see
+            if (taken >= n->kid_count || n->kids[taken]->kind == NODE_VARDEC) return NULL;
+            return fold_stmt(f, n->kids[taken], env, stops);
+        }
+        Known *other = xmalloc(f->slots * sizeof *other);
+        memcpy(other, env, f->slots * sizeof *other);
+        int then_stops, else_stops = 0;
+        n->kids[1] = fold_branch(f, n->kids[1], env, &then_stops);
+        if (n->kid_count == 3) n->kids[2] = fold_branch(f, n->kids[2], other, &else_stops);
+        // facts hold after the If when every branch that gets there agrees
+        if (then_stops) {
+            memcpy(env, other, f->slots * sizeof *other);
+        } else if (!else_stops) {
+            for (int s = 0; s < f->slots; s++)
+                if (!other[s].known || other[s].value != env[s].value) env[s].known = 0;
+        }
+        free(other);
+        *stops = then_stops && else_stops;
+        return n;
+    }
+    case NODE_WHILE: {
+        forget_assigned(n, env);
+        fold_exp(f, n->kids[0], env);
+        int constant = is_constant(n->kids[0]);
+        if (constant && !constant_value(n->kids[0])) {
+            f->stats->branches_pruned++;
+            return NULL;
+        }
+        Known *body = xmalloc(f->slots * sizeof *body);
+        memcpy(body, env, f->slots * sizeof *body);
+        fold_list(f, n, 1, body);
+        free(body);
+        // while true only ends through a Break or a Return
+        *stops = constant;
+        for (int i = 1; i < n->kid_count && *stops; i++)
+            *stops = !breaks_out(n->kids[i]);
+        return n;
+    }
+    case NODE_RETURN:
+        if (n->kid_count == 1) fold_exp(f, n->kids[0], env);
+        *stops = 1;
+        return n;
+    case NODE_BREAK:
+        *stops = 1;
+        return n;
+    case NODE_STMTLIST:
+        *stops = fold_list(f, n, 0, env);
+        return n;
+    default:
+        // Call, Println or SuperCall for its effect
+        fold_exp(f, n, env);
+        return n;
+    }
+}
+
+// Body statements of a method, constructor or the program start at
+// 'first'; parameters and 'this' start out unknown
+static void fold_body(Folder *f, ASTNode *n, int first, int frame_size) {
+    f->slots = frame_size + 1;
+    Known *env = xcalloc(f->slots, sizeof *env);
+    fold_list(f, n, first, env);
+    free(env);
+}
+
+void fold_constants(ASTNode *root, Arena *arena, FoldStats *stats) {
+    Folder f;
+    f.arena = arena;
+    f.stats = stats;
+    memset(stats, 0, sizeof *stats);
+    int before = count_nodes(root);
+    for (int i = 0; i < root->kid_count; i++) {
+        ASTNode *form = root->kids[i];
+        if (form->kind == NODE_STMTLIST) {
+            fold_body(&f, form, 0, root->frame_size);
+            continue;
+        }
+        for (int j = 0; j < form->kid_count; j++) {
+            ASTNode *def = form->kids[j];
+            if (def->kind == NODE_CONSTRUCTOR)
+                fold_body(&f, def, def->param_count, def->frame_size);
+            else if (def->kind == NODE_METHOD)
+                fold_body(&f, def, def->param_count + 1, def->frame_size);
+        }
+    }
+    stats->nodes_removed = before - count_nodes(root);
+}
@@ -0,0 +1,209 @@
+#include "opt.h"
+#include "../common/xalloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Nothing in an expression can assign a variable, so literals and
+// variable reads give the same value wherever they are evaluated: the
+// copy of the callee reads those arguments in place. Every other one is
+// bound first, keeping the order and the effects of the call.
+//
+// Bindings are dead once their statement is done, so each statement
+// takes its slots from the same point on; within a statement they are
+// all distinct.
+
+typedef struct {
+    const TypeEnv      *env;
+    Arena              *arena;
+    const InlineBudget *budget;
+    InlineStats        *stats;
+    ASTNode           **bodies;      // [method entry]: copy of its returned expression, NULL if not inlinable
+    int                *sizes;       // [method entry]: nodes in bodies[]
+    int                 base;        // first slot of the body being rewritten that is free for bindings
+    int                 next;        // next free slot in the current statement
+    int                 frame_size;  // slots of that body, bindings included
+} Inliner;
+
+static int count_nodes(const ASTNode *n) {
+    int count = 1;
+    for (int i = 0; i < n->kid_count; i++)
+        count += count_nodes(n->kids[i]);
+    return count;
+}
+
+static ASTNode *copy_node(Inliner *in, const ASTNode *n) {
+    ASTNode *c = arena_alloc(in->arena, sizeof *c);
+    *c = *n;
+    if (n->kid_count) {
+        c->kids = arena_alloc(in->arena, n->kid_count * sizeof *c->kids);
+        memcpy(c->kids, n->kids, n->kid_count * sizeof *c->kids);
+    }
+    return c;
+}
+
+// Copy of expression 'n' in which 'this' and the variable in slot s
+// become copies of args[0] and args[s]; with no 'args', a plain copy
+static ASTNode *copy_exp(Inliner *in, const ASTNode *n, ASTNode *const *args) {
+    if (args && (n->kind == NODE_THIS || (n->kind == NODE_IDENT && n->slot >= 0))) {
+        ASTNode *c = copy_node(in, args[n->kind == NODE_THIS ? 0 : n->slot]);
+        c->type = n->type;   // the receiver may be of a subclass
+        return c;
+    }
+    ASTNode *c = copy_node(in, n);
+    for (int i = 0; i < n->kid_count; i++)
+        c->kids[i] = copy_exp(in, n->kids[i], args);
+    return c;
+}
+
+static int reads_only_params(const ASTNode *n, int params) {
+    if (n->kind == NODE_IDENT && n->slot > params) return 0;
+    for (int i = 0; i < n->kid_count; i++)
+        if (!reads_only_params(n->kids[i], params)) return 0;
+    return 1;
+}
+
+// The expression of a method whose whole body is 'return e;', or NULL
+static const ASTNode *returned_exp(const MethodEntry *m) {
+    const ASTNode *def = m->def;
+    if (m->method_name == SYM_CTOR || m->sig.return_type.kind == TYPE_VOID) return NULL;
+    // the parameters, the return type, then the body
+    if (def->kid_count != def->param_count + 2) return NULL;
+    const ASTNode *ret = def->kids[def->param_count + 1];
+    if (ret->kind != NODE_RETURN || ret->kid_count != 1) return NULL;
+    return reads_only_params(ret->kids[0], def->param_count) ? ret->kids[0] : NULL;
+}
+
+static int is_trivial(const ASTNode *n) {
+    switch (n->kind) {
+    case NODE_INT_LIT: case NODE_TRUE: case NODE_FALSE: case NODE_THIS:
+        return 1;
+    case NODE_IDENT:
+        return n->slot >= 0;
+    default:
+        return 0;
+    }
+}
+
+// An Assign of 'value' to a new slot named 'name'; the slot's variable
+// goes to *var
+static ASTNode *bind(Inliner *in, ASTNode *value, Symbol name, Type type, ASTNode **var) {
+    ASTNode *v = new_node(in->arena, NODE_IDENT, symbol_name(in->env->names, name));
+    v->sym  = name;
+    v->type = type;
+    v->slot = in->next++;
+    if (in->next > in->frame_size) in->frame_size = in->next;
+    ASTNode *assign = new_node(in->arena, NODE_ASSIGN, "Assign");
+    add_child(in->arena, assign, v);
+    add_child(in->arena, assign, value);
+    *var = v;
+    return assign;
+}
+
+static void rewrite_exp(Inliner *in, ASTNode **link, int depth);
+
+static ASTNode *expand(Inliner *in, ASTNode *call, int depth) {
+    const MethodEntry *m = &in->env->methods[call->target];
+    const ASTNode *def = m->def;
+    ASTNode *n = new_node(in->arena, NODE_INLINED, "Inlined");
+    n->type   = call->type;
+    n->target = call->target;
+
+    ASTNode *args[def->param_count + 1];
+    ASTNode *recv = call->kids[0];
+    if (is_trivial(recv)) {
+        args[0] = recv;
+        add_child(in->arena, n, recv);
+    } else {
+        add_child(in->arena, n, bind(in, recv, SYM_THIS, (Type){ TYPE_CLASS, m->class_name }, &args[0]));
+    }
+    for (int p = 0; p < def->param_count; p++) {
+        ASTNode *arg = call->kids[2 + p];
+        const ASTNode *param = def->kids[p];
+        if (is_trivial(arg))
+            args[1 + p] = arg;
+        else
+            add_child(in->arena, n, bind(in, arg, param->kids[1]->sym, param->kids[0]->type, &args[1 + p]));
+    }
+    add_child(in->arena, n, copy_exp(in, in->bodies[call->target], args));
+    in->stats->inlined++;
+    // its calls were the callee's
+    rewrite_exp(in, &n->kids[n->kid_count - 1], depth + 1);
+    return n;
+}
+
+static void rewrite_exp(Inliner *in, ASTNode **link, int depth) {
+    ASTNode *n = *link;
+    for (int i = 0; i < n->kid_count; i++)
+        rewrite_exp(in, &n->kids[i], depth);
+    if (n->kind != NODE_CALL || n->target < 0) return;
+    in->stats->bound_calls++;
+    if (!in->bodies[n->target]) return;
+    if (in->sizes[n->target] > in->budget->max_size)
+        in->stats->too_large++;
+    else if (depth >= in->budget->max_depth)
+        in->stats->too_deep++;
+    else
+        *link = expand(in, n, depth);
+}
+
+static void rewrite_stmt(Inliner *in, ASTNode **link) {
+    ASTNode *n = *link;
+    switch (n->kind) {
+    case NODE_STMTLIST:
+        for (int i = 0; i < n->kid_count; i++)
+            rewrite_stmt(in, &n->kids[i]);
+        return;
+    case NODE_IF:
+    case NODE_WHILE:
+        in->next = in->base;
+        rewrite_exp(in, &n->kids[0], 0);
+        for (int i = 1; i < n->kid_count; i++)
+            rewrite_stmt(in, &n->kids[i]);
+        return;
+    default:
+        in->next = in->base;
+        rewrite_exp(in, link, 0);
+        return;
+    }
+}
+
+// Rewrites the 'count' statements of a body with 'frame_size' slots and
+// returns how many it has now
+static int rewrite_body(Inliner *in, ASTNode **stmts, int count, int frame_size) {
+    in->base = in->next = in->frame_size = frame_size;
+    for (int i = 0; i < count; i++)
+        rewrite_stmt(in, &stmts[i]);
+    return in->frame_size;
+}
+
+void inline_calls(ASTNode *root, const TypeEnv *env, Arena *arena, const InlineBudget *budget, InlineStats *stats) {
+    Inliner in;
+    in.env    = env;
+    in.arena  = arena;
+    in.budget = budget;
+    in.stats  = stats;
+    memset(stats, 0, sizeof *stats);
+
+    // copies from before any rewriting, so they read only the callee's
+    // own slots
+    in.bodies = xcalloc(env->method_count + 1, sizeof *in.bodies);
+    in.sizes  = xcalloc(env->method_count + 1, sizeof *in.sizes);
+    for (int id = 0; id < env->method_count; id++) {
+        const ASTNode *e = returned_exp(&env->methods[id]);
+        if (!e) continue;
+        in.bodies[id] = copy_exp(&in, e, NULL);
+        in.sizes[id]  = count_nodes(e);
+    }
+
+    for (int id = 0; id < env->method_count; id++) {
+        ASTNode *def = env->methods[id].def;
+        int first = def->param_count;
+        def->frame_size = rewrite_body(&in, def->kids + first, def->kid_count - first, def->frame_size);
+    }
+    for (int i = 0; i < root->kid_count; i++)
+        if (root->kids[i]->kind == NODE_STMTLIST)
+            root->frame_size = rewrite_body(&in, &root->kids[i], 1, root->frame_size);
+
+    free(in.sizes);
+    free(in.bodies);
+}
@@ -0,0 +1,83 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include "../typechecker/typeenv.h"
+#include <stdio.h>
+
+// Whole-program passes over a typechecked AST. Each rewrites or
+// annotates the tree in place and leaves it valid input for the code
+// generator, and reports what it did.
+
+// Class hierarchy analysis. A Call is monomorphic when its receiver's
+// static class and every subclass of it hold the same method in the
+// called slot; such calls get that method entry in ASTNode.target and
+// are emitted as direct calls.
+typedef struct {
+    int call_sites;      // Call nodes seen
+    int devirtualized;   // of those, bound to a single method
+} DevirtStats;
+
+void devirtualize(ASTNode *root, const TypeEnv *env, DevirtStats *stats);
+
+// Constant folding, propagation and dead-code elimination on method,
+// constructor and program bodies. Int and Boolean operators over
+// literals are replaced by their value; a division by zero is kept so it
+// still traps. Reads of a local whose value is a known literal along
+// straight-line code become that literal. If and While nodes with a
+// constant condition keep only the branch that runs, and statements
+// after a Return, a Break or a while-true without a Break are dropped.
+// Folded literals get labels from 'arena'.
+typedef struct {
+    int folded;           // operators replaced by their value
+    int propagated;       // variable reads replaced by a literal
+    int branches_pruned;  // Ifs and Whiles decided by their condition
+    int dead_statements;  // unreachable statements dropped
+    int nodes_removed;    // how much smaller the tree got
+} FoldStats;
+
+void fold_constants(ASTNode *root, Arena *arena, FoldStats *stats);
+
+// Inlining of bound calls whose method body is a single Return of an
+// expression, e.g. an accessor. Each becomes a NODE_INLINED: kids[0] is
+// the receiver, then come Assigns binding the other arguments to new
+// frame slots of the caller, and last a copy of the callee's expression
+// reading 'this' and its parameters from there. The receiver is an
+// Assign as well unless it is 'this' or a variable, which the copy reads
+// directly, as it does literal and variable arguments. Backends run the
+// Assigns in order, then trap like the call would if the receiver is
+// null (never for 'this'), then evaluate the copy as the node's value.
+// Calls in the copies are inlined in turn, up to max_depth. Runs after
+// devirtualize.
+typedef struct {
+    int max_size;    // nodes in the callee's returned expression
+    int max_depth;   // inlined calls nested in one another; 0 inlines none
+} InlineBudget;
+
+#define DEFAULT_INLINE_BUDGET { 12, 3 }
+
+typedef struct {
+    int bound_calls;  // Calls with a target, inlined copies included
+    int inlined;      // of those, replaced by the callee's expression
+    int too_large;    // left alone for max_size
+    int too_deep;     // left alone for max_depth
+} InlineStats;
+
+void inline_calls(ASTNode *root, const TypeEnv *env, Arena *arena, const InlineBudget *budget, InlineStats *stats);
+
+// Interprocedural escape analysis. With no fields and no globals, an
+// object outlives the frame that made it only by being returned, so a
+// New whose object cannot reach its method's return value is numbered
+// as an object of that frame in ASTNode.alloc; the rest stay
+// ALLOC_HEAP. Objects have no state a program can change or compare, so
+// every run of one New may reuse the same frame storage. Runs after
+// devirtualize, whose bound calls it follows exactly, and inline_calls.
+typedef struct {
+    int sites;      // New nodes seen
+    int in_frame;   // of those, placed in their frame
+} EscapeStats;
+
+void analyze_escapes(ASTNode *root, const TypeEnv *env, EscapeStats *stats);
+// One line per New: the method it is in, its class and where it goes
+void print_escape_sites(FILE *out, const ASTNode *root, const TypeEnv *env);
+
+#endif // OPT_H
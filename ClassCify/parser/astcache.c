@@ -0,0 +1,405 @@
+#include "astcache.h"
+#include "../common/xalloc.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char cache_magic[8] = "CCFYAST";
+
+uint64_t source_hash(const char *data, size_t length) {
+    // eight bytes per step, folded with a 64-bit multiply
+    const uint64_t k = 0x9e3779b97f4a7c15ULL;
+    uint64_t h = length * k;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, 8);
+        h = (h ^ w) * k;
+        h ^= h >> 29;
+    }
+    uint64_t w = 0;
+    memcpy(&w, data + i, length - i);
+    h = (h ^ w) * k;
+    h ^= h >> 32;
+    return h;
+}
+
+int ast_cache_path(char *out, size_t size, const char *dir, uint64_t hash) {
+    return snprintf(out, size, "%s/%016llx.ast", dir, (unsigned long long)hash);
+}
+
+// Growable byte buffer for one section of the file
+typedef struct {
+    unsigned char *data;
+    size_t         size, cap;
+} Buf;
+
+static void *buf_push(Buf *b, size_t n) {
+    if (b->size + n > b->cap) {
+        b->cap = b->cap ? b->cap * 2 : 4096;
+        while (b->size + n > b->cap) b->cap *= 2;
+        b->data = xrealloc(b->data, b->cap);
+    }
+    void *p = b->data + b->size;
+    b->size += n;
+    return p;
+}
+
+static uint32_t add_string(Buf *strings, const char *s) {
+    size_t length = strlen(s) + 1;
+    uint32_t at = (uint32_t)strings->size;
+    memcpy(buf_push(strings, length), s, length);
+    return at;
+}
+
+typedef struct {
+    Buf       nodes, kids, strings;
+    uint32_t *symbol_at;    // string offset of each symbol's name
+    // labels that are not symbol names, e.g. "If" or "+", stored once each
+    const char **label_keys;
+    uint32_t    *label_vals;
+    unsigned     label_mask;
+    int          label_count;
+} Writer;
+
+static uint32_t label_hash(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static uint32_t intern_label(Writer *w, const char *label) {
+    if ((unsigned)(w->label_count + 1) * 2 > w->label_mask) {
+        unsigned old_mask = w->label_mask;
+        const char **old_keys = w->label_keys;
+        uint32_t *old_vals = w->label_vals;
+        w->label_mask = old_mask ? old_mask * 2 + 1 : 255;
+        w->label_keys = xcalloc(w->label_mask + 1, sizeof *w->label_keys);
+        w->label_vals = xmalloc((w->label_mask + 1) * sizeof *w->label_vals);
+        for (unsigned i = 0; old_mask && i <= old_mask; i++) {
+            if (!old_keys[i]) continue;
+            unsigned j = label_hash(old_keys[i]) & w->label_mask;
+            while (w->label_keys[j]) j = (j + 1) & w->label_mask;
+            w->label_keys[j] = old_keys[i];
+            w->label_vals[j] = old_vals[i];
+        }
+        free(old_keys);
+        free(old_vals);
+    }
+    unsigned i = label_hash(label) & w->label_mask;
+    while (w->label_keys[i]) {
+        if (strcmp(w->label_keys[i], label) == 0) return w->label_vals[i];
+        i = (i + 1) & w->label_mask;
+    }
+    w->label_keys[i] = label;
+    w->label_vals[i] = add_string(&w->strings, label);
+    w->label_count++;
+    return w->label_vals[i];
+}
+
+// Appends 'n' and, after it, its subtree; children of a node sit next
+// to each other in the kid array. Returns the node's index.
+static uint32_t write_node(Writer *w, const ASTNode *n) {
+    uint32_t index = (uint32_t)(w->nodes.size / sizeof(CachedNode));
+    CachedNode *c = buf_push(&w->nodes, sizeof *c);
+    c->kind        = (uint16_t)n->kind;
+    c->type_kind   = (uint16_t)n->type.kind;
+    c->sym         = n->sym;
+    c->int_value   = n->int_value;
+    c->type_cls    = n->type.cls;
+    c->label       = n->sym != NO_SYMBOL ? w->symbol_at[n->sym] : intern_label(w, n->label);
+    c->kid_count   = (uint32_t)n->kid_count;
+    c->param_count = (uint32_t)n->param_count;
+    uint32_t first = (uint32_t)(w->kids.size / sizeof(uint32_t));
+    c->first_kid   = first;
+    buf_push(&w->kids, n->kid_count * sizeof(uint32_t));
+    // 'c' may move as the node table grows, so write through indices
+    for (int i = 0; i < n->kid_count; i++) {
+        uint32_t kid = write_node(w, n->kids[i]);
+        ((uint32_t *)w->kids.data)[first + i] = kid;
+    }
+    return index;
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+    const unsigned char *p = data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+int write_ast_cache(const char *path, const ASTNode *root, const InternTable *names,
+                    uint64_t hash, const char *source, size_t source_length) {
+    Writer w;
+    memset(&w, 0, sizeof w);
+    int symbols = symbol_count(names);
+    w.symbol_at = xmalloc((symbols + 1) * sizeof(uint32_t));
+    for (int s = 0; s < symbols; s++)
+        w.symbol_at[s] = add_string(&w.strings, symbol_name(names, s));
+    uint32_t root_index = write_node(&w, root);
+
+    CacheHeader h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, cache_magic, sizeof h.magic);
+    h.version       = AST_CACHE_VERSION;
+    h.node_count    = (uint32_t)(w.nodes.size / sizeof(CachedNode));
+    h.kid_count     = (uint32_t)(w.kids.size / sizeof(uint32_t));
+    h.symbol_count  = (uint32_t)symbols;
+    h.root          = root_index;
+    h.nodes_at      = sizeof h;
+    h.kids_at       = h.nodes_at + (uint32_t)w.nodes.size;
+    h.symbols_at    = h.kids_at + (uint32_t)w.kids.size;
+    h.strings_at    = h.symbols_at + (uint32_t)(symbols * sizeof(uint32_t));
+    h.strings_size  = (uint32_t)w.strings.size;
+    h.source_hash   = hash;
+    h.source_length = source_length;
+    h.source_at     = (uint64_t)h.strings_at + h.strings_size;
+
+    // readers may be mapping the old file; they keep it until they unmap
+    size_t length = strlen(path);
+    char *tmp = xmalloc(length + 8);
+    memcpy(tmp, path, length);
+    memcpy(tmp + length, ".XXXXXX", 8);
+    int status = -1;
+    int fd = mkstemp(tmp);
+    if (fd >= 0) {
+        if (write_all(fd, &h, sizeof h) == 0 &&
+            write_all(fd, w.nodes.data, w.nodes.size) == 0 &&
+            write_all(fd, w.kids.data, w.kids.size) == 0 &&
+            write_all(fd, w.symbol_at, symbols * sizeof(uint32_t)) == 0 &&
+            write_all(fd, w.strings.data, w.strings.size) == 0 &&
+            write_all(fd, source, source_length) == 0)
+            status = 0;
+        if (close(fd) != 0) status = -1;
+        if (status == 0) status = rename(tmp, path);
+        if (status != 0) {
+            int saved = errno;
+            unlink(tmp);
+            errno = saved;
+        }
+    }
+    free(tmp);
+    free(w.nodes.data);
+    free(w.kids.data);
+    free(w.strings.data);
+    free(w.symbol_at);
+    free(w.label_keys);
+    free(w.label_vals);
+    return status;
+}
+
+// Kid counts the parser can give each kind, -1 for no upper bound; the
+// parameters of a Constructor or Method come on top
+static const struct {
+    int min, max;
+} kid_limits[NODE_INLINED] = {
+    [NODE_PROGRAM]     = { 0, -1 },
+    [NODE_CLASSDEF]    = { 2, -1 },   // name, [superclass,] fields, constructor, methods
+    [NODE_CONSTRUCTOR] = { 0, -1 },
+    [NODE_SUPERCALL]   = { 0, -1 },
+    [NODE_METHOD]      = { 1, -1 },   // the return type, then the body
+    [NODE_VARDEC]      = { 2, 2 },
+    [NODE_STMTLIST]    = { 1, -1 },
+    [NODE_ASSIGN]      = { 2, 2 },
+    [NODE_WHILE]       = { 1, -1 },
+    [NODE_IF]          = { 2, 3 },
+    [NODE_RETURN]      = { 0, 1 },
+    [NODE_BREAK]       = { 0, 0 },
+    [NODE_PRINTLN]     = { 1, 1 },
+    [NODE_CALL]        = { 2, -1 },   // receiver, method name, arguments
+    [NODE_NEW]         = { 1, -1 },   // class name, arguments
+    [NODE_ADD]         = { 2, 2 },
+    [NODE_SUB]         = { 2, 2 },
+    [NODE_MUL]         = { 2, 2 },
+    [NODE_DIV]         = { 2, 2 },
+    [NODE_LESS]        = { 2, 2 },
+    [NODE_EQUAL]       = { 2, 2 },
+    [NODE_INT_LIT]     = { 0, 0 },
+    [NODE_TRUE]        = { 0, 0 },
+    [NODE_FALSE]       = { 0, 0 },
+    [NODE_THIS]        = { 0, 0 },
+    [NODE_IDENT]       = { 0, 0 },
+    [NODE_TYPE]        = { 0, 0 },
+};
+
+static uint16_t kid_kind(const AstCache *c, const CachedNode *n, uint32_t i) {
+    return c->nodes[c->kids[n->first_kid + i]].kind;
+}
+
+// Whether node 'n' has a shape the parser can produce: the kid count for
+// its kind, and the kinds of the kids the later passes reach by position.
+// Its kids are known to be in range.
+static int valid_shape(const AstCache *c, const CachedNode *n) {
+    if (n->kind >= NODE_INLINED || n->type_kind > TYPE_CLASS) return 0;
+    uint32_t params = 0;
+    if (n->kind == NODE_CONSTRUCTOR || n->kind == NODE_METHOD) params = n->param_count;
+    else if (n->param_count != 0) return 0;
+    if (params > n->kid_count) return 0;
+    uint32_t min = (uint32_t)kid_limits[n->kind].min + params;
+    int max = kid_limits[n->kind].max;
+    if (n->kid_count < min || (max >= 0 && n->kid_count > (uint32_t)max)) return 0;
+    for (uint32_t i = 0; i < params; i++)
+        if (kid_kind(c, n, i) != NODE_VARDEC) return 0;
+
+    switch (n->kind) {
+    case NODE_CLASSDEF:
+    case NODE_NEW:
+        return kid_kind(c, n, 0) == NODE_IDENT;
+    case NODE_METHOD:
+        return n->sym != NO_SYMBOL && kid_kind(c, n, params) == NODE_TYPE;
+    case NODE_VARDEC:
+        return kid_kind(c, n, 0) == NODE_TYPE && kid_kind(c, n, 1) == NODE_IDENT;
+    case NODE_ASSIGN:
+        return kid_kind(c, n, 0) == NODE_IDENT;
+    case NODE_CALL:
+        return kid_kind(c, n, 1) == NODE_IDENT;
+    case NODE_IDENT:
+        return n->sym != NO_SYMBOL;
+    case NODE_TYPE:
+        return n->type_kind != TYPE_CLASS || n->type_cls != NO_SYMBOL;
+    default:
+        return 1;
+    }
+}
+
+// Every offset and index in the file must stay inside it, and the nodes
+// must form a tree the parser could have built
+static int valid_cache(const AstCache *c) {
+    const CacheHeader *h = c->header;
+    size_t size = c->size;
+    if (h->nodes_at != sizeof *h ||
+        (uint64_t)h->nodes_at + (uint64_t)h->node_count * sizeof(CachedNode) != h->kids_at ||
+        (uint64_t)h->kids_at + (uint64_t)h->kid_count * sizeof(uint32_t) != h->symbols_at ||
+        (uint64_t)h->symbols_at + (uint64_t)h->symbol_count * sizeof(uint32_t) != h->strings_at ||
+        (uint64_t)h->strings_at + h->strings_size != h->source_at ||
+        h->source_at + h->source_length != size ||
+        h->strings_size == 0 || c->strings[h->strings_size - 1] != '\0' ||
+        h->root >= h->node_count)
+        return 0;
+    for (uint32_t s = 0; s < h->symbol_count; s++)
+        if (c->symbols[s] >= h->strings_size) return 0;
+    for (uint32_t i = 0; i < h->node_count; i++) {
+        const CachedNode *n = &c->nodes[i];
+        if (n->label >= h->strings_size ||
+            n->first_kid > h->kid_count || n->kid_count > h->kid_count - n->first_kid ||
+            (n->sym != NO_SYMBOL && (uint32_t)n->sym >= h->symbol_count) ||
+            (n->type_cls != NO_SYMBOL && (uint32_t)n->type_cls >= h->symbol_count))
+            return 0;
+    }
+    // the writer numbers nodes in pre-order, so a child always comes after
+    // its parent; that rules out cycles, and one parent per node rules out
+    // shared subtrees
+    unsigned char *has_parent = xcalloc(h->node_count, 1);
+    int valid = 1;
+    for (uint32_t i = 0; i < h->node_count && valid; i++) {
+        const CachedNode *n = &c->nodes[i];
+        for (uint32_t k = 0; k < n->kid_count && valid; k++) {
+            uint32_t kid = c->kids[n->first_kid + k];
+            if (kid <= i || kid >= h->node_count || has_parent[kid]) valid = 0;
+            else has_parent[kid] = 1;
+        }
+    }
+    valid = valid && !has_parent[h->root] && c->nodes[h->root].kind == NODE_PROGRAM;
+    free(has_parent);
+    if (!valid) return 0;
+    for (uint32_t i = 0; i < h->node_count; i++)
+        if (!valid_shape(c, &c->nodes[i])) return 0;
+    return 1;
+}
+
+int open_ast_cache(const char *path, uint64_t hash, const char *source, size_t source_length,
+                   AstCache *cache) {
+    memset(cache, 0, sizeof *cache);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CacheHeader)) {
+        close(fd);
+        return -1;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+
+    cache->base   = base;
+    cache->size   = (size_t)st.st_size;
+    cache->header = base;
+    const CacheHeader *h = cache->header;
+    if (memcmp(h->magic, cache_magic, sizeof h->magic) != 0 ||
+        h->version != AST_CACHE_VERSION ||
+        h->source_hash != hash || h->source_length != source_length ||
+        h->strings_at > cache->size || source_length > cache->size ||
+        h->source_at != cache->size - source_length ||
+        memcmp(cache->base + h->source_at, source, source_length) != 0) {
+        close_ast_cache(cache);
+        return -1;
+    }
+    cache->nodes   = (const CachedNode *)(cache->base + h->nodes_at);
+    cache->kids    = (const uint32_t *)(cache->base + h->kids_at);
+    cache->symbols = (const uint32_t *)(cache->base + h->symbols_at);
+    cache->strings = (const char *)(cache->base + h->strings_at);
+    if (!valid_cache(cache)) {
+        close_ast_cache(cache);
+        return -1;
+    }
+    return 0;
+}
+
+void close_ast_cache(AstCache *cache) {
+    if (cache->base) munmap((void *)cache->base, cache->size);
+    memset(cache, 0, sizeof *cache);
+}
+
+void print_cached_ast(const AstCache *cache, const CachedNode *node, int indent) {
+    for (int i = 0; i < indent; i++) putchar(' ');
+    printf("%s\n", cached_label(cache, node));
+    for (uint32_t i = 0; i < node->kid_count; i++)
+        print_cached_ast(cache, cached_kid(cache, node, i), indent + 2);
+}
+
+ASTNode *load_cached_ast(const AstCache *cache, Arena *arena, InternTable *names) {
+    const CacheHeader *h = cache->header;
+    // cached symbol ids -> ids in 'names'; equal when 'names' is fresh
+    Symbol *remap = xmalloc((h->symbol_count + 1) * sizeof(Symbol));
+    for (uint32_t s = 0; s < h->symbol_count; s++) {
+        const char *name = cache->strings + cache->symbols[s];
+        remap[s] = intern(names, name, (int)strlen(name));
+    }
+
+    ASTNode  *nodes = arena_alloc(arena, h->node_count * sizeof(ASTNode));
+    ASTNode **kids  = arena_alloc(arena, (h->kid_count + 1) * sizeof(ASTNode *));
+    for (uint32_t k = 0; k < h->kid_count; k++)
+        kids[k] = &nodes[cache->kids[k]];
+    for (uint32_t i = 0; i < h->node_count; i++) {
+        const CachedNode *c = &cache->nodes[i];
+        ASTNode *n = &nodes[i];
+        memset(n, 0, sizeof *n);
+        n->kind        = (NodeKind)c->kind;
+        n->label       = cache->strings + c->label;
+        n->kids        = c->kid_count ? kids + c->first_kid : NULL;
+        n->kid_count   = (int)c->kid_count;
+        n->sym         = c->sym == NO_SYMBOL ? NO_SYMBOL : remap[c->sym];
+        n->int_value   = c->int_value;
+        n->param_count = (int)c->param_count;
+        n->type.kind   = (TypeKind)c->type_kind;
+        n->type.cls    = c->type_cls == NO_SYMBOL ? NO_SYMBOL : remap[c->type_cls];
+        n->depth       = -1;
+        n->slot        = -1;
+        n->target      = -1;
+        n->alloc       = ALLOC_HEAP;
+    }
+    free(remap);
+    return &nodes[h->root];
+}
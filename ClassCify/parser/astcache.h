@@ -0,0 +1,84 @@
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+
+#include "parser.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary AST cache. A parsed program is written as a node table, a child
+// index array, a symbol table and a string table. Nodes refer to each
+// other by index and to strings by offset, so the file is used straight
+// from mmap with no pointer fix-ups. Files are named by a hash of the
+// source text and end with a copy of it, which must match the source
+// byte for byte when opened, so a hash collision costs a parse rather
+// than a wrong tree.
+
+#define AST_CACHE_VERSION 2
+
+typedef struct {
+    char     magic[8];         // "CCFYAST\0"
+    uint32_t version;
+    uint32_t node_count, kid_count, symbol_count;
+    uint32_t root;             // node index of the Program node
+    uint32_t nodes_at, kids_at, symbols_at, strings_at;   // byte offsets in the file
+    uint32_t strings_size;
+    uint64_t source_hash, source_length;
+    uint64_t source_at;        // byte offset of the copy of the source, which ends the file
+} CacheHeader;
+
+typedef struct {
+    uint16_t kind;             // NodeKind
+    uint16_t type_kind;        // TypeKind of a NODE_TYPE
+    int32_t  sym;              // symbol table index, or NO_SYMBOL
+    int32_t  int_value;
+    int32_t  type_cls;         // symbol table index, or NO_SYMBOL
+    uint32_t label;            // string table offset
+    uint32_t first_kid;        // kid array index of the first child
+    uint32_t kid_count;
+    uint32_t param_count;
+} CachedNode;
+
+// An opened cache file
+typedef struct {
+    const unsigned char *base;
+    size_t               size;
+    const CacheHeader   *header;
+    const CachedNode    *nodes;
+    const uint32_t      *kids;
+    const uint32_t      *symbols;   // string table offset of each symbol's name
+    const char          *strings;
+} AstCache;
+
+// Non-cryptographic 64-bit hash of the source text
+uint64_t source_hash(const char *data, size_t length);
+// "<dir>/<hash>.ast"; returns the snprintf result
+int      ast_cache_path(char *out, size_t size, const char *dir, uint64_t hash);
+
+// Writes atomically (temporary file, then rename). Returns 0 or -1 with errno set.
+int  write_ast_cache(const char *path, const ASTNode *root, const InternTable *names,
+                     uint64_t hash, const char *source, size_t source_length);
+// Maps 'path' and checks it was written for exactly this source. Returns
+// 0, or -1 when the file is missing, stale or malformed.
+int  open_ast_cache(const char *path, uint64_t hash, const char *source, size_t source_length,
+                    AstCache *cache);
+void close_ast_cache(AstCache *cache);
+
+static inline const CachedNode *cached_root(const AstCache *c) {
+    return &c->nodes[c->header->root];
+}
+static inline const CachedNode *cached_kid(const AstCache *c, const CachedNode *n, uint32_t i) {
+    return &c->nodes[c->kids[n->first_kid + i]];
+}
+static inline const char *cached_label(const AstCache *c, const CachedNode *n) {
+    return c->strings + n->label;
+}
+
+// Prints the mapped tree exactly as print_ast prints the parsed one
+void print_cached_ast(const AstCache *cache, const CachedNode *node, int indent);
+
+// Rebuilds ASTNodes in 'arena', interning the cached symbols into
+// 'names'. Labels point into the mapping, so the cache must stay open
+// while the AST is in use.
+ASTNode *load_cached_ast(const AstCache *cache, Arena *arena, InternTable *names);
+
+#endif // ASTCACHE_H
@@ -0,0 +1,127 @@
+#include "astcache.h"
+#include "../tokenizer/source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Times getting an AST for one source file three ways: tokenize + parse,
+// opening the cache and walking the mapped nodes, and opening the cache
+// and rebuilding ASTNodes from it. Checks the rebuilt tree against the
+// parsed one first.
+//
+//   gcc -O2 -pthread -o bench_astcache bench_astcache.c astcache.c parser.c
+//       ../tokenizer/{tokenizer,structural,charclass,intern,source}.c ../common/*.c
+//   ./bench_astcache [file [cachedir [iterations]]]
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int same_tree(const ASTNode *a, const ASTNode *b) {
+    if (a->kind != b->kind || strcmp(a->label, b->label) != 0 || a->kid_count != b->kid_count ||
+        a->sym != b->sym || a->int_value != b->int_value || a->param_count != b->param_count ||
+        a->type.kind != b->type.kind || a->type.cls != b->type.cls)
+        return 0;
+    for (int i = 0; i < a->kid_count; i++)
+        if (!same_tree(a->kids[i], b->kids[i])) return 0;
+    return 1;
+}
+
+// Stands in for a consumer of the mapped form, e.g. print_cached_ast
+static long walk(const AstCache *c, const CachedNode *n) {
+    long sum = n->kind + c->strings[n->label];
+    for (uint32_t i = 0; i < n->kid_count; i++)
+        sum += walk(c, cached_kid(c, n, i));
+    return sum;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "sample_text.txt";
+    const char *dir  = argc > 2 ? argv[2] : ".";
+    int iterations   = argc > 3 ? atoi(argv[3]) : 50;
+    SourceFile src;
+    if (load_source(path, &src) != 0) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    uint64_t hash = source_hash(src.data, src.length);
+    char cache_path[4096];
+    ast_cache_path(cache_path, sizeof cache_path, dir, hash);
+
+    // Parse once and write the cache
+    InternTable *names = create_intern_table();
+    Arena arena = ARENA_INIT;
+    Parser parser;
+    init_parser(&parser, src.data, names, &arena);
+    ASTNode *ast = parse_program(&parser);
+    if (!ast) {
+        print_diagnostic(stderr, &parser.diag);
+        return EXIT_FAILURE;
+    }
+    free_parser(&parser);
+    if (write_ast_cache(cache_path, ast, names, hash, src.data, src.length) != 0) {
+        perror(cache_path);
+        return EXIT_FAILURE;
+    }
+
+    AstCache cache;
+    InternTable *loaded_names = create_intern_table();
+    Arena loaded_arena = ARENA_INIT;
+    if (open_ast_cache(cache_path, hash, src.data, src.length, &cache) != 0) {
+        fprintf(stderr, "%s: cannot open the cache just written\n", cache_path);
+        return EXIT_FAILURE;
+    }
+    int same = same_tree(ast, load_cached_ast(&cache, &loaded_arena, loaded_names));
+    printf("%s: %zu bytes, %u nodes, cache %zu bytes, trees %s\n", path, src.length,
+           cache.header->node_count, cache.size, same ? "match" : "DIFFER");
+    close_ast_cache(&cache);
+    arena_free(&loaded_arena);
+    free_intern_table(loaded_names);
+    arena_free(&arena);
+    free_intern_table(names);
+    if (!same) return EXIT_FAILURE;
+
+    double t0 = now();
+    for (int i = 0; i < iterations; i++) {
+        InternTable *n = create_intern_table();
+        Arena a = ARENA_INIT;
+        init_parser(&parser, src.data, n, &a);
+        parse_program(&parser);
+        free_parser(&parser);
+        arena_free(&a);
+        free_intern_table(n);
+    }
+    double parse_time = (now() - t0) / iterations;
+
+    volatile long sink = 0;
+    t0 = now();
+    for (int i = 0; i < iterations; i++) {
+        source_hash(src.data, src.length);
+        open_ast_cache(cache_path, hash, src.data, src.length, &cache);
+        sink += walk(&cache, cached_root(&cache));
+        close_ast_cache(&cache);
+    }
+    double mapped_time = (now() - t0) / iterations;
+
+    t0 = now();
+    for (int i = 0; i < iterations; i++) {
+        InternTable *n = create_intern_table();
+        Arena a = ARENA_INIT;
+        source_hash(src.data, src.length);
+        open_ast_cache(cache_path, hash, src.data, src.length, &cache);
+        load_cached_ast(&cache, &a, n);
+        close_ast_cache(&cache);
+        arena_free(&a);
+        free_intern_table(n);
+    }
+    double load_time = (now() - t0) / iterations;
+
+    printf("tokenize + parse     %9.3f ms\n", parse_time * 1e3);
+    printf("hash + map + walk    %9.3f ms  (%.1fx)\n", mapped_time * 1e3, parse_time / mapped_time);
+    printf("hash + map + rebuild %9.3f ms  (%.1fx)\n", load_time * 1e3, parse_time / load_time);
+    release_source(&src);
+    return EXIT_SUCCESS;
+}
@@ -1,42 +1,38 @@
 #include "parser.h"
 #include "../tokenizer/tokenizer.h"
+#include "../tokenizer/source.h"
 #include <stdio.h>
 #include <stdlib.h>
 
-extern Tokenizer tokenizer;
-
-int main(void) {
-    // Open the test file
-    FILE *f = fopen("sample_text.txt", "r");
-    if (!f) {
-        perror("fopen");
-        return EXIT_FAILURE;
-    }
-
-    // Read entire contents into a buffer
-    fseek(f, 0, SEEK_END);
-    long size = ftell(f);
-    rewind(f);
-    char *src = malloc(size + 1);
-    if (!src) {
-        fprintf(stderr, "Out of memory!\n");
-        fclose(f);
+int main(int argc, char **argv) {
+    // Map the source file (default: the bundled sample)
+    const char *path = argc > 1 ? argv[1] : "sample_text.txt";
+    SourceFile src;
+    if (load_source(path, &src) != 0) {
+        perror(path);
         return EXIT_FAILURE;
     }
-    fread(src, 1, size, f);
-    src[size] = '\0';
-    fclose(f);
 
     // Tokenize and parse into an AST
-    init_tokenizer(&tokenizer, src);
-    ASTNode *ast = parse_program();
-
-    // Print the AST
-    printf("=== AST ===\n");
-    print_ast(ast, 0);
+    InternTable *names = create_intern_table();
+    Arena arena = ARENA_INIT;
+    Parser parser;
+    init_parser(&parser, src.data, names, &arena);
+    ASTNode *ast = parse_program(&parser);
+    int status = EXIT_SUCCESS;
+    if (ast) {
+        // Print the AST
+        printf("=== AST ===\n");
+        print_ast(ast, 0);
+    } else {
+        print_diagnostic(stderr, &parser.diag);
+        status = EXIT_FAILURE;
+    }
 
     // Cleanup
-    free_ast(ast);
-    free(src);
-    return EXIT_SUCCESS;
+    free_parser(&parser);
+    arena_free(&arena);
+    free_intern_table(names);
+    release_source(&src);
+    return status;
 }
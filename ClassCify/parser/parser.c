@@ -1,33 +1,59 @@
 #include "parser.h"
+#include "../common/xalloc.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 
-// Global tokenizer and current token
-Tokenizer tokenizer;
-static Token current;
+// Children of nodes still being parsed wait on the parser's kid stack.
+// Nodes close in LIFO order, so an open node's children are always the
+// top kid_count entries; close_node copies them into the arena in one go.
+static void push_child(Parser *p, ASTNode *parent, ASTNode *child) {
+    if (p->kid_top == p->kid_cap) {
+        p->kid_cap   = p->kid_cap ? p->kid_cap * 2 : 256;
+        p->kid_stack = xrealloc(p->kid_stack, sizeof(ASTNode*) * p->kid_cap);
+    }
+    p->kid_stack[p->kid_top++] = child;
+    parent->kid_count++;
+}
+static ASTNode *close_node(Parser *p, ASTNode *n) {
+    if (n->kid_count > 0) {
+        n->kids = arena_alloc(p->arena, sizeof(ASTNode*) * n->kid_count);
+        p->kid_top -= n->kid_count;
+        memcpy(n->kids, p->kid_stack + p->kid_top, sizeof(ASTNode*) * n->kid_count);
+    }
+    return n;
+}
 
 // AST helpers
-ASTNode *new_node(const char *label) {
-    ASTNode *n = malloc(sizeof(ASTNode));
-    n->label     = strdup(label);
-    n->kid_count = 0;
-    n->kids      = NULL;
+// 'label' must outlive the AST
+static ASTNode *alloc_node(Arena *arena, NodeKind kind, const char *label) {
+    ASTNode *n = arena_alloc(arena, sizeof(ASTNode));
+    memset(n, 0, sizeof *n);
+    n->kind     = kind;
+    n->label    = label;
+    n->sym      = NO_SYMBOL;
+    n->type.cls = NO_SYMBOL;
+    n->depth    = -1;
+    n->slot     = -1;
+    n->target   = -1;
+    n->alloc    = ALLOC_HEAP;
     return n;
 }
-void add_child(ASTNode *parent, ASTNode *child) {
-    parent->kids = realloc(parent->kids, sizeof(ASTNode*) * (parent->kid_count + 1));
-    parent->kids[parent->kid_count++] = child;
+ASTNode *new_node(Arena *arena, NodeKind kind, const char *label) {
+    size_t length = strlen(label);
+    char *copy = arena_alloc(arena, length + 1);
+    memcpy(copy, label, length + 1);
+    return alloc_node(arena, kind, copy);
 }
-void free_ast(ASTNode *node) {
-    if (!node) return;
-    for (int i = 0; i < node->kid_count; i++) {
-        free_ast(node->kids[i]);
-    }
-    free(node->kids);
-    free(node->label);
-    free(node);
+// Append to a node that is already closed; copies the child array, so
+// it is meant for passes that edit the tree after parsing
+void add_child(Arena *arena, ASTNode *parent, ASTNode *child) {
+    ASTNode **kids = arena_alloc(arena, sizeof(ASTNode*) * (parent->kid_count + 1));
+    if (parent->kid_count)
+        memcpy(kids, parent->kids, sizeof(ASTNode*) * parent->kid_count);
+    kids[parent->kid_count++] = child;
+    parent->kids = kids;
 }
 void print_ast(ASTNode *node, int indent) {
     if (!node) return;
@@ -39,406 +65,565 @@ void print_ast(ASTNode *node, int indent) {
 }
 
 // Token handling
-static void next_token_safe() {
-    free_token(&current);
-    if (has_more_tokens(&tokenizer)) {
-        current = next_token(&tokenizer);
+// Kind of the token k places ahead of the cursor; TOKEN_EOF past the end
+static TokenKind peek(Parser *p, int k) {
+    int i = p->pos + k;
+    return i < p->tokens.count ? p->tokens.kinds[i] : TOKEN_EOF;
+}
+static void advance(Parser *p) {
+    // never step past the trailing TOKEN_EOF
+    if (p->pos < p->tokens.count - 1) p->pos++;
+}
+// Record the error and unwind to parse_program
+static _Noreturn void parse_error(Parser *p, const char *msg) {
+    p->diag.phase   = DIAG_PARSE;
+    p->diag.message = msg;
+    if (peek(p, 0) == TOKEN_EOF) {
+        p->diag.near        = NULL;
+        p->diag.near_length = 0;
     } else {
-        current.kind  = TOKEN_UNKNOWN;
-        current.value = NULL;
+        p->diag.near        = p->tokenizer.input + p->tokens.offsets[p->pos];
+        p->diag.near_length = p->tokens.lengths[p->pos];
     }
+    longjmp(p->bail, 1);
 }
-static void parse_error(const char *msg) {
-    fprintf(stderr, "Parse error at token '%s': %s\n",
-            current.value ? current.value : "(null)", msg);
-    exit(EXIT_FAILURE);
+// Leaf node for the current token. Identifiers are labelled with their
+// interned name, so no per-node copy of the name is made.
+static ASTNode *token_node(Parser *p, NodeKind kind) {
+    int pos = p->pos;
+    if (kind == NODE_INT_LIT) {
+        int length = p->tokens.lengths[pos];
+        char *copy = arena_alloc(p->arena, length + 1);
+        memcpy(copy, p->tokenizer.input + p->tokens.offsets[pos], length);
+        copy[length] = '\0';
+        ASTNode *n = alloc_node(p->arena, kind, copy);
+        n->int_value = p->tokens.values[pos];
+        return n;
+    }
+    ASTNode *n = alloc_node(p->arena, kind, symbol_name(p->tokenizer.names, p->tokens.values[pos]));
+    n->sym = p->tokens.values[pos];
+    return n;
 }
-static void expect(TokenKind kind, const char *what) {
-    if (current.kind != kind) parse_error(what);
-    next_token_safe();
+static void expect(Parser *p, TokenKind kind, const char *what) {
+    if (peek(p, 0) != kind) parse_error(p, what);
+    advance(p);
 }
 
 // Forward declarations
-ASTNode *parse_program();
-ASTNode *parse_classdef();
-ASTNode *parse_constructor();
-ASTNode *parse_methoddef();
-ASTNode *parse_stmt_list();
-ASTNode *parse_stmt();
-ASTNode *parse_vardec_stmt();
-ASTNode *parse_exp();
-ASTNode *parse_type();
+static ASTNode *parse_classdef(Parser *p);
+static ASTNode *parse_constructor(Parser *p);
+static ASTNode *parse_methoddef(Parser *p);
+static ASTNode *parse_stmt_list(Parser *p);
+static ASTNode *parse_stmt(Parser *p);
+static ASTNode *parse_vardec_stmt(Parser *p);
+static ASTNode *parse_exp(Parser *p);
+static ASTNode *parse_type(Parser *p);
+
+void init_parser(Parser *p, const char *input, InternTable *names, Arena *arena) {
+    memset(p, 0, sizeof *p);
+    init_tokenizer(&p->tokenizer, input, names);
+    p->arena = arena;
+}
+
+void free_parser(Parser *p) {
+    free_token_array(&p->tokens);
+    free(p->kid_stack);
+    p->kid_stack = NULL;
+    p->kid_top = p->kid_cap = 0;
+}
 
 // program ::= classdef* stmt+
-ASTNode *parse_program() {
-    next_token_safe();
-    ASTNode *root = new_node("Program");
+// 'done' holds classdefs already parsed elsewhere; p->pos is just past them
+static ASTNode *parse_forms(Parser *p, ASTNode **done, int done_count) {
+    ASTNode *root = new_node(p->arena, NODE_PROGRAM, "Program");
+    for (int i = 0; i < done_count; i++)
+        push_child(p, root, done[i]);
 
     // zero or more classdefs
-    while (current.kind == TOKEN_LPAREN) {
-        int save = tokenizer.position;
-        Token tok = current;
-        next_token_safe();
-        if (current.kind == TOKEN_CLASS) {
-            tokenizer.position = save;
-            current            = tok;
-            add_child(root, parse_classdef());
-        } else {
-            tokenizer.position = save;
-            current            = tok;
-            break;
-        }
+    while (peek(p, 0) == TOKEN_LPAREN && peek(p, 1) == TOKEN_CLASS) {
+        push_child(p, root, parse_classdef(p));
     }
 
     // at least one statement
-    if (!(current.kind == TOKEN_LPAREN ||
-          current.kind == TOKEN_VARDEC ||
-          current.kind == TOKEN_BREAK))
-        parse_error("Expected at least one statement");
-    add_child(root, parse_stmt_list());
+    if (!(peek(p, 0) == TOKEN_LPAREN ||
+          peek(p, 0) == TOKEN_VARDEC ||
+          peek(p, 0) == TOKEN_BREAK))
+        parse_error(p, "Expected at least one statement");
+    push_child(p, root, parse_stmt_list(p));
 
     // make sure we really are at EOF
-    if (current.kind != TOKEN_UNKNOWN)
-        parse_error("Extra tokens after program end");
+    if (peek(p, 0) != TOKEN_EOF)
+        parse_error(p, "Extra tokens after program end");
+
+    return close_node(p, root);
+}
+
+// Parses the token array from p->pos, after 'done_count' classdefs
+static ASTNode *parse_lexed(Parser *p, ASTNode **done, int done_count) {
+    // parse_error lands here
+    if (setjmp(p->bail) != 0) {
+        free_token_array(&p->tokens);
+        return NULL;
+    }
+    ASTNode *root = parse_forms(p, done, done_count);
+    free_token_array(&p->tokens);
+    return root;
+}
+
+ASTNode *parse_program(Parser *p) {
+    clear_diagnostic(&p->diag);
+    lex_all(&p->tokenizer, &p->tokens);
+    p->pos     = 0;
+    p->kid_top = 0;
+    return parse_lexed(p, NULL, 0);
+}
+
+// Parallel mode. A class form's tokens are balanced, and parse_classdef
+// depends on nothing but its own tokens, so once the depth-0 boundaries
+// are known each form can be parsed on its own. Workers share the token
+// array read-only and build into private arenas that are adopted into
+// p->arena afterwards.
+
+// Below this many class forms the pool costs more than it saves
+#define PARALLEL_MIN_FORMS 64
+
+// Token index of each leading depth-0 class form, plus one past the last.
+// Stops at the first form that is not a class, or that never closes;
+// the serial loop picks up from there and reports any error.
+static int scan_class_forms(const TokenArray *t, int **starts_out) {
+    int count = 0, cap = 64;
+    int *starts = xmalloc(cap * sizeof(int));
+    int i = 0;
+    while (t->kinds[i] == TOKEN_LPAREN && t->kinds[i + 1] == TOKEN_CLASS) {
+        int j = i, depth = 0;
+        do {
+            if (t->kinds[j] == TOKEN_LPAREN) depth++;
+            else if (t->kinds[j] == TOKEN_RPAREN) depth--;
+            else if (t->kinds[j] == TOKEN_EOF) break;
+            j++;
+        } while (depth > 0);
+        if (depth > 0) break;
+        if (count + 1 == cap) {
+            cap *= 2;
+            starts = xrealloc(starts, cap * sizeof(int));
+        }
+        starts[count++] = i;
+        i = j;
+    }
+    starts[count] = i;
+    *starts_out = starts;
+    return count;
+}
+
+// A run of consecutive class forms parsed by one task
+typedef struct {
+    const Parser *main;     // token array and names, read-only
+    const int    *starts;
+    ASTNode     **out;      // one node per form
+    int           first, last;
+    Arena         arena;
+    int           failed;   // form that hit a parse error, or -1
+    Diagnostic    diag;
+} FormRange;
+
+static void parse_forms_task(void *arg) {
+    FormRange *r = arg;
+    Parser w;
+    memset(&w, 0, sizeof w);
+    w.tokenizer = r->main->tokenizer;
+    w.tokens    = r->main->tokens;
+    w.arena     = &r->arena;
+    r->failed   = -1;
+    volatile int i = r->first;
+    if (setjmp(w.bail)) {
+        r->failed = i;
+        r->diag   = w.diag;
+    } else {
+        for (; i < r->last; i++) {
+            w.pos     = r->starts[i];
+            r->out[i] = parse_classdef(&w);
+        }
+    }
+    free(w.kid_stack);
+}
+
+ASTNode *parse_program_parallel(Parser *p, ThreadPool *pool) {
+    clear_diagnostic(&p->diag);
+    lex_all(&p->tokenizer, &p->tokens);
+    p->pos     = 0;
+    p->kid_top = 0;
+
+    int *starts;
+    int forms = scan_class_forms(&p->tokens, &starts);
+    ThreadPool *own = NULL;
+    if (forms >= PARALLEL_MIN_FORMS && !pool && default_thread_count() > 1)
+        pool = own = threadpool_create(0);
+    if (forms < PARALLEL_MIN_FORMS || !pool) {
+        free(starts);
+        return parse_lexed(p, NULL, 0);
+    }
 
+    // split by token count so every task gets a similar amount of input
+    int tasks = threadpool_size(pool) * 4;
+    if (tasks > forms) tasks = forms;
+    FormRange *ranges = xcalloc(tasks, sizeof *ranges);
+    ASTNode **nodes = xmalloc(forms * sizeof *nodes);
+    TaskGroup group;
+    atomic_init(&group.pending, 0);
+    int total = starts[forms] - starts[0];
+    int form = 0;
+    for (int t = 0; t < tasks; t++) {
+        FormRange *r = &ranges[t];
+        r->main   = p;
+        r->starts = starts;
+        r->out    = nodes;
+        r->first  = form;
+        long goal = starts[0] + (long)total * (t + 1) / tasks;
+        while (form < forms && (starts[form] < goal || form == r->first))
+            form++;
+        if (t == tasks - 1) form = forms;
+        r->last = form;
+        threadpool_submit(pool, &group, parse_forms_task, r);
+    }
+    threadpool_wait(pool, &group);
+    threadpool_destroy(own);
+
+    ASTNode *root = NULL;
+    int failed = -1;
+    for (int t = 0; t < tasks; t++) {
+        arena_adopt(p->arena, &ranges[t].arena);
+        if (failed < 0 && ranges[t].failed >= 0) {
+            failed  = t;
+            p->diag = ranges[t].diag;
+        }
+    }
+    // the first bad form in source order is what the serial parse reports
+    if (failed < 0) {
+        p->pos = starts[forms];
+        root = parse_lexed(p, nodes, forms);
+    } else {
+        free_token_array(&p->tokens);
+    }
+    free(nodes);
+    free(ranges);
+    free(starts);
     return root;
 }
 
 // classdef ::= ( class classname [superclass] (vardec*) constructor methoddef* )
-ASTNode *parse_classdef() {
+static ASTNode *parse_classdef(Parser *p) {
     //“( class”
-    expect(TOKEN_LPAREN, "Expected '(' for classdef");
-    expect(TOKEN_CLASS,  "Expected 'class'");
-    ASTNode *n = new_node("ClassDef");
+    expect(p, TOKEN_LPAREN, "Expected '(' for classdef");
+    expect(p, TOKEN_CLASS,  "Expected 'class'");
+    ASTNode *n = new_node(p->arena, NODE_CLASSDEF, "ClassDef");
 
     //classname
-    if (current.kind != TOKEN_IDENTIFIER)
-        parse_error("Expected class name");
-    add_child(n, new_node(current.value));
-    next_token_safe();
+    if (peek(p, 0) != TOKEN_IDENTIFIER)
+        parse_error(p, "Expected class name");
+    push_child(p, n, token_node(p, NODE_IDENT));
+    advance(p);
 
     //optional superclass
-    if (current.kind == TOKEN_IDENTIFIER) {
-        add_child(n, new_node(current.value));
-        next_token_safe();
+    if (peek(p, 0) == TOKEN_IDENTIFIER) {
+        push_child(p, n, token_node(p, NODE_IDENT));
+        advance(p);
     }
 
     //parse ONE group of fields: an outer “( … )” wrapping multiple vardecs
-    expect(TOKEN_LPAREN, "Expected '(' before field declarations");
+    expect(p, TOKEN_LPAREN, "Expected '(' before field declarations");
     //inside, each field begins with its own LPAREN
-    while (current.kind == TOKEN_LPAREN) {
-        add_child(n, parse_vardec_stmt());
+    while (peek(p, 0) == TOKEN_LPAREN) {
+        push_child(p, n, parse_vardec_stmt(p));
     }
-    expect(TOKEN_RPAREN, "Expected ')' after field declarations");
+    expect(p, TOKEN_RPAREN, "Expected ')' after field declarations");
 
     //exactly one constructor
-    add_child(n, parse_constructor());
+    push_child(p, n, parse_constructor(p));
 
     //zero or more methods
-    while (current.kind == TOKEN_LPAREN) {
-        int save_pos = tokenizer.position;
-        Token save_tok = current;
-        next_token_safe();
-        if (current.kind == TOKEN_METHOD) {
-            tokenizer.position = save_pos;
-            current = save_tok;
-            add_child(n, parse_methoddef());
-        } else {
-            tokenizer.position = save_pos;
-            current = save_tok;
-            break;
-        }
+    while (peek(p, 0) == TOKEN_LPAREN && peek(p, 1) == TOKEN_METHOD) {
+        push_child(p, n, parse_methoddef(p));
     }
 
     //closing “)” of the class
-    expect(TOKEN_RPAREN, "Expected ')' after classdef");
-    return n;
+    expect(p, TOKEN_RPAREN, "Expected ')' after classdef");
+    return close_node(p, n);
 }
 
 
 // constructor ::= ( init (vardec*) [ (super exp*) ] stmt* )
-ASTNode *parse_constructor() {
-    expect(TOKEN_LPAREN, "Expected '(' for init");
-    expect(TOKEN_INIT,   "Expected 'init'");
-    ASTNode *n = new_node("Constructor");
-
-    expect(TOKEN_LPAREN, "Expected '(' before init params");
-    while (current.kind == TOKEN_VARDEC) {
-        add_child(n, parse_vardec_stmt());
+static ASTNode *parse_constructor(Parser *p) {
+    expect(p, TOKEN_LPAREN, "Expected '(' for init");
+    expect(p, TOKEN_INIT,   "Expected 'init'");
+    ASTNode *n = new_node(p->arena, NODE_CONSTRUCTOR, "Constructor");
+
+    expect(p, TOKEN_LPAREN, "Expected '(' before init params");
+    while (peek(p, 0) == TOKEN_LPAREN && peek(p, 1) == TOKEN_VARDEC) {
+        push_child(p, n, parse_vardec_stmt(p));
+        n->param_count++;
     }
-    expect(TOKEN_RPAREN, "Expected ')' after init params");
+    expect(p, TOKEN_RPAREN, "Expected ')' after init params");
 
     // optional super call
-    if (current.kind == TOKEN_LPAREN) {
-        int save_pos = tokenizer.position;
-        Token save_tok = current;
-        next_token_safe();
-        if (current.kind == TOKEN_SUPER) {
-            ASTNode *sup = new_node("SuperCall");
-            next_token_safe();
-            while (current.kind == TOKEN_LPAREN ||
-                   current.kind == TOKEN_IDENTIFIER ||
-                   current.kind == TOKEN_INT_LITERAL) {
-                add_child(sup, parse_exp());
-            }
-            expect(TOKEN_RPAREN, "Expected ')' after super");
-            add_child(n, sup);
-        } else {
-            tokenizer.position = save_pos;
-            current = save_tok;
+    if (peek(p, 0) == TOKEN_LPAREN && peek(p, 1) == TOKEN_SUPER) {
+        ASTNode *sup = new_node(p->arena, NODE_SUPERCALL, "SuperCall");
+        advance(p);
+        advance(p);
+        while (peek(p, 0) == TOKEN_LPAREN ||
+               peek(p, 0) == TOKEN_IDENTIFIER ||
+               peek(p, 0) == TOKEN_INT_LITERAL) {
+            push_child(p, sup, parse_exp(p));
         }
+        expect(p, TOKEN_RPAREN, "Expected ')' after super");
+        push_child(p, n, close_node(p, sup));
     }
 
     // body stmts
-    while (current.kind == TOKEN_LPAREN ||
-           current.kind == TOKEN_VARDEC ||
-           current.kind == TOKEN_BREAK) {
-        add_child(n, parse_stmt());
+    while (peek(p, 0) == TOKEN_LPAREN ||
+           peek(p, 0) == TOKEN_VARDEC ||
+           peek(p, 0) == TOKEN_BREAK) {
+        push_child(p, n, parse_stmt(p));
     }
-    expect(TOKEN_RPAREN, "Expected ')' after constructor");
-    return n;
+    expect(p, TOKEN_RPAREN, "Expected ')' after constructor");
+    return close_node(p, n);
 }
 
 // methoddef ::= ( method methodname (vardec*) type stmt* )
-ASTNode *parse_methoddef() {
-    expect(TOKEN_LPAREN, "Expected '(' for method");
-    expect(TOKEN_METHOD,"Expected 'method'");
-    if (current.kind != TOKEN_IDENTIFIER) parse_error("Expected method name");
-    ASTNode *n = new_node(current.value);
-    next_token_safe();
-
-    expect(TOKEN_LPAREN, "Expected '(' before method params");
-    while (current.kind == TOKEN_VARDEC) {
-        add_child(n, parse_vardec_stmt());
+static ASTNode *parse_methoddef(Parser *p) {
+    expect(p, TOKEN_LPAREN, "Expected '(' for method");
+    expect(p, TOKEN_METHOD,"Expected 'method'");
+    if (peek(p, 0) != TOKEN_IDENTIFIER) parse_error(p, "Expected method name");
+    ASTNode *n = token_node(p, NODE_METHOD);
+    advance(p);
+
+    expect(p, TOKEN_LPAREN, "Expected '(' before method params");
+    while (peek(p, 0) == TOKEN_LPAREN && peek(p, 1) == TOKEN_VARDEC) {
+        push_child(p, n, parse_vardec_stmt(p));
+        n->param_count++;
     }
-    expect(TOKEN_RPAREN, "Expected ')' after method params");
+    expect(p, TOKEN_RPAREN, "Expected ')' after method params");
 
-    add_child(n, parse_type());
+    push_child(p, n, parse_type(p));
 
-    while (current.kind == TOKEN_LPAREN ||
-           current.kind == TOKEN_VARDEC ||
-           current.kind == TOKEN_BREAK) {
-        add_child(n, parse_stmt());
+    while (peek(p, 0) == TOKEN_LPAREN ||
+           peek(p, 0) == TOKEN_VARDEC ||
+           peek(p, 0) == TOKEN_BREAK) {
+        push_child(p, n, parse_stmt(p));
     }
-    expect(TOKEN_RPAREN, "Expected ')' after method");
-    return n;
+    expect(p, TOKEN_RPAREN, "Expected ')' after method");
+    return close_node(p, n);
 }
 
 // vardec ::= ( vardec type var )
-ASTNode *parse_vardec_stmt() {
-    expect(TOKEN_LPAREN, "Expected '(' for vardec");
-    expect(TOKEN_VARDEC, "Expected 'vardec'");
-    ASTNode *n = new_node("VarDec");
-    add_child(n, parse_type());
-    if (current.kind != TOKEN_IDENTIFIER) parse_error("Expected var name");
-    add_child(n, new_node(current.value));
-    next_token_safe();
-    expect(TOKEN_RPAREN, "Expected ')' after vardec");
-    return n;
+static ASTNode *parse_vardec_stmt(Parser *p) {
+    expect(p, TOKEN_LPAREN, "Expected '(' for vardec");
+    expect(p, TOKEN_VARDEC, "Expected 'vardec'");
+    ASTNode *n = new_node(p->arena, NODE_VARDEC, "VarDec");
+    push_child(p, n, parse_type(p));
+    if (peek(p, 0) != TOKEN_IDENTIFIER) parse_error(p, "Expected var name");
+    push_child(p, n, token_node(p, NODE_IDENT));
+    advance(p);
+    expect(p, TOKEN_RPAREN, "Expected ')' after vardec");
+    return close_node(p, n);
 }
 
 // stmt_list ::= stmt+
-ASTNode *parse_stmt_list() {
-    ASTNode *n = new_node("StmtList");
+static ASTNode *parse_stmt_list(Parser *p) {
+    ASTNode *n = new_node(p->arena, NODE_STMTLIST, "StmtList");
     do {
-        add_child(n, parse_stmt());
-    } while (current.kind == TOKEN_LPAREN ||
-             current.kind == TOKEN_VARDEC ||
-             current.kind == TOKEN_BREAK);
-    return n;
+        push_child(p, n, parse_stmt(p));
+    } while (peek(p, 0) == TOKEN_LPAREN ||
+             peek(p, 0) == TOKEN_VARDEC ||
+             peek(p, 0) == TOKEN_BREAK);
+    return close_node(p, n);
 }
 
 // stmt ::= (vardec Type var) | break
 //        | (= var exp) | (while …) | (if …) | (return …)
 //        | (call …) | (println …)
-ASTNode *parse_stmt() {
-    // QUICK LOOKAHEAD FOR A VARDENC STATEMENT
-    if (current.kind == TOKEN_LPAREN) {
-        int save_pos = tokenizer.position;
-        Token save_tok = current;
-        next_token_safe();               // consume '('
-        if (current.kind == TOKEN_VARDEC) {
-            // rollback, then parse it properly
-            tokenizer.position = save_pos;
-            current = save_tok;
-            return parse_vardec_stmt();
-        }
-        // not a vardec; rewind for the normal LPAREN logic
-        tokenizer.position = save_pos;
-        current = save_tok;
+static ASTNode *parse_stmt(Parser *p) {
+    // QUICK LOOKAHEAD FOR A VARDEC STATEMENT
+    if (peek(p, 0) == TOKEN_LPAREN && peek(p, 1) == TOKEN_VARDEC) {
+        return parse_vardec_stmt(p);
     }
 
     // plain break
-    if (current.kind == TOKEN_BREAK) {
-        ASTNode *n = new_node("Break");
-        next_token_safe();
+    if (peek(p, 0) == TOKEN_BREAK) {
+        ASTNode *n = new_node(p->arena, NODE_BREAK, "Break");
+        advance(p);
         return n;
     }
 
     // everything else must start with '('
-    if (current.kind != TOKEN_LPAREN) {
-        parse_error("Unrecognized statement");
+    if (peek(p, 0) != TOKEN_LPAREN) {
+        parse_error(p, "Unrecognized statement");
     }
 
     // enter parenthesized statement
-    expect(TOKEN_LPAREN, "Expected '(' for statement");
-    TokenKind k = current.kind;
+    expect(p, TOKEN_LPAREN, "Expected '(' for statement");
+    TokenKind k = peek(p, 0);
     ASTNode *n = NULL;
 
     if (k == TOKEN_SINGLE_EQUALS) {
-        next_token_safe();
-        n = new_node("Assign");
-        if (current.kind != TOKEN_IDENTIFIER)
-            parse_error("Expected variable name after '='");
-        add_child(n, new_node(current.value));
-        next_token_safe();
-        add_child(n, parse_exp());
+        advance(p);
+        n = new_node(p->arena, NODE_ASSIGN, "Assign");
+        if (peek(p, 0) != TOKEN_IDENTIFIER)
+            parse_error(p, "Expected variable name after '='");
+        push_child(p, n, token_node(p, NODE_IDENT));
+        advance(p);
+        push_child(p, n, parse_exp(p));
 
     } else if (k == TOKEN_WHILE) {
-        next_token_safe();
-        n = new_node("While");
-        add_child(n, parse_exp());
+        advance(p);
+        n = new_node(p->arena, NODE_WHILE, "While");
+        push_child(p, n, parse_exp(p));
         // loop body
-        while (current.kind == TOKEN_LPAREN ||
-               current.kind == TOKEN_BREAK) {
-            add_child(n, parse_stmt());
+        while (peek(p, 0) == TOKEN_LPAREN ||
+               peek(p, 0) == TOKEN_BREAK) {
+            push_child(p, n, parse_stmt(p));
         }
 
     } else if (k == TOKEN_IF) {
-        next_token_safe();
-        n = new_node("If");
-        add_child(n, parse_exp());
-        add_child(n, parse_stmt());
+        advance(p);
+        n = new_node(p->arena, NODE_IF, "If");
+        push_child(p, n, parse_exp(p));
+        push_child(p, n, parse_stmt(p));
         // optional else
-        if (current.kind == TOKEN_LPAREN ||
-            current.kind == TOKEN_BREAK) {
-            add_child(n, parse_stmt());
+        if (peek(p, 0) == TOKEN_LPAREN ||
+            peek(p, 0) == TOKEN_BREAK) {
+            push_child(p, n, parse_stmt(p));
         }
 
     } else if (k == TOKEN_RETURN) {
-        next_token_safe();
-        n = new_node("Return");
-        if (current.kind != TOKEN_RPAREN) {
-            add_child(n, parse_exp());
+        advance(p);
+        n = new_node(p->arena, NODE_RETURN, "Return");
+        if (peek(p, 0) != TOKEN_RPAREN) {
+            push_child(p, n, parse_exp(p));
         }
 
     } else if (k == TOKEN_CALL) {
-        next_token_safe();
-        n = new_node("Call");
-        add_child(n, parse_exp());  // receiver
-        if (current.kind != TOKEN_IDENTIFIER)
-            parse_error("Expected method name in call");
-        add_child(n, new_node(current.value));
-        next_token_safe();
-        while (current.kind != TOKEN_RPAREN) {
-            add_child(n, parse_exp());
+        advance(p);
+        n = new_node(p->arena, NODE_CALL, "Call");
+        push_child(p, n, parse_exp(p));  // receiver
+        if (peek(p, 0) != TOKEN_IDENTIFIER)
+            parse_error(p, "Expected method name in call");
+        push_child(p, n, token_node(p, NODE_IDENT));
+        advance(p);
+        while (peek(p, 0) != TOKEN_RPAREN) {
+            push_child(p, n, parse_exp(p));
         }
 
     } else if (k == TOKEN_PRINT) {
-        next_token_safe();
-        n = new_node("Println");
-        add_child(n, parse_exp());
+        advance(p);
+        n = new_node(p->arena, NODE_PRINTLN, "Println");
+        push_child(p, n, parse_exp(p));
 
     } else {
-        parse_error("Unknown statement form");
+        parse_error(p, "Unknown statement form");
     }
 
-    expect(TOKEN_RPAREN, "Expected ')' after statement");
-    return n;
+    expect(p, TOKEN_RPAREN, "Expected ')' after statement");
+    return close_node(p, n);
 }
 
 
 // exp ::= var | this | true | false | int | (println exp) | (op exp exp) | (call exp method exp*) | (new classname exp*)
-ASTNode *parse_exp() {
-    if (current.kind == TOKEN_IDENTIFIER) {
-        ASTNode *n = new_node(current.value);
-        next_token_safe();
+static ASTNode *parse_exp(Parser *p) {
+    if (peek(p, 0) == TOKEN_IDENTIFIER) {
+        ASTNode *n = token_node(p, NODE_IDENT);
+        advance(p);
         return n;
-    } else if (current.kind == TOKEN_THIS) {
-        ASTNode *n = new_node("this");
-        next_token_safe();
+    } else if (peek(p, 0) == TOKEN_THIS) {
+        ASTNode *n = new_node(p->arena, NODE_THIS, "this");
+        advance(p);
         return n;
-    } else if (current.kind == TOKEN_TRUE) {
-        ASTNode *n = new_node("true");
-        next_token_safe();
+    } else if (peek(p, 0) == TOKEN_TRUE) {
+        ASTNode *n = new_node(p->arena, NODE_TRUE, "true");
+        advance(p);
         return n;
-    } else if (current.kind == TOKEN_FALSE) {
-        ASTNode *n = new_node("false");
-        next_token_safe();
+    } else if (peek(p, 0) == TOKEN_FALSE) {
+        ASTNode *n = new_node(p->arena, NODE_FALSE, "false");
+        advance(p);
         return n;
-    } else if (current.kind == TOKEN_INT_LITERAL) {
-        ASTNode *n = new_node(current.value);
-        next_token_safe();
+    } else if (peek(p, 0) == TOKEN_INT_LITERAL) {
+        ASTNode *n = token_node(p, NODE_INT_LIT);
+        advance(p);
         return n;
-    } else if (current.kind == TOKEN_LPAREN) {
-        expect(TOKEN_LPAREN, "Expected '(' for expression");
-        TokenKind k = current.kind;
+    } else if (peek(p, 0) == TOKEN_LPAREN) {
+        expect(p, TOKEN_LPAREN, "Expected '(' for expression");
+        TokenKind k = peek(p, 0);
         ASTNode *n = NULL;
         if (k == TOKEN_PRINT) {
-            next_token_safe();
-            n = new_node("Println");
-            add_child(n, parse_exp());
+            advance(p);
+            n = new_node(p->arena, NODE_PRINTLN, "Println");
+            push_child(p, n, parse_exp(p));
         } else if (k == TOKEN_PLUS || k == TOKEN_MINUS ||
                    k == TOKEN_MULT || k == TOKEN_DIV ||
                    k == TOKEN_LESSTHAN || k == TOKEN_EQUALS) {
-            char lbl[3] = {0};
+            NodeKind op = NODE_ADD;
+            const char *lbl = "+";
             switch (k) {
-                case TOKEN_PLUS:     lbl[0] = '+'; break;
-                case TOKEN_MINUS:    lbl[0] = '-'; break;
-                case TOKEN_MULT:     lbl[0] = '*'; break;
-                case TOKEN_DIV:      lbl[0] = '/'; break;
-                case TOKEN_LESSTHAN: lbl[0] = '<'; break;
-                case TOKEN_EQUALS:   lbl[0] = '='; lbl[1] = '='; break;
+                case TOKEN_PLUS:     op = NODE_ADD;   lbl = "+";  break;
+                case TOKEN_MINUS:    op = NODE_SUB;   lbl = "-";  break;
+                case TOKEN_MULT:     op = NODE_MUL;   lbl = "*";  break;
+                case TOKEN_DIV:      op = NODE_DIV;   lbl = "/";  break;
+                case TOKEN_LESSTHAN: op = NODE_LESS;  lbl = "<";  break;
+                case TOKEN_EQUALS:   op = NODE_EQUAL; lbl = "=="; break;
                 default: break;
             }
-            next_token_safe();
-            n = new_node(lbl);
-            add_child(n, parse_exp());
-            add_child(n, parse_exp());
+            advance(p);
+            n = new_node(p->arena, op, lbl);
+            push_child(p, n, parse_exp(p));
+            push_child(p, n, parse_exp(p));
         } else if (k == TOKEN_CALL) {
-            next_token_safe();
-            n = new_node("Call");
-            add_child(n, parse_exp());
-            if (current.kind != TOKEN_IDENTIFIER) parse_error("Expected method name in call expr");
-            add_child(n, new_node(current.value));
-            next_token_safe();
-            while (current.kind != TOKEN_RPAREN) {
-                add_child(n, parse_exp());
+            advance(p);
+            n = new_node(p->arena, NODE_CALL, "Call");
+            push_child(p, n, parse_exp(p));
+            if (peek(p, 0) != TOKEN_IDENTIFIER) parse_error(p, "Expected method name in call expr");
+            push_child(p, n, token_node(p, NODE_IDENT));
+            advance(p);
+            while (peek(p, 0) != TOKEN_RPAREN) {
+                push_child(p, n, parse_exp(p));
             }
         } else if (k == TOKEN_NEW) {
-            next_token_safe();
-            if (current.kind != TOKEN_IDENTIFIER) parse_error("Expected class name in new expr");
-            n = new_node("New");
-            add_child(n, new_node(current.value));
-            next_token_safe();
-            while (current.kind != TOKEN_RPAREN) {
-                add_child(n, parse_exp());
+            advance(p);
+            if (peek(p, 0) != TOKEN_IDENTIFIER) parse_error(p, "Expected class name in new expr");
+            n = new_node(p->arena, NODE_NEW, "New");
+            push_child(p, n, token_node(p, NODE_IDENT));
+            advance(p);
+            while (peek(p, 0) != TOKEN_RPAREN) {
+                push_child(p, n, parse_exp(p));
             }
         } else {
-            parse_error("Unknown expression form");
+            parse_error(p, "Unknown expression form");
         }
-        expect(TOKEN_RPAREN, "Expected ')' after expression");
-        return n;
+        expect(p, TOKEN_RPAREN, "Expected ')' after expression");
+        return close_node(p, n);
     } else {
-        parse_error("Unrecognized expression");
+        parse_error(p, "Unrecognized expression");
     }
     return NULL;
 }
 
 // type ::= Int | Boolean | Void | classname
-ASTNode *parse_type() {
+static ASTNode *parse_type(Parser *p) {
     ASTNode *n = NULL;
-    if (current.kind == TOKEN_INT) {
-        n = new_node("Int");
-    } else if (current.kind == TOKEN_BOOL) {
-        n = new_node("Boolean");
-    } else if (current.kind == TOKEN_VOID) {
-        n = new_node("Void");
-    } else if (current.kind == TOKEN_IDENTIFIER) {
-        n = new_node(current.value);
+    if (peek(p, 0) == TOKEN_INT) {
+        n = new_node(p->arena, NODE_TYPE, "Int");
+        n->type.kind = TYPE_INT;
+    } else if (peek(p, 0) == TOKEN_BOOL) {
+        n = new_node(p->arena, NODE_TYPE, "Boolean");
+        n->type.kind = TYPE_BOOLEAN;
+    } else if (peek(p, 0) == TOKEN_VOID) {
+        n = new_node(p->arena, NODE_TYPE, "Void");
+        n->type.kind = TYPE_VOID;
+    } else if (peek(p, 0) == TOKEN_IDENTIFIER) {
+        n = token_node(p, NODE_TYPE);
+        n->type.kind = TYPE_CLASS;
+        n->type.cls  = n->sym;
     } else {
-        parse_error("Expected type");
+        parse_error(p, "Expected type");
     }
-    next_token_safe();
+    advance(p);
     return n;
 }
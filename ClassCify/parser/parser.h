@@ -2,29 +2,97 @@
 #define PARSER_H
 
 #include "../tokenizer/tokenizer.h"
+#include "../common/arena.h"
+#include "../common/diagnostic.h"
+#include "../common/threadpool.h"
+#include <setjmp.h>
+
+// AST node kinds
+typedef enum {
+    NODE_PROGRAM,
+    NODE_CLASSDEF,
+    NODE_CONSTRUCTOR,
+    NODE_SUPERCALL,
+    NODE_METHOD,       // sym holds the method name
+    NODE_VARDEC,
+    NODE_STMTLIST,
+    NODE_ASSIGN,
+    NODE_WHILE,
+    NODE_IF,
+    NODE_RETURN,
+    NODE_BREAK,
+    NODE_PRINTLN,
+    NODE_CALL,
+    NODE_NEW,
+    NODE_ADD,
+    NODE_SUB,
+    NODE_MUL,
+    NODE_DIV,
+    NODE_LESS,
+    NODE_EQUAL,
+    NODE_INT_LIT,      // int_value holds the decoded literal
+    NODE_TRUE,
+    NODE_FALSE,
+    NODE_THIS,
+    NODE_IDENT,        // variable, class or method name; sym holds it
+    NODE_TYPE,         // Int | Boolean | Void | classname; type holds it
+    NODE_INLINED       // a call inline_calls expanded; never parsed
+} NodeKind;
+
+// Static types
+typedef enum { TYPE_NONE, TYPE_INT, TYPE_BOOLEAN, TYPE_VOID, TYPE_CLASS } TypeKind;
+typedef struct {
+    TypeKind kind;
+    Symbol   cls;             // class name for TYPE_CLASS, NO_SYMBOL otherwise
+} Type;
 
 // AST node
 typedef struct ASTNode {
-    char *label;               // e.g. "ClassDef", "If", "Identifier:foo"
+    NodeKind kind;
+    const char *label;         // printable form, e.g. "ClassDef", "If", "foo", "+"
     struct ASTNode **kids;     // child nodes
     int kid_count;
+    Symbol sym;                // identifier payload (NODE_IDENT, NODE_METHOD, class NODE_TYPE)
+    int int_value;             // literal payload (NODE_INT_LIT)
+    int param_count;           // leading VarDec kids that are parameters (NODE_CONSTRUCTOR, NODE_METHOD)
+    Type type;                 // declared type of NODE_TYPE, inferred type of expressions
+    int depth, slot;           // resolved variable (NODE_IDENT, NODE_THIS): scope depth and frame slot, -1 if none
+    int frame_size;            // frame slots used by a NODE_METHOD, NODE_CONSTRUCTOR or NODE_PROGRAM body
+    int target;                // NODE_CALL bound to one method entry by devirtualize, -1 if virtual; NODE_INLINED: the method
+    int alloc;                 // NODE_NEW: ALLOC_HEAP, or the frame object analyze_escapes built it in (0, 1, ...)
 } ASTNode;
 
+#define ALLOC_HEAP (-1)
+
 // AST construction & traversal helpers
-ASTNode *new_node(const char *label);
-void     add_child(ASTNode *parent, ASTNode *child);
-void     free_ast(ASTNode *node);
+// Nodes live in an arena; arena_free releases all of them at once
+ASTNode *new_node(Arena *arena, NodeKind kind, const char *label);
+void     add_child(Arena *arena, ASTNode *parent, ASTNode *child);
 void     print_ast(ASTNode *node, int indent);
 
-// Parsing entry points (each returns an AST subtree)
-ASTNode *parse_program();
-ASTNode *parse_classdef();
-ASTNode *parse_constructor();
-ASTNode *parse_methoddef();
-ASTNode *parse_stmt_list();
-ASTNode *parse_stmt();
-ASTNode *parse_vardec_stmt();
-ASTNode *parse_exp();
-ASTNode *parse_type();
+// Parser state. Nothing is shared between parsers, so each thread can
+// run its own.
+typedef struct {
+    Tokenizer  tokenizer;
+    TokenArray tokens;        // the whole input, lexed up front
+    int        pos;           // cursor into tokens
+    Arena     *arena;         // receives the AST
+    ASTNode  **kid_stack;     // children of nodes still being parsed
+    int        kid_top, kid_cap;
+    Diagnostic diag;          // why parse_program returned NULL
+    jmp_buf    bail;          // where a parse error unwinds to
+} Parser;
+
+// 'input' must be NUL-terminated; identifiers are interned in 'names'
+void init_parser(Parser *p, const char *input, InternTable *names, Arena *arena);
+void free_parser(Parser *p);
+
+// Parsing entry point. Returns NULL on a syntax error and describes it
+// in p->diag; nodes built before the error stay in the arena.
+ASTNode *parse_program(Parser *p);
+// Same result, but the leading class forms are found with a paren-depth
+// scan and parsed on 'pool'. Without a pool, a temporary one is used when
+// the machine has more than one CPU. Small programs are parsed serially.
+ASTNode *parse_program_parallel(Parser *p, ThreadPool *pool);
 
 #endif // PARSER_H
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "tokenizer.h"
+
+// Microbenchmark for keyword recognition: the old linear table scan
+// against match_keyword, over an identifier-heavy word mix.
+//
+//   gcc -O2 bench_keywords.c tokenizer.c charclass.c intern.c ../common/xalloc.c -o bench_keywords
+//   ./bench_keywords [rounds]
+
+typedef struct
+{
+    const char *keyword;
+    TokenKind kind;
+} KeywordMap;
+
+// The table and scan match_keyword replaced, kept here as the baseline
+static KeywordMap reserved_keywords[] = {
+    {"Int", TOKEN_INT}, {"Boolean", TOKEN_BOOL}, {"Void", TOKEN_VOID}, {"this", TOKEN_THIS}, {"true", TOKEN_TRUE}, {"false", TOKEN_FALSE}, {"new", TOKEN_NEW}, {"vardec", TOKEN_VARDEC}, {"while", TOKEN_WHILE}, {"break", TOKEN_BREAK}, {"println", TOKEN_PRINT}, {"if", TOKEN_IF}, {"return", TOKEN_RETURN}, {"init", TOKEN_INIT}, {"super", TOKEN_SUPER}, {"class", TOKEN_CLASS}, {"method", TOKEN_METHOD}, {"call", TOKEN_CALL}, {NULL, TOKEN_UNKNOWN}};
+
+static TokenKind linear_match_keyword(const char *start, int length)
+{
+    for (int i = 0; reserved_keywords[i].keyword != NULL; i++)
+    {
+        if (strncmp(start, reserved_keywords[i].keyword, length) == 0 &&
+            strlen(reserved_keywords[i].keyword) == (size_t)length)
+        {
+            return reserved_keywords[i].kind;
+        }
+    }
+    return TOKEN_IDENTIFIER;
+}
+
+// Roughly what generated programs look like: mostly user names, some
+// of them sharing a length and first letter with a keyword
+static const char *words[] = {
+    "x", "count", "this", "speak", "Animal", "call", "cat", "dog", "new",
+    "total", "vardec", "Int", "index", "init", "value", "method", "result",
+    "Boolean", "printer", "if", "i", "return", "retval", "while", "width",
+    "super", "supper", "class", "clazz", "getAge", "true", "tree", "false",
+    "break", "bark", "println", "Void", "Vect", "sum", "acc", "n", "next"};
+
+typedef TokenKind (*MatchFn)(const char *, int);
+
+static double run(MatchFn match, const int *lengths, int nwords, long rounds, long *checksum)
+{
+    struct timespec t0, t1;
+    long sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < nwords; i++)
+            sum += match(words[i], lengths[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    *checksum = sum;
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    long rounds = argc > 1 ? atol(argv[1]) : 2000000;
+    int nwords = sizeof(words) / sizeof(words[0]);
+    int lengths[sizeof(words) / sizeof(words[0])];
+
+    for (int i = 0; i < nwords; i++)
+    {
+        lengths[i] = strlen(words[i]);
+        if (linear_match_keyword(words[i], lengths[i]) != match_keyword(words[i], lengths[i]))
+        {
+            fprintf(stderr, "mismatch on '%s'\n", words[i]);
+            return 1;
+        }
+    }
+
+    long check_linear, check_switch;
+    double linear = run(linear_match_keyword, lengths, nwords, rounds, &check_linear);
+    double fast = run(match_keyword, lengths, nwords, rounds, &check_switch);
+    double total = (double)rounds * nwords;
+
+    printf("identifiers:  %.0f\n", total);
+    printf("linear scan:  %8.1f M ident/s (checksum %ld)\n", total / linear / 1e6, check_linear);
+    printf("switch:       %8.1f M ident/s (checksum %ld)\n", total / fast / 1e6, check_switch);
+    printf("speedup:      %.2fx\n", linear / fast);
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "tokenizer.h"
+#include "../common/xalloc.h"
+
+// Compares the one-pass lexer (lex_all) with the two-stage one
+// (build_structural_index + lex_indexed) on a large generated program,
+// checks that both produce the same tokens, and times paren matching
+// on the index.
+//
+//   gcc -O2 bench_structural.c tokenizer.c structural.c charclass.c intern.c ../common/xalloc.c -o bench_structural
+//   ./bench_structural [MiB]
+
+static const char *snippet =
+    "(class Counter Base ((vardec Int count) (vardec Boolean done))\n"
+    "  (init ((vardec Int start)) (super) (= count start))\n"
+    "  (method step ((vardec Int by)) Int\n"
+    "    (while (< count 1000) (= count (+ count by)) (if (== count 512) break))\n"
+    "    (return (call this total count 42))))\n";
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int same_tokens(const TokenArray *a, const TokenArray *b)
+{
+    if (a->count != b->count)
+        return 0;
+    for (int i = 0; i < a->count; i++)
+    {
+        if (a->kinds[i] != b->kinds[i] || a->offsets[i] != b->offsets[i] ||
+            a->lengths[i] != b->lengths[i] || a->values[i] != b->values[i])
+            return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = (size_t)(argc > 1 ? atoi(argv[1]) : 64) << 20;
+    size_t piece = strlen(snippet);
+    char *input = xmalloc(size + 1);
+    size_t used = 0;
+    while (used + piece <= size)
+    {
+        memcpy(input + used, snippet, piece);
+        used += piece;
+    }
+    input[used] = '\0';
+    double mib = used / (1024.0 * 1024.0);
+
+    InternTable *names = create_intern_table();
+    Tokenizer tokenizer;
+    TokenArray direct, indexed;
+    StructuralIndex index;
+
+    init_tokenizer(&tokenizer, input, names);
+    double t0 = now();
+    lex_all(&tokenizer, &direct);
+    double t1 = now();
+
+    init_tokenizer(&tokenizer, input, names);
+    double t2 = now();
+    build_structural_index(input, &index);
+    double t3 = now();
+    lex_indexed(&tokenizer, &index, &indexed);
+    double t4 = now();
+
+    int *partner = xmalloc((index.paren_count + 1) * sizeof(int));
+    double t5 = now();
+    int unmatched = match_parens(input, &index, partner);
+    double t6 = now();
+
+    if (!same_tokens(&direct, &indexed))
+    {
+        fprintf(stderr, "token streams differ\n");
+        return 1;
+    }
+    printf("input:            %.1f MiB, %d tokens, classifier %s\n", mib, direct.count,
+           structural_isa());
+    printf("lex_all:          %8.1f MiB/s\n", mib / (t1 - t0));
+    printf("stage 1 (index):  %8.1f MiB/s\n", mib / (t3 - t2));
+    printf("stage 2 (decode): %8.1f MiB/s\n", mib / (t4 - t3));
+    printf("indexed total:    %8.1f MiB/s\n", mib / (t4 - t2));
+    printf("paren matching:   %8.1f MiB/s (%d parens, %d unmatched)\n", mib / (t6 - t5),
+           index.paren_count, unmatched);
+
+    free(partner);
+    free_structural_index(&index);
+    free_token_array(&direct);
+    free_token_array(&indexed);
+    free_intern_table(names);
+    free(input);
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "charclass.h"
+#include <stdint.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CHAR_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+const unsigned char char_class[256] = {
+    ['\t'] = CC_SPACE, ['\n'] = CC_SPACE, ['\v'] = CC_SPACE,
+    ['\f'] = CC_SPACE, ['\r'] = CC_SPACE, [' '] = CC_SPACE,
+    ['0' ... '9'] = CC_DIGIT,
+    ['A' ... 'Z'] = CC_ALPHA,
+    ['a' ... 'z'] = CC_ALPHA,
+};
+
+// Scalar kernels, used when no vector unit is available
+static const char *scalar_skip(const char *p, unsigned char cls)
+{
+    while (char_class[(unsigned char)*p] & cls)
+        p++;
+    return p;
+}
+static const char *scalar_skip_space(const char *p) { return scalar_skip(p, CC_SPACE); }
+static const char *scalar_skip_alnum(const char *p) { return scalar_skip(p, CC_ALNUM); }
+static const char *scalar_skip_digit(const char *p) { return scalar_skip(p, CC_DIGIT); }
+
+#ifdef CHAR_SCAN_X86
+
+// Each classifier returns 0xFF in every byte lane that is in the class.
+// Range tests use "min(x - lo, hi - lo) == x - lo" as an unsigned compare.
+static inline __m128i sse2_space(__m128i x)
+{
+    __m128i ctl = _mm_sub_epi8(x, _mm_set1_epi8('\t'));
+    ctl = _mm_cmpeq_epi8(_mm_min_epu8(ctl, _mm_set1_epi8('\r' - '\t')), ctl);
+    return _mm_or_si128(ctl, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+}
+static inline __m128i sse2_digit(__m128i x)
+{
+    __m128i d = _mm_sub_epi8(x, _mm_set1_epi8('0'));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+}
+static inline __m128i sse2_alnum(__m128i x)
+{
+    __m128i a = _mm_sub_epi8(_mm_or_si128(x, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    a = _mm_cmpeq_epi8(_mm_min_epu8(a, _mm_set1_epi8(25)), a);
+    return _mm_or_si128(a, sse2_digit(x));
+}
+
+// Scan from the 16-byte block holding p, masking off the lanes before p
+#define SSE2_SKIP(name, classify)                                                \
+    static const char *name(const char *p)                                       \
+    {                                                                            \
+        const char *block = (const char *)((uintptr_t)p & ~(uintptr_t)15);       \
+        unsigned in = _mm_movemask_epi8(classify(_mm_load_si128((const __m128i *)block))); \
+        unsigned stop = ~in & (0xFFFFu << (p - block));                          \
+        while (!stop)                                                            \
+        {                                                                        \
+            block += 16;                                                         \
+            in = _mm_movemask_epi8(classify(_mm_load_si128((const __m128i *)block))); \
+            stop = ~in & 0xFFFFu;                                                \
+        }                                                                        \
+        return block + __builtin_ctz(stop);                                      \
+    }
+
+SSE2_SKIP(sse2_skip_space, sse2_space)
+SSE2_SKIP(sse2_skip_alnum, sse2_alnum)
+SSE2_SKIP(sse2_skip_digit, sse2_digit)
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2_space(__m256i x)
+{
+    __m256i ctl = _mm256_sub_epi8(x, _mm256_set1_epi8('\t'));
+    ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(ctl, _mm256_set1_epi8('\r' - '\t')), ctl);
+    return _mm256_or_si256(ctl, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+}
+AVX2 static inline __m256i avx2_digit(__m256i x)
+{
+    __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8('0'));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+}
+AVX2 static inline __m256i avx2_alnum(__m256i x)
+{
+    __m256i a = _mm256_sub_epi8(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    a = _mm256_cmpeq_epi8(_mm256_min_epu8(a, _mm256_set1_epi8(25)), a);
+    return _mm256_or_si256(a, avx2_digit(x));
+}
+
+#define AVX2_SKIP(name, classify)                                                \
+    AVX2 static const char *name(const char *p)                                  \
+    {                                                                            \
+        const char *block = (const char *)((uintptr_t)p & ~(uintptr_t)31);       \
+        unsigned in = _mm256_movemask_epi8(classify(_mm256_load_si256((const __m256i *)block))); \
+        unsigned stop = ~in & (0xFFFFFFFFu << (p - block));                      \
+        while (!stop)                                                            \
+        {                                                                        \
+            block += 32;                                                         \
+            in = _mm256_movemask_epi8(classify(_mm256_load_si256((const __m256i *)block))); \
+            stop = ~in;                                                          \
+        }                                                                        \
+        return block + __builtin_ctz(stop);                                      \
+    }
+
+AVX2_SKIP(avx2_skip_space, avx2_space)
+AVX2_SKIP(avx2_skip_alnum, avx2_alnum)
+AVX2_SKIP(avx2_skip_digit, avx2_digit)
+
+#endif // CHAR_SCAN_X86
+
+const char *(*skip_space_run)(const char *p) = scalar_skip_space;
+const char *(*skip_alnum_run)(const char *p) = scalar_skip_alnum;
+const char *(*skip_digit_run)(const char *p) = scalar_skip_digit;
+static const char *scan_isa = "scalar";
+
+// Pick the widest kernels this CPU supports before main() runs
+__attribute__((constructor)) static void select_char_scanners(void)
+{
+#ifdef CHAR_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        skip_space_run = avx2_skip_space;
+        skip_alnum_run = avx2_skip_alnum;
+        skip_digit_run = avx2_skip_digit;
+        scan_isa = "avx2";
+    }
+    else
+    {
+        // SSE2 is part of the x86-64 baseline
+        skip_space_run = sse2_skip_space;
+        skip_alnum_run = sse2_skip_alnum;
+        skip_digit_run = sse2_skip_digit;
+        scan_isa = "sse2";
+    }
+#endif
+}
+
+const char *char_scan_isa(void)
+{
+    return scan_isa;
+}
@@ -0,0 +1,49 @@
+#ifndef CHARCLASS_H
+#define CHARCLASS_H
+
+// Byte classes used by the lexer, independent of the C locale
+enum
+{
+    CC_SPACE = 1, // ' ', \t, \n, \v, \f, \r
+    CC_ALPHA = 2, // A-Z a-z
+    CC_DIGIT = 4, // 0-9
+    CC_ALNUM = CC_ALPHA | CC_DIGIT
+};
+
+extern const unsigned char char_class[256];
+
+#define IS_SPACE(c) (char_class[(unsigned char)(c)] & CC_SPACE)
+#define IS_ALPHA(c) (char_class[(unsigned char)(c)] & CC_ALPHA)
+#define IS_DIGIT(c) (char_class[(unsigned char)(c)] & CC_DIGIT)
+#define IS_ALNUM(c) (char_class[(unsigned char)(c)] & CC_ALNUM)
+
+// Run scanners: each returns a pointer to the first byte at or after p
+// that is not in the class. The input must be NUL-terminated; NUL is in
+// no class, so a scan always stops on it. The vector kernels only issue
+// aligned loads, which never cross into the page after the terminator.
+extern const char *(*skip_space_run)(const char *p);
+extern const char *(*skip_alnum_run)(const char *p);
+extern const char *(*skip_digit_run)(const char *p);
+
+// Name of the kernel set picked at startup: "avx2", "sse2" or "scalar"
+const char *char_scan_isa(void);
+
+// Most runs are a few bytes long (one space, a short name), so look at
+// the first bytes inline and only call into a kernel for longer runs
+#define CHAR_SCAN_INLINE 8
+
+static inline const char *scan_run(const char *p, unsigned char cls,
+                                   const char *(*kernel)(const char *))
+{
+    for (int i = 0; i < CHAR_SCAN_INLINE; i++, p++)
+    {
+        if (!(char_class[(unsigned char)*p] & cls))
+            return p;
+    }
+    return kernel(p);
+}
+static inline const char *scan_space(const char *p) { return scan_run(p, CC_SPACE, skip_space_run); }
+static inline const char *scan_alnum(const char *p) { return scan_run(p, CC_ALNUM, skip_alnum_run); }
+static inline const char *scan_digit(const char *p) { return scan_run(p, CC_DIGIT, skip_digit_run); }
+
+#endif // CHARCLASS_H
@@ -0,0 +1,146 @@
+#include "intern.h"
+#include "../common/xalloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_CHUNK_SIZE (64 * 1024)
+
+// Name strings are packed into chunks that are never moved, so the
+// pointers symbol_name hands out stay valid
+typedef struct PoolChunk
+{
+    struct PoolChunk *next;
+    size_t used, size;
+    char data[];
+} PoolChunk;
+
+struct InternTable
+{
+    PoolChunk *pool;
+
+    const char **names;
+    int *name_lengths;
+    unsigned *name_hashes;
+    int count, capacity;
+
+    // Open-addressing index: slot holds a symbol, or -1 when empty
+    int *slots;
+    unsigned slot_mask;
+};
+
+static unsigned hash_name(const char *text, int length)
+{
+    // FNV-1a
+    unsigned h = 2166136261u;
+    for (int i = 0; i < length; i++)
+        h = (h ^ (unsigned char)text[i]) * 16777619u;
+    return h;
+}
+
+static const char *pool_copy(InternTable *t, const char *text, int length)
+{
+    if (!t->pool || t->pool->used + length + 1 > t->pool->size)
+    {
+        size_t size = length + 1 > POOL_CHUNK_SIZE ? length + 1 : POOL_CHUNK_SIZE;
+        PoolChunk *chunk = xmalloc(sizeof(PoolChunk) + size);
+        chunk->next = t->pool;
+        chunk->used = 0;
+        chunk->size = size;
+        t->pool = chunk;
+    }
+    char *copy = t->pool->data + t->pool->used;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    t->pool->used += length + 1;
+    return copy;
+}
+
+static void grow_slots(InternTable *t)
+{
+    unsigned size = t->slot_mask ? (t->slot_mask + 1) * 2 : 1024;
+    free(t->slots);
+    t->slots = xmalloc(size * sizeof(int));
+    memset(t->slots, -1, size * sizeof(int));
+    t->slot_mask = size - 1;
+    for (int s = 0; s < t->count; s++)
+    {
+        unsigned i = t->name_hashes[s] & t->slot_mask;
+        while (t->slots[i] != -1)
+            i = (i + 1) & t->slot_mask;
+        t->slots[i] = s;
+    }
+}
+
+static Symbol insert(InternTable *t, const char *text, int length, unsigned h, unsigned slot)
+{
+    if (t->count == t->capacity)
+    {
+        t->capacity = t->capacity ? t->capacity * 2 : 256;
+        t->names = xrealloc(t->names, t->capacity * sizeof(*t->names));
+        t->name_lengths = xrealloc(t->name_lengths, t->capacity * sizeof(int));
+        t->name_hashes = xrealloc(t->name_hashes, t->capacity * sizeof(unsigned));
+    }
+    Symbol s = t->count++;
+    t->names[s] = pool_copy(t, text, length);
+    t->name_lengths[s] = length;
+    t->name_hashes[s] = h;
+    t->slots[slot] = s;
+    // keep the load factor under one half
+    if ((unsigned)t->count * 2 > t->slot_mask)
+        grow_slots(t);
+    return s;
+}
+
+Symbol intern(InternTable *t, const char *text, int length)
+{
+    unsigned h = hash_name(text, length);
+    unsigned i = h & t->slot_mask;
+    for (;;)
+    {
+        int s = t->slots[i];
+        if (s == -1)
+            return insert(t, text, length, h, i);
+        if (t->name_hashes[s] == h && t->name_lengths[s] == length &&
+            memcmp(t->names[s], text, length) == 0)
+            return s;
+        i = (i + 1) & t->slot_mask;
+    }
+}
+
+// The predefined symbols take the first ids, in enum order
+InternTable *create_intern_table(void)
+{
+    InternTable *t = xmalloc(sizeof *t);
+    memset(t, 0, sizeof *t);
+    grow_slots(t);
+    intern(t, "this", 4);
+    intern(t, "<ctor>", 6);
+    return t;
+}
+
+void free_intern_table(InternTable *t)
+{
+    if (!t)
+        return;
+    while (t->pool)
+    {
+        PoolChunk *next = t->pool->next;
+        free(t->pool);
+        t->pool = next;
+    }
+    free(t->names);
+    free(t->name_lengths);
+    free(t->name_hashes);
+    free(t->slots);
+    free(t);
+}
+
+const char *symbol_name(const InternTable *t, Symbol symbol)
+{
+    return symbol >= 0 && symbol < t->count ? t->names[symbol] : "<none>";
+}
+
+int symbol_count(const InternTable *t)
+{
+    return t->count;
+}
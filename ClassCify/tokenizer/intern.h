@@ -0,0 +1,30 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+// Interned names. Every distinct identifier gets a dense id, so later
+// phases compare names with == and index tables by id. Ids are only
+// meaningful within the table that handed them out.
+typedef int Symbol;
+
+#define NO_SYMBOL (-1)
+
+// Names the compiler itself refers to, present in every table
+enum
+{
+    SYM_THIS, // "this", the receiver variable
+    SYM_CTOR, // "<ctor>", the constructor's method name
+    SYM_PREDEFINED_COUNT
+};
+
+typedef struct InternTable InternTable;
+
+// A new table already holds the predefined symbols
+InternTable *create_intern_table(void);
+void free_intern_table(InternTable *table);
+
+// Not synchronised: concurrent readers are fine once nobody interns
+Symbol intern(InternTable *table, const char *text, int length);
+const char *symbol_name(const InternTable *table, Symbol symbol); // NUL-terminated, stable
+int symbol_count(const InternTable *table);
+
+#endif // INTERN_H
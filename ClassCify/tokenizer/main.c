@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "tokenizer.h"
+#include "source.h"
 
 const char *get_token_name(TokenKind kind)
 {
@@ -74,6 +75,8 @@ const char *get_token_name(TokenKind kind)
         return "TOKEN_STRING_LITERAL";
     case TOKEN_SEMICOLON:
         return "TOKEN_SEMICOLON";
+    case TOKEN_EOF:
+        return "TOKEN_EOF";
     case TOKEN_UNKNOWN:
         return "TOKEN_UNKNOWN";
     default:
@@ -81,34 +84,31 @@ const char *get_token_name(TokenKind kind)
     }
 }
 
-int main()
+int main(int argc, char **argv)
 {
-    FILE *file = fopen("test_input.txt", "r");
-    if (!file)
+    const char *path = argc > 1 ? argv[1] : "test_input.txt";
+    SourceFile source;
+    if (load_source(path, &source) != 0)
     {
-        perror("Failed to open test_input.txt");
+        fprintf(stderr, "Failed to open %s: ", path);
+        perror(NULL);
         return 1;
     }
 
-    fseek(file, 0, SEEK_END);
-    long length = ftell(file);
-    rewind(file);
-
-    char *buffer = (char *)malloc(length + 1);
-    fread(buffer, 1, length, file);
-    buffer[length] = '\0';
-    fclose(file);
-
+    InternTable *names = create_intern_table();
     Tokenizer tokenizer;
-    init_tokenizer(&tokenizer, buffer);
+    init_tokenizer(&tokenizer, source.data, names);
 
     while (has_more_tokens(&tokenizer))
     {
         Token token = next_token(&tokenizer);
-        printf("%s: %s\n", get_token_name(token.kind), token.value);
-        free_token(&token);
+        if (token.kind == TOKEN_EOF)
+            break;
+        printf("%s: %.*s\n", get_token_name(token.kind), token.length,
+               token_text(&tokenizer, token));
     }
 
-    free(buffer);
+    free_intern_table(names);
+    release_source(&source);
     return 0;
 }
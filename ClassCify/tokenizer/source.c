@@ -0,0 +1,107 @@
+#include "source.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Fallback for pipes and special files: read everything into the heap
+static int read_source(int fd, SourceFile *src)
+{
+    size_t capacity = 1 << 16, length = 0;
+    char *buffer = malloc(capacity);
+    if (!buffer)
+        return -1;
+    for (;;)
+    {
+        if (length + 1 == capacity)
+        {
+            char *grown = realloc(buffer, capacity * 2);
+            if (!grown)
+            {
+                free(buffer);
+                return -1;
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, buffer + length, capacity - length - 1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            free(buffer);
+            return -1;
+        }
+        if (n == 0)
+            break;
+        length += n;
+    }
+    buffer[length] = '\0';
+    src->data = buffer;
+    src->length = length;
+    src->base = buffer;
+    src->map_size = 0;
+    return 0;
+}
+
+// Regular files are mapped without copying. The mapping is one byte
+// longer than the file, rounded up to whole pages: the kernel zero-fills
+// the tail of the last file page, and when the file ends exactly on a
+// page boundary the extra anonymous page supplies the terminating NUL.
+static int map_source(int fd, size_t length, SourceFile *src)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t map_size = (length + 1 + page - 1) / page * page;
+
+    char *base = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return -1;
+    if (length > 0 &&
+        mmap(base, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        int saved = errno;
+        munmap(base, map_size);
+        errno = saved;
+        return -1;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(base, map_size, MADV_SEQUENTIAL);
+#endif
+    src->data = base;
+    src->length = length;
+    src->base = base;
+    src->map_size = map_size;
+    return 0;
+}
+
+int load_source(const char *path, SourceFile *src)
+{
+    memset(src, 0, sizeof *src);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    int result;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        result = map_source(fd, (size_t)st.st_size, src);
+    else
+        result = read_source(fd, src);
+
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return result;
+}
+
+void release_source(SourceFile *src)
+{
+    if (src->map_size)
+        munmap(src->base, src->map_size);
+    else
+        free(src->base);
+    memset(src, 0, sizeof *src);
+}
@@ -0,0 +1,21 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+
+// A source file loaded for lexing. 'data' is always followed by a NUL
+// byte, so the tokenizer can run on it directly.
+typedef struct
+{
+    const char *data;
+    size_t length;
+    void *base;      // start of the mapping or heap buffer
+    size_t map_size; // size of the mapping, 0 when read into the heap
+} SourceFile;
+
+// Map 'path' read-only (or read it, for pipes and other non-regular
+// files). Returns 0 on success, -1 with errno set on failure.
+int load_source(const char *path, SourceFile *src);
+void release_source(SourceFile *src);
+
+#endif // SOURCE_H
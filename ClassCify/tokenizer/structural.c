@@ -0,0 +1,218 @@
+#include "structural.h"
+#include "charclass.h"
+#include "../common/xalloc.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define STRUCTURAL_X86 1
+#include <immintrin.h>
+#endif
+
+// One bit per byte of a 64-byte block, bit i for byte i
+typedef struct
+{
+    uint64_t space, alpha, digit, paren;
+} BlockMasks;
+
+static void scalar_classify(const unsigned char *block, BlockMasks *m)
+{
+    m->space = m->alpha = m->digit = m->paren = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        unsigned char cls = char_class[block[i]];
+        uint64_t bit = (uint64_t)1 << i;
+        if (cls & CC_SPACE)
+            m->space |= bit;
+        if (cls & CC_ALPHA)
+            m->alpha |= bit;
+        if (cls & CC_DIGIT)
+            m->digit |= bit;
+        if (block[i] == '(' || block[i] == ')')
+            m->paren |= bit;
+    }
+}
+
+#ifdef STRUCTURAL_X86
+
+// Range tests use "min(x - lo, hi - lo) == x - lo" as an unsigned compare
+static inline void sse2_classify16(__m128i x, unsigned *space, unsigned *alpha,
+                                   unsigned *digit, unsigned *paren)
+{
+    __m128i ctl = _mm_sub_epi8(x, _mm_set1_epi8('\t'));
+    ctl = _mm_cmpeq_epi8(_mm_min_epu8(ctl, _mm_set1_epi8('\r' - '\t')), ctl);
+    *space = _mm_movemask_epi8(_mm_or_si128(ctl, _mm_cmpeq_epi8(x, _mm_set1_epi8(' '))));
+    __m128i a = _mm_sub_epi8(_mm_or_si128(x, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    *alpha = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(a, _mm_set1_epi8(25)), a));
+    __m128i d = _mm_sub_epi8(x, _mm_set1_epi8('0'));
+    *digit = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d));
+    // '(' and ')' are 0x28 and 0x29: clear the low bit and compare once
+    *paren = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(x, _mm_set1_epi8(~1)),
+                                              _mm_set1_epi8('(')));
+}
+
+static void sse2_classify(const unsigned char *block, BlockMasks *m)
+{
+    m->space = m->alpha = m->digit = m->paren = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        unsigned space, alpha, digit, paren;
+        sse2_classify16(_mm_loadu_si128((const __m128i *)(block + 16 * i)),
+                        &space, &alpha, &digit, &paren);
+        m->space |= (uint64_t)space << (16 * i);
+        m->alpha |= (uint64_t)alpha << (16 * i);
+        m->digit |= (uint64_t)digit << (16 * i);
+        m->paren |= (uint64_t)paren << (16 * i);
+    }
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline void avx2_classify32(__m256i x, uint32_t *space, uint32_t *alpha,
+                                        uint32_t *digit, uint32_t *paren)
+{
+    __m256i ctl = _mm256_sub_epi8(x, _mm256_set1_epi8('\t'));
+    ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(ctl, _mm256_set1_epi8('\r' - '\t')), ctl);
+    *space = _mm256_movemask_epi8(_mm256_or_si256(ctl, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' '))));
+    __m256i a = _mm256_sub_epi8(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    *alpha = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(a, _mm256_set1_epi8(25)), a));
+    __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8('0'));
+    *digit = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d));
+    *paren = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(x, _mm256_set1_epi8(~1)),
+                                                    _mm256_set1_epi8('(')));
+}
+
+AVX2 static void avx2_classify(const unsigned char *block, BlockMasks *m)
+{
+    uint32_t s0, a0, d0, p0, s1, a1, d1, p1;
+    avx2_classify32(_mm256_loadu_si256((const __m256i *)block), &s0, &a0, &d0, &p0);
+    avx2_classify32(_mm256_loadu_si256((const __m256i *)(block + 32)), &s1, &a1, &d1, &p1);
+    m->space = s0 | (uint64_t)s1 << 32;
+    m->alpha = a0 | (uint64_t)a1 << 32;
+    m->digit = d0 | (uint64_t)d1 << 32;
+    m->paren = p0 | (uint64_t)p1 << 32;
+}
+
+#endif // STRUCTURAL_X86
+
+static void (*classify_block)(const unsigned char *block, BlockMasks *m) = scalar_classify;
+static const char *classify_isa = "scalar";
+
+__attribute__((constructor)) static void select_block_classifier(void)
+{
+#ifdef STRUCTURAL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        classify_block = avx2_classify;
+        classify_isa = "avx2";
+    }
+    else
+    {
+        classify_block = sse2_classify;
+        classify_isa = "sse2";
+    }
+#endif
+}
+
+const char *structural_isa(void)
+{
+    return classify_isa;
+}
+
+// Append the offset of every set bit; 'out' has room for 64 more
+static inline int flatten(uint64_t bits, int base, int *out, int count)
+{
+    while (bits)
+    {
+        out[count++] = base + __builtin_ctzll(bits);
+        bits &= bits - 1;
+    }
+    return count;
+}
+
+// Make room for one more block's worth of offsets
+static int *reserve(int *array, int count, int *cap)
+{
+    if (count + 64 <= *cap)
+        return array;
+    while (count + 64 > *cap)
+        *cap *= 2;
+    return xrealloc(array, *cap * sizeof(int));
+}
+
+void build_structural_index(const char *input, StructuralIndex *index)
+{
+    int length = (int)strlen(input);
+    index->length = length;
+    // typical programs have a token start every four or five bytes
+    int start_cap = length / 4 + 64, paren_cap = length / 8 + 64;
+    index->starts = xmalloc(start_cap * sizeof(int));
+    index->parens = xmalloc(paren_cap * sizeof(int));
+    index->start_count = 0;
+    index->paren_count = 0;
+
+    // bit 63 of the previous block's word and digit masks
+    uint64_t prev_word = 0, prev_digit = 0;
+    unsigned char tail[64];
+    for (int base = 0; base < length; base += 64)
+    {
+        const unsigned char *block = (const unsigned char *)input + base;
+        if (length - base < 64)
+        {
+            // pad the last block with spaces, which start nothing
+            memset(tail, ' ', sizeof tail);
+            memcpy(tail, block, length - base);
+            block = tail;
+        }
+        BlockMasks m;
+        classify_block(block, &m);
+
+        uint64_t word = m.alpha | m.digit;
+        // punctuation and stray bytes are single-byte tokens
+        uint64_t other = ~(m.space | word);
+        // names and numbers start where a run of letters and digits does;
+        // a letter right after a digit may also start one ("12ab" is 12, ab)
+        uint64_t word_start = word & ~(word << 1 | prev_word);
+        uint64_t after_digit = m.alpha & (m.digit << 1 | prev_digit);
+        prev_word = word >> 63;
+        prev_digit = m.digit >> 63;
+
+        index->starts = reserve(index->starts, index->start_count, &start_cap);
+        index->parens = reserve(index->parens, index->paren_count, &paren_cap);
+        index->start_count = flatten(other | word_start | after_digit, base,
+                                     index->starts, index->start_count);
+        index->paren_count = flatten(m.paren, base, index->parens, index->paren_count);
+    }
+}
+
+void free_structural_index(StructuralIndex *index)
+{
+    free(index->starts);
+    free(index->parens);
+    index->starts = index->parens = NULL;
+    index->start_count = index->paren_count = 0;
+}
+
+int match_parens(const char *input, const StructuralIndex *index, int *partner)
+{
+    int *stack = xmalloc((index->paren_count + 1) * sizeof(int));
+    int top = 0, unmatched = 0;
+    for (int i = 0; i < index->paren_count; i++)
+    {
+        partner[i] = -1;
+        if (input[index->parens[i]] == '(')
+            stack[top++] = i;
+        else if (top > 0)
+        {
+            int open = stack[--top];
+            partner[open] = i;
+            partner[i] = open;
+        }
+        else
+            unmatched++;
+    }
+    free(stack);
+    return unmatched + top;
+}
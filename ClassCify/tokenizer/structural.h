@@ -0,0 +1,31 @@
+#ifndef STRUCTURAL_H
+#define STRUCTURAL_H
+
+// Stage 1 of the lexer, in the style of simdjson: the input is classified
+// 64 bytes at a time into bitmasks (whitespace, letters, digits, parens),
+// and the masks are turned into the offsets where tokens can start.
+// Stage 2 (lex_indexed) then decodes tokens only at those offsets and
+// never scans whitespace.
+typedef struct
+{
+    int *starts;     // ascending; every token start, plus the second byte
+                     // of "==" and letters that follow digits inside a name
+    int start_count;
+    int *parens;     // offsets of every '(' and ')', ascending
+    int paren_count;
+    int length;      // bytes indexed: everything before the first NUL
+} StructuralIndex;
+
+// 'input' must be NUL-terminated
+void build_structural_index(const char *input, StructuralIndex *index);
+void free_structural_index(StructuralIndex *index);
+
+// Pairs up the parens of the index: partner[i] is the entry of
+// index->parens that closes or opens entry i, or -1 if it has none.
+// Returns the number of unmatched parens.
+int match_parens(const char *input, const StructuralIndex *index, int *partner);
+
+// Name of the block classifier picked at startup: "avx2", "sse2" or "scalar"
+const char *structural_isa(void);
+
+#endif // STRUCTURAL_H
@@ -1,39 +1,31 @@
 #include "tokenizer.h"
+#include "charclass.h"
+#include "../common/xalloc.h"
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdio.h>
 
-typedef struct
-{
-    const char *keyword;
-    TokenKind kind;
-} KeywordMap;
-
-static KeywordMap reserved_keywords[] = {
-    {"Int", TOKEN_INT}, {"Boolean", TOKEN_BOOL}, {"Void", TOKEN_VOID}, {"this", TOKEN_THIS}, {"true", TOKEN_TRUE}, {"false", TOKEN_FALSE}, {"new", TOKEN_NEW}, {"vardec", TOKEN_VARDEC}, {"while", TOKEN_WHILE}, {"break", TOKEN_BREAK}, {"println", TOKEN_PRINT}, {"if", TOKEN_IF}, {"return", TOKEN_RETURN}, {"init", TOKEN_INIT}, {"super", TOKEN_SUPER}, {"class", TOKEN_CLASS}, {"method", TOKEN_METHOD}, {"call", TOKEN_CALL}, {NULL, TOKEN_UNKNOWN}};
-
-static Token make_token(TokenKind kind, const char *start, int length)
+static Token make_token(Tokenizer *tokenizer, TokenKind kind, const char *start, int length)
 {
     Token token;
     token.kind = kind;
-    token.value = (char *)malloc(length + 1);
-    strncpy(token.value, start, length);
-    token.value[length] = '\0';
+    token.offset = start - tokenizer->input;
+    token.length = length;
+    token.value = 0;
     return token;
 }
 
-void free_token(Token *token)
+// Points at the first byte of the lexeme; it is NOT NUL-terminated
+const char *token_text(const Tokenizer *tokenizer, Token token)
 {
-    if (token->value)
-        free(token->value);
-    token->value = NULL;
+    return tokenizer->input + token.offset;
 }
 
-void init_tokenizer(Tokenizer *tokenizer, const char *input)
+void init_tokenizer(Tokenizer *tokenizer, const char *input, InternTable *names)
 {
     tokenizer->input = input;
     tokenizer->position = 0;
+    tokenizer->names = names;
 }
 
 bool has_more_tokens(Tokenizer *tokenizer)
@@ -43,100 +35,252 @@ bool has_more_tokens(Tokenizer *tokenizer)
 
 static void skip_whitespace(Tokenizer *tokenizer)
 {
-    while (isspace(tokenizer->input[tokenizer->position]))
-    {
-        tokenizer->position++;
-    }
+    const char *src = tokenizer->input + tokenizer->position;
+    tokenizer->position = scan_space(src) - tokenizer->input;
 }
 
-static TokenKind match_keyword(const char *start, int length)
+// Reserved words are picked out by length and first character (second
+// character for this/true), leaving one memcmp against the only candidate
+TokenKind match_keyword(const char *start, int length)
 {
-    for (int i = 0; reserved_keywords[i].keyword != NULL; i++)
+    const char *keyword;
+    TokenKind kind;
+
+    switch (length)
     {
-        if (strncmp(start, reserved_keywords[i].keyword, length) == 0 &&
-            strlen(reserved_keywords[i].keyword) == length)
+    case 2:
+        if (start[0] != 'i')
+            return TOKEN_IDENTIFIER;
+        keyword = "if", kind = TOKEN_IF;
+        break;
+    case 3:
+        switch (start[0])
         {
-            return reserved_keywords[i].kind;
+        case 'I': keyword = "Int", kind = TOKEN_INT; break;
+        case 'n': keyword = "new", kind = TOKEN_NEW; break;
+        default: return TOKEN_IDENTIFIER;
+        }
+        break;
+    case 4:
+        switch (start[0])
+        {
+        case 'V': keyword = "Void", kind = TOKEN_VOID; break;
+        case 'i': keyword = "init", kind = TOKEN_INIT; break;
+        case 'c': keyword = "call", kind = TOKEN_CALL; break;
+        case 't':
+            if (start[1] == 'h')
+                keyword = "this", kind = TOKEN_THIS;
+            else
+                keyword = "true", kind = TOKEN_TRUE;
+            break;
+        default: return TOKEN_IDENTIFIER;
         }
+        break;
+    case 5:
+        switch (start[0])
+        {
+        case 'f': keyword = "false", kind = TOKEN_FALSE; break;
+        case 'w': keyword = "while", kind = TOKEN_WHILE; break;
+        case 'b': keyword = "break", kind = TOKEN_BREAK; break;
+        case 's': keyword = "super", kind = TOKEN_SUPER; break;
+        case 'c': keyword = "class", kind = TOKEN_CLASS; break;
+        default: return TOKEN_IDENTIFIER;
+        }
+        break;
+    case 6:
+        switch (start[0])
+        {
+        case 'v': keyword = "vardec", kind = TOKEN_VARDEC; break;
+        case 'r': keyword = "return", kind = TOKEN_RETURN; break;
+        case 'm': keyword = "method", kind = TOKEN_METHOD; break;
+        default: return TOKEN_IDENTIFIER;
+        }
+        break;
+    case 7:
+        switch (start[0])
+        {
+        case 'B': keyword = "Boolean", kind = TOKEN_BOOL; break;
+        case 'p': keyword = "println", kind = TOKEN_PRINT; break;
+        default: return TOKEN_IDENTIFIER;
+        }
+        break;
+    default:
+        return TOKEN_IDENTIFIER;
     }
-    return TOKEN_IDENTIFIER;
+    return memcmp(start, keyword, length) == 0 ? kind : TOKEN_IDENTIFIER;
 }
 
-Token next_token(Tokenizer *tokenizer)
+// Decode the token at the current position, which must not be whitespace
+static Token lex_token(Tokenizer *tokenizer)
 {
-    skip_whitespace(tokenizer);
     const char *src = tokenizer->input + tokenizer->position;
 
-    if (isalpha(*src))
+    if (IS_ALPHA(*src))
     {
         const char *start = src;
-        while (isalnum(*src))
-            src++;
+        src = scan_alnum(src + 1);
         int length = src - start;
         TokenKind kind = match_keyword(start, length);
         tokenizer->position += length;
-        return make_token(kind, start, length);
+        Token token = make_token(tokenizer, kind, start, length);
+        // each distinct name is copied once, into the intern table
+        if (kind == TOKEN_IDENTIFIER)
+            token.value = intern(tokenizer->names, start, length);
+        return token;
     }
-    else if (isdigit(*src))
+    else if (IS_DIGIT(*src))
     {
         const char *start = src;
-        while (isdigit(*src))
-            src++;
+        src = scan_digit(src + 1);
         int length = src - start;
         tokenizer->position += length;
-        return make_token(TOKEN_INT_LITERAL, start, length);
+        Token token = make_token(tokenizer, TOKEN_INT_LITERAL, start, length);
+        // decode once here so the parser never has to re-scan the digits
+        unsigned int value = 0;
+        for (const char *p = start; p < src; p++)
+            value = value * 10 + (unsigned int)(*p - '0');
+        token.value = (int)value;
+        return token;
     }
     else
     {
         switch (*src)
         {
+        case '\0':
+            // stay on the terminator so repeated calls keep returning EOF
+            return make_token(tokenizer, TOKEN_EOF, src, 0);
         case '(':
             tokenizer->position++;
-            return make_token(TOKEN_LPAREN, src, 1);
+            return make_token(tokenizer, TOKEN_LPAREN, src, 1);
         case ')':
             tokenizer->position++;
-            return make_token(TOKEN_RPAREN, src, 1);
+            return make_token(tokenizer, TOKEN_RPAREN, src, 1);
         case '{':
             tokenizer->position++;
-            return make_token(TOKEN_LBRACE, src, 1);
+            return make_token(tokenizer, TOKEN_LBRACE, src, 1);
         case '}':
             tokenizer->position++;
-            return make_token(TOKEN_RBRACE, src, 1);
+            return make_token(tokenizer, TOKEN_RBRACE, src, 1);
         case '.':
             tokenizer->position++;
-            return make_token(TOKEN_DOT, src, 1);
+            return make_token(tokenizer, TOKEN_DOT, src, 1);
         case '+':
             tokenizer->position++;
-            return make_token(TOKEN_PLUS, src, 1);
+            return make_token(tokenizer, TOKEN_PLUS, src, 1);
         case '-':
             tokenizer->position++;
-            return make_token(TOKEN_MINUS, src, 1);
+            return make_token(tokenizer, TOKEN_MINUS, src, 1);
         case '*':
             tokenizer->position++;
-            return make_token(TOKEN_MULT, src, 1);
+            return make_token(tokenizer, TOKEN_MULT, src, 1);
         case '/':
             tokenizer->position++;
-            return make_token(TOKEN_DIV, src, 1);
+            return make_token(tokenizer, TOKEN_DIV, src, 1);
         case '<':
             tokenizer->position++;
-            return make_token(TOKEN_LESSTHAN, src, 1);
+            return make_token(tokenizer, TOKEN_LESSTHAN, src, 1);
         case ';':
             tokenizer->position++;
-            return make_token(TOKEN_SEMICOLON, src, 1);
+            return make_token(tokenizer, TOKEN_SEMICOLON, src, 1);
         case '=':
             if (*(src + 1) == '=')
             {
                 tokenizer->position += 2;
-                return make_token(TOKEN_EQUALS, src, 2);
+                return make_token(tokenizer, TOKEN_EQUALS, src, 2);
             }
             else
             {
                 tokenizer->position++;
-                return make_token(TOKEN_SINGLE_EQUALS, src, 1);
+                return make_token(tokenizer, TOKEN_SINGLE_EQUALS, src, 1);
             }
         default:
             tokenizer->position++;
-            return make_token(TOKEN_UNKNOWN, src, 1);
+            return make_token(tokenizer, TOKEN_UNKNOWN, src, 1);
         }
     }
-}
\ No newline at end of file
+}
+
+Token next_token(Tokenizer *tokenizer)
+{
+    skip_whitespace(tokenizer);
+    return lex_token(tokenizer);
+}
+
+static void resize_token_array(TokenArray *tokens, int capacity)
+{
+    tokens->kinds = (TokenKind *)xrealloc(tokens->kinds, capacity * sizeof(TokenKind));
+    tokens->offsets = (int *)xrealloc(tokens->offsets, capacity * sizeof(int));
+    tokens->lengths = (int *)xrealloc(tokens->lengths, capacity * sizeof(int));
+    tokens->values = (int *)xrealloc(tokens->values, capacity * sizeof(int));
+    tokens->capacity = capacity;
+}
+
+static void grow_token_array(TokenArray *tokens)
+{
+    resize_token_array(tokens, tokens->capacity ? tokens->capacity * 2 : 256);
+}
+
+static void push_token(TokenArray *tokens, Token token)
+{
+    if (tokens->count == tokens->capacity)
+        grow_token_array(tokens);
+    tokens->kinds[tokens->count] = token.kind;
+    tokens->offsets[tokens->count] = token.offset;
+    tokens->lengths[tokens->count] = token.length;
+    tokens->values[tokens->count] = token.value;
+    tokens->count++;
+}
+
+static void clear_token_array(TokenArray *tokens)
+{
+    tokens->kinds = NULL;
+    tokens->offsets = NULL;
+    tokens->lengths = NULL;
+    tokens->values = NULL;
+    tokens->count = 0;
+    tokens->capacity = 0;
+}
+
+// Lex the whole input once, ending with a single TOKEN_EOF entry
+void lex_all(Tokenizer *tokenizer, TokenArray *tokens)
+{
+    clear_token_array(tokens);
+    Token token;
+    do
+    {
+        token = next_token(tokenizer);
+        push_token(tokens, token);
+    } while (token.kind != TOKEN_EOF);
+}
+
+// Stage 2 of indexed lexing: decode a token at each start the index
+// recorded. Entries that fall inside the previous token are skipped.
+void lex_indexed(Tokenizer *tokenizer, const StructuralIndex *index, TokenArray *tokens)
+{
+    clear_token_array(tokens);
+    // there is at most a token per start, plus TOKEN_EOF
+    resize_token_array(tokens, index->start_count + 1);
+    for (int i = 0; i < index->start_count; i++)
+    {
+        if (index->starts[i] < tokenizer->position)
+            continue;
+        tokenizer->position = index->starts[i];
+        push_token(tokens, lex_token(tokenizer));
+    }
+    tokenizer->position = index->length;
+    push_token(tokens, lex_token(tokenizer));
+}
+
+void free_token_array(TokenArray *tokens)
+{
+    free(tokens->kinds);
+    free(tokens->offsets);
+    free(tokens->lengths);
+    free(tokens->values);
+    tokens->kinds = NULL;
+    tokens->offsets = NULL;
+    tokens->lengths = NULL;
+    tokens->values = NULL;
+    tokens->count = 0;
+    tokens->capacity = 0;
+}
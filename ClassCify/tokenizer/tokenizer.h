@@ -2,6 +2,8 @@
 #define TOKENIZER_H
 
 #include <stdbool.h>
+#include "intern.h"
+#include "structural.h"
 
 // Define token types
 typedef enum
@@ -40,14 +42,17 @@ typedef enum
     TOKEN_INT_LITERAL,
     TOKEN_STRING_LITERAL,
     TOKEN_SEMICOLON,
+    TOKEN_EOF,
     TOKEN_UNKNOWN
 } TokenKind;
 
-// Token structure
+// Token structure: a view into the tokenizer input, nothing is allocated
 typedef struct
 {
     TokenKind kind;
-    char *value;
+    int offset;    // start of the lexeme in the input buffer
+    int length;    // length of the lexeme in bytes
+    int value;     // decoded TOKEN_INT_LITERAL value, or the Symbol of a TOKEN_IDENTIFIER
 } Token;
 
 // Tokenizer structure
@@ -55,12 +60,30 @@ typedef struct
 {
     const char *input;
     int position;
+    InternTable *names; // identifiers are interned here
 } Tokenizer;
 
+// Pre-lexed token stream, kinds and spans are kept in separate arrays so
+// lookahead over kinds stays in a dense array of small values
+typedef struct
+{
+    TokenKind *kinds;
+    int *offsets;
+    int *lengths;
+    int *values;  // literal values and identifier Symbols, 0 for other kinds
+    int count;    // number of tokens, the last one is always TOKEN_EOF
+    int capacity;
+} TokenArray;
+
 // Function declarations
-void init_tokenizer(Tokenizer *tokenizer, const char *input);
+void init_tokenizer(Tokenizer *tokenizer, const char *input, InternTable *names);
 Token next_token(Tokenizer *tokenizer);
 bool has_more_tokens(Tokenizer *tokenizer);
-void free_token(Token *token);
+const char *token_text(const Tokenizer *tokenizer, Token token);
+TokenKind match_keyword(const char *start, int length);
+void lex_all(Tokenizer *tokenizer, TokenArray *tokens);
+// Same tokens, decoded from a structural index built over the input
+void lex_indexed(Tokenizer *tokenizer, const StructuralIndex *index, TokenArray *tokens);
+void free_token_array(TokenArray *tokens);
 
 #endif // TOKENIZER_H
\ No newline at end of file
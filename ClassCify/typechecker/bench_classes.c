@@ -0,0 +1,119 @@
+#include "../compiler/compiler.h"
+#include "../common/xalloc.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Scaling benchmark for the class and method environments: generates a
+// program with N classes whose methods call into the previous class,
+// and times parsing and typechecking for growing N. Linear behaviour
+// shows up as a flat time-per-class column.
+//
+//   ./bench_classes [max_classes]
+
+typedef struct
+{
+    char *data;
+    size_t length, capacity;
+} Buffer;
+
+__attribute__((format(printf, 2, 3)))
+static void append(Buffer *b, const char *fmt, ...)
+{
+    for (;;)
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(b->data + b->length, b->capacity - b->length, fmt, ap);
+        va_end(ap);
+        if (b->length + n < b->capacity)
+        {
+            b->length += n;
+            return;
+        }
+        b->capacity = b->capacity ? b->capacity * 2 : 1 << 16;
+        b->data = xrealloc(b->data, b->capacity);
+    }
+}
+
+static char *generate(int classes)
+{
+    Buffer b = {0};
+    append(&b, "(class Base ()\n"
+               "  (init ())\n"
+               "  (method m0 () Int (return 0))\n"
+               "  (method m1 () Int (return 0)))\n");
+    for (int i = 0; i < classes; i++)
+    {
+        const char *prev = "Base";
+        char prev_name[32];
+        if (i > 0)
+        {
+            snprintf(prev_name, sizeof prev_name, "C%d", i - 1);
+            prev = prev_name;
+        }
+        append(&b, "(class C%d Base ()\n"
+                   "  (init () (super))\n"
+                   "  (method m0 () Int (return %d))\n"
+                   "  (method m1 () Int\n"
+                   "    (return (+ (call (new %s) m0) (call (new %s) m1))))\n"
+                   "  (method m2 ((vardec Int x)) Int (return (* x 2)))\n"
+                   "  (method m3 () Int (return (call this m2 (call this m0)))))\n",
+               i, i, prev, prev);
+    }
+    append(&b, "(vardec Base b)\n"
+               "(= b (new C%d))\n"
+               "(println (call b m1))\n",
+           classes - 1);
+    return b.data;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Every size reuses one context; compiler_parse starts from a clean unit
+static int measure(CompilerContext *ctx, int classes, double out[2])
+{
+    char *src = generate(classes);
+    double t0 = now();
+    int status = compiler_parse(ctx, src);
+    double t1 = now();
+    if (status == 0)
+        status = compiler_check(ctx);
+    double t2 = now();
+    if (status != 0)
+        print_diagnostic(stderr, &ctx->diag);
+    compiler_reset(ctx);
+    free(src);
+
+    out[0] = t1 - t0;
+    out[1] = t2 - t1;
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    int max_classes = argc > 1 ? atoi(argv[1]) : 16000;
+    CompilerContext *ctx = compiler_create(NULL);
+
+    printf("%8s %12s %12s %16s\n", "classes", "parse (ms)", "check (ms)", "check/class (us)");
+    for (int classes = 1000; classes <= max_classes; classes *= 2)
+    {
+        double t[2];
+        if (measure(ctx, classes, t) != 0)
+        {
+            fprintf(stderr, "run with %d classes failed\n", classes);
+            return EXIT_FAILURE;
+        }
+        printf("%8d %12.2f %12.2f %16.3f\n", classes, t[0] * 1e3, t[1] * 1e3,
+               t[1] * 1e6 / classes);
+    }
+    compiler_destroy(ctx);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,239 @@
+// the XSI strerror_r, which fills a buffer and returns an int
+#define _POSIX_C_SOURCE 200809L
+
+#include "../compiler/compiler.h"
+#include "../common/xalloc.h"
+#include "../tokenizer/source.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Batch driver: lexes, parses and typechecks many programs at once on a
+// bounded thread pool, then prints one result line per file in the order
+// given and the aggregate throughput. Directories are searched
+// recursively; every regular file whose name does not start with '.' is
+// taken as a program. Symbolic links to directories found inside them
+// are not followed, since they can loop.
+//
+//   ./main_batch [-j threads] [-q] [-c cachedir] path...
+//
+// -j caps the worker count (default: CLASSCIFY_THREADS or the CPU count),
+// -q prints only the files that fail, -c loads and stores parsed ASTs in
+// an existing directory. Exits with 1 if any file fails.
+
+typedef struct
+{
+    char *path;
+    size_t bytes;
+    int failed;
+    char *message; // diagnostic or I/O error, NULL when the file passed
+} FileResult;
+
+typedef struct
+{
+    FileResult *items;
+    int count, capacity;
+} FileList;
+
+static void add_file(FileList *list, const char *path)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->items = xrealloc(list->items, list->capacity * sizeof *list->items);
+    }
+    FileResult *r = &list->items[list->count++];
+    memset(r, 0, sizeof *r);
+    r->path = xstrdup(path);
+}
+
+static int skip_entry(const struct dirent *e)
+{
+    return e->d_name[0] != '.';
+}
+
+// Sorted, so the output does not depend on directory order
+static void collect(FileList *list, const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        // load_source reports missing files with the rest of the results
+        add_file(list, path);
+        return;
+    }
+    struct dirent **entries;
+    int n = scandir(path, &entries, skip_entry, alphasort);
+    if (n < 0)
+    {
+        add_file(list, path);
+        return;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        size_t length = strlen(path) + strlen(entries[i]->d_name) + 2;
+        char *child = xmalloc(length);
+        snprintf(child, length, "%s/%s", path, entries[i]->d_name);
+        if (lstat(child, &st) == 0 && (S_ISDIR(st.st_mode) || S_ISREG(st.st_mode) ||
+            (S_ISLNK(st.st_mode) && stat(child, &st) == 0 && S_ISREG(st.st_mode))))
+            collect(list, child);
+        free(child);
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+// Copies the diagnostic out before the source and AST it points into go
+static char *format_message(const Diagnostic *d)
+{
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    if (!out)
+        return xstrdup(d->message);
+    print_diagnostic(out, d);
+    fclose(out);
+    // drop the trailing newline, the result line adds its own
+    if (length > 0 && text[length - 1] == '\n')
+        text[length - 1] = '\0';
+    return text;
+}
+
+static void check_file(CompilerContext *ctx, FileResult *r)
+{
+    SourceFile src;
+    if (load_source(r->path, &src) != 0)
+    {
+        // runs on pool workers, and strerror may share one buffer
+        int error = errno;
+        char reason[256];
+        if (strerror_r(error, reason, sizeof reason) != 0)
+            snprintf(reason, sizeof reason, "error %d", error);
+        r->failed = 1;
+        r->message = xstrdup(reason);
+        return;
+    }
+    r->bytes = src.length;
+    if (compile_source(ctx, src.data) != 0)
+    {
+        r->failed = 1;
+        r->message = format_message(&ctx->diag);
+    }
+    compiler_reset(ctx);
+    release_source(&src);
+}
+
+// A run of files checked one after another on one context
+typedef struct
+{
+    ThreadPool *pool;
+    const char *cache_dir;
+    FileResult *files;
+    int begin, end;
+} Chunk;
+
+static void check_chunk(void *arg)
+{
+    Chunk *c = arg;
+    // large programs split their method bodies over the same pool
+    CompilerContext *ctx = compiler_create(c->pool);
+    ctx->cache_dir = c->cache_dir;
+    for (int i = c->begin; i < c->end; i++)
+        check_file(ctx, &c->files[i]);
+    compiler_destroy(ctx);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: main_batch [-j threads] [-q] [-c cachedir] path...\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    int threads = 0;
+    int quiet = 0;
+    const char *cache_dir = NULL;
+    FileList files = {0};
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0)
+        {
+            if (++i == argc || atoi(argv[i]) <= 0)
+                usage();
+            threads = atoi(argv[i]);
+        }
+        else if (strcmp(argv[i], "-q") == 0)
+            quiet = 1;
+        else if (strcmp(argv[i], "-c") == 0)
+        {
+            if (++i == argc)
+                usage();
+            cache_dir = argv[i];
+        }
+        else
+            collect(&files, argv[i]);
+    }
+    if (files.count == 0)
+        usage();
+
+    double start = now();
+    ThreadPool *pool = threadpool_create(threads);
+
+    // several chunks per worker keep the load even when file sizes vary,
+    // while each chunk still reuses one context for many files
+    int chunks = threadpool_size(pool) * 8;
+    if (chunks > files.count)
+        chunks = files.count;
+    Chunk *work = xmalloc(chunks * sizeof *work);
+    TaskGroup group;
+    atomic_init(&group.pending, 0);
+    for (int c = 0; c < chunks; c++)
+    {
+        work[c].pool = pool;
+        work[c].cache_dir = cache_dir;
+        work[c].files = files.items;
+        work[c].begin = (int)((long)files.count * c / chunks);
+        work[c].end = (int)((long)files.count * (c + 1) / chunks);
+        threadpool_submit(pool, &group, check_chunk, &work[c]);
+    }
+    threadpool_wait(pool, &group);
+    double elapsed = now() - start;
+
+    int failed = 0;
+    size_t bytes = 0;
+    for (int i = 0; i < files.count; i++)
+    {
+        FileResult *r = &files.items[i];
+        bytes += r->bytes;
+        failed += r->failed;
+        if (r->failed)
+            printf("%s: %s\n", r->path, r->message);
+        else if (!quiet)
+            printf("%s: ok\n", r->path);
+        free(r->path);
+        free(r->message);
+    }
+    printf("%d files, %d passed, %d failed, %.1f KiB in %.3f s "
+           "(%.0f files/s, %.1f MiB/s, %d threads)\n",
+           files.count, files.count - failed, failed, bytes / 1024.0, elapsed,
+           files.count / elapsed, bytes / elapsed / (1024.0 * 1024.0),
+           threadpool_size(pool));
+
+    threadpool_destroy(pool);
+    free(work);
+    free(files.items);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,34 +1,29 @@
-#include "../parser/parser.h"
-#include "../tokenizer/tokenizer.h"
-#include "typechecker.h"
+#include "../compiler/compiler.h"
+#include "../tokenizer/source.h"
 #include <stdio.h>
 #include <stdlib.h>
 
-Tokenizer tokenizer;
-
-int main(void)
+int main(int argc, char **argv)
 {
-    FILE *f = fopen("typechecker_error_test.txt", "r");
-    if (!f)
+    const char *path = argc > 1 ? argv[1] : "typechecker_error_test.txt";
+    SourceFile src;
+    if (load_source(path, &src) != 0)
     {
-        perror("fopen");
+        perror(path);
         return EXIT_FAILURE;
     }
 
-    fseek(f, 0, SEEK_END);
-    long size = ftell(f);
-    rewind(f);
-    char *src = malloc(size + 1);
-    fread(src, 1, size, f);
-    src[size] = '\0';
-    fclose(f);
-
-    init_tokenizer(&tokenizer, src);
-    ASTNode *ast = parse_program();
-
-    typecheck_program(ast);
+    CompilerContext *ctx = compiler_create(NULL);
+    int status = EXIT_SUCCESS;
+    if (compile_source(ctx, src.data) == 0)
+        printf("Type checking passed.\n");
+    else
+    {
+        print_diagnostic(stderr, &ctx->diag);
+        status = EXIT_FAILURE;
+    }
 
-    free_ast(ast);
-    free(src);
-    return EXIT_SUCCESS;
+    compiler_destroy(ctx);
+    release_source(&src);
+    return status;
 }
@@ -1,471 +1,822 @@
-#include "typechecker.h"
+#include "typeenv.h"
 #include "../parser/parser.h"
+#include "../common/threadpool.h"
+#include "../common/xalloc.h"
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
-#include <stdbool.h>
 
-// Type definitions
-typedef enum { TYPE_INT, TYPE_BOOLEAN, TYPE_VOID, TYPE_CLASS } TypeKind;
-typedef struct {
-    TypeKind kind;
-    char    *class_name;   // for TYPE_CLASS
-} Type;
+// Type and TypeKind come from parser.h, where they also label AST nodes
 
-// Method/constructor signature
-typedef struct {
-    int     param_count;
-    Type   *param_types;   // array of length param_count
-    Type    return_type;   // for methods; for ctors, use TYPE_VOID
-} MethodSig;
-
-// Class inheritance environment
-typedef struct ClassEntry {
-    char *name;
-    char *superclass;      // NULL if none
-    struct ClassEntry *next;
-} ClassEntry;
-
-// Method signature environment
-typedef struct MethodEntry {
-    char     *class_name;
-    char     *method_name; // method name or "<ctor>"
-    MethodSig sig;
-    struct MethodEntry *next;
-} MethodEntry;
+static unsigned map_hash(unsigned long long key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (unsigned)key;
+}
+
+static void map_put(IndexMap *m, unsigned long long key, int val);
+
+static void map_grow(IndexMap *m) {
+    IndexMap old = *m;
+    unsigned size = old.mask ? (old.mask + 1) * 2 : 64;
+    m->keys  = xmalloc(size * sizeof *m->keys);
+    m->vals  = xmalloc(size * sizeof *m->vals);
+    m->mask  = size - 1;
+    m->count = 0;
+    for (unsigned i = 0; i < size; i++) m->vals[i] = -1;
+    if (old.mask) {
+        for (unsigned i = 0; i <= old.mask; i++)
+            if (old.vals[i] != -1) map_put(m, old.keys[i], old.vals[i]);
+    }
+    free(old.keys);
+    free(old.vals);
+}
+
+// Insert or overwrite; later definitions shadow earlier ones
+static void map_put(IndexMap *m, unsigned long long key, int val) {
+    if (!m->mask || (unsigned)(m->count + 1) * 2 > m->mask) map_grow(m);
+    unsigned i = map_hash(key) & m->mask;
+    while (m->vals[i] != -1 && m->keys[i] != key)
+        i = (i + 1) & m->mask;
+    if (m->vals[i] == -1) m->count++;
+    m->keys[i] = key;
+    m->vals[i] = val;
+}
+
+static int map_get(const IndexMap *m, unsigned long long key) {
+    if (!m->mask) return -1;
+    unsigned i = map_hash(key) & m->mask;
+    while (m->vals[i] != -1) {
+        if (m->keys[i] == key) return m->vals[i];
+        i = (i + 1) & m->mask;
+    }
+    return -1;
+}
+
+static unsigned long long method_key(Symbol cls, Symbol mname) {
+    return ((unsigned long long)(unsigned)cls << 32) | (unsigned)mname;
+}
 
-static ClassEntry  *class_list  = NULL;
-static MethodEntry *method_list = NULL;
+struct SymTable;
 
-// Add a class to the list
-static void register_class(const char *name, const char *superclass) {
-    ClassEntry *e = malloc(sizeof *e);
-    e->name       = strdup(name);
-    e->superclass = superclass ? strdup(superclass) : NULL;
-    e->next       = class_list;
-    class_list    = e;
+// Checking state of one thread. error() fills in 'diag' and jumps back
+// to 'bail'; whoever catches it also frees 'tbl'.
+typedef struct {
+    TypeEnv         *env;
+    struct SymTable *tbl;  // table of the body being checked, if any
+    Diagnostic       diag;
+    jmp_buf          bail;
+} Checker;
+
+// Add a class to the environment
+static void register_class(TypeEnv *env, Symbol name, Symbol superclass, ASTNode *def) {
+    if (env->class_count == env->class_cap) {
+        env->class_cap = env->class_cap ? env->class_cap * 2 : 64;
+        env->classes   = xrealloc(env->classes, env->class_cap * sizeof *env->classes);
+    }
+    ClassEntry *e = &env->classes[env->class_count];
+    e->name       = name;
+    e->superclass = superclass;
+    e->def        = def;
+    e->method_ids = NULL;
+    e->method_id_count = e->method_id_cap = 0;
+    e->vtable     = NULL;
+    e->vtable_len = 0;
+    map_put(&env->class_index, (unsigned)name, env->class_count++);
 }
 
 // Find a class by name
-static ClassEntry *find_class(const char *name) {
-    for (ClassEntry *e = class_list; e; e = e->next)
-        if (strcmp(e->name, name) == 0) return e;
-    return NULL;
+static ClassEntry *find_class(const TypeEnv *env, Symbol name) {
+    int i = map_get(&env->class_index, (unsigned)name);
+    return i < 0 ? NULL : &env->classes[i];
 }
 
-// Check if 'sub' is a subclass of 'super'
-static int is_subclass(const char *sub, const char *super) {
-    if (strcmp(sub, super) == 0) return 1;
-    ClassEntry *e = find_class(sub);
-    while (e && e->superclass) {
-        if (strcmp(e->superclass, super) == 0) return 1;
-        e = find_class(e->superclass);
+static _Noreturn void error(Checker *ck, const char *msg, ASTNode *n);
+
+int class_number(const TypeEnv *env, Symbol name) {
+    return name >= 0 && name < env->class_by_symbol_len ? env->class_by_symbol[name] : -1;
+}
+
+// Link every class to its superclass and number the inheritance forest
+// in DFS pre/post order, so subclass queries become interval checks.
+// Unknown superclasses and inheritance cycles are reported here.
+static void build_hierarchy(Checker *ck) {
+    TypeEnv    *env     = ck->env;
+    ClassEntry *classes = env->classes;
+    int class_count     = env->class_count;
+    env->class_by_symbol_len = symbol_count(env->names);
+    env->class_by_symbol     = xrealloc(env->class_by_symbol, env->class_by_symbol_len * sizeof(int));
+    for (int s = 0; s < env->class_by_symbol_len; s++) env->class_by_symbol[s] = -1;
+    for (int c = 0; c < class_count; c++) {
+        // a redefinition shadows the earlier entry, which stays out of the tree
+        if (map_get(&env->class_index, (unsigned)classes[c].name) == c)
+            env->class_by_symbol[classes[c].name] = c;
+        classes[c].first_child = classes[c].next_sibling = -1;
+        classes[c].pre = classes[c].post = -1;
+    }
+
+    // children are linked in reverse so siblings come out in source order
+    for (int c = class_count - 1; c >= 0; c--) {
+        ClassEntry *e = &classes[c];
+        e->super_index = -1;
+        if (env->class_by_symbol[e->name] != c) continue;
+        if (e->superclass == NO_SYMBOL) continue;
+        int s = class_number(env, e->superclass);
+        if (s < 0) error(ck, "Unknown superclass", e->def->kids[0]);
+        e->super_index  = s;
+        e->next_sibling = classes[s].first_child;
+        classes[s].first_child = c;
+    }
+
+    // iterative DFS from every root; the stack holds class indices and
+    // cursor[c] is the next child of c still to visit
+    int *stack  = xmalloc((class_count + 1) * sizeof(int));
+    int *cursor = xmalloc((class_count + 1) * sizeof(int));
+    for (int c = 0; c < class_count; c++) cursor[c] = classes[c].first_child;
+    env->class_preorder     = xrealloc(env->class_preorder, (class_count + 1) * sizeof(int));
+    env->class_preorder_len = 0;
+    int counter = 0;
+    for (int r = 0; r < class_count; r++) {
+        if (env->class_by_symbol[classes[r].name] != r || classes[r].super_index != -1) continue;
+        int top = 0;
+        stack[top++] = r;
+        classes[r].pre = counter++;
+        env->class_preorder[env->class_preorder_len++] = r;
+        while (top > 0) {
+            int c = stack[top - 1];
+            int child = cursor[c];
+            if (child != -1) {
+                cursor[c] = classes[child].next_sibling;
+                classes[child].pre = counter++;
+                env->class_preorder[env->class_preorder_len++] = child;
+                stack[top++] = child;
+            } else {
+                classes[c].post = counter++;
+                top--;
+            }
+        }
+    }
+    free(stack);
+    free(cursor);
+
+    // anything not reached from a root sits on or below a cycle
+    for (int c = 0; c < class_count; c++) {
+        if (env->class_by_symbol[classes[c].name] == c && classes[c].pre == -1)
+            error(ck, "Cyclic inheritance", classes[c].def->kids[0]);
     }
-    return 0;
+}
+
+// Check if 'sub' is a subclass of 'super'
+int is_subclass(const TypeEnv *env, Symbol sub, Symbol super) {
+    if (sub == super) return 1;
+    int a = class_number(env, sub), b = class_number(env, super);
+    if (a < 0 || b < 0) return 0;
+    const ClassEntry *classes = env->classes;
+    return classes[b].pre <= classes[a].pre && classes[a].post <= classes[b].post;
 }
 
 // Check subtype compatibility
-static int is_subtype(Type sub, Type sup) {
+static int is_subtype(const TypeEnv *env, Type sub, Type sup) {
     if (sub.kind != sup.kind) return 0;
     if (sub.kind == TYPE_CLASS)
-        return is_subclass(sub.class_name, sup.class_name);
+        return is_subclass(env, sub.cls, sup.cls);
     return 1;
 }
 
+// Record that method entry 'id' can be called on class 'c'
+static void add_class_method(TypeEnv *env, int c, int id) {
+    ClassEntry *e = &env->classes[c];
+    if (e->method_id_count == e->method_id_cap) {
+        e->method_id_cap = e->method_id_cap ? e->method_id_cap * 2 : 8;
+        e->method_ids    = xrealloc(e->method_ids, e->method_id_cap * sizeof(int));
+    }
+    e->method_ids[e->method_id_count++] = id;
+}
+
 // Register a method or constructor signature
-static void add_method_sig(const char *cls, const char *mname, MethodSig sig) {
-    MethodEntry *e = malloc(sizeof *e);
-    e->class_name  = strdup(cls);
-    e->method_name = strdup(mname);
+static void add_method_sig(TypeEnv *env, Symbol cls, Symbol mname, MethodSig sig, ASTNode *def) {
+    if (env->method_count == env->method_cap) {
+        env->method_cap = env->method_cap ? env->method_cap * 2 : 64;
+        env->methods    = xrealloc(env->methods, env->method_cap * sizeof *env->methods);
+    }
+    MethodEntry *e = &env->methods[env->method_count];
+    e->class_name  = cls;
+    e->method_name = mname;
     e->sig         = sig;
-    e->next        = method_list;
-    method_list    = e;
+    e->def         = def;
+    e->slot        = -1;
+    int c = class_number(env, cls);
+    if (c >= 0) add_class_method(env, c, env->method_count);
+    map_put(&env->method_index, method_key(cls, mname), env->method_count++);
 }
 
-// Find a method signature
-static int find_method(const char *cls, const char *mname, MethodSig *out) {
-    for (MethodEntry *e = method_list; e; e = e->next) {
-        if (strcmp(e->class_name, cls) == 0
-         && strcmp(e->method_name, mname) == 0) {
-            *out = e->sig;
-            return 1;
+// A method takes over an inherited slot only when it can stand in for
+// the inherited method at every call site: same parameter types and a
+// return type that is a subtype. Otherwise it hides it by name alone.
+static int overrides(const TypeEnv *env, const MethodSig *sub, const MethodSig *sup) {
+    if (sub->param_count != sup->param_count) return 0;
+    for (int i = 0; i < sub->param_count; i++) {
+        if (sub->param_types[i].kind != sup->param_types[i].kind ||
+            sub->param_types[i].cls != sup->param_types[i].cls)
+            return 0;
+    }
+    return is_subtype(env, sub->return_type, sup->return_type);
+}
+
+// Make every method a class inherits callable on it: walking classes in
+// pre-order, copy the superclass's entries the class does not override.
+// Constructors are not inherited. Dispatch slots are laid out in the
+// same walk: a class starts from its superclass's table, overriding
+// methods reuse the slot they override and the rest are appended.
+static void inherit_methods(TypeEnv *env) {
+    for (int k = 0; k < env->class_preorder_len; k++) {
+        ClassEntry *e = &env->classes[env->class_preorder[k]];
+        ClassEntry *s = e->super_index < 0 ? NULL : &env->classes[e->super_index];
+        // only the class's own entries are in method_ids so far
+        int own = e->method_id_count;
+        e->vtable_len = s ? s->vtable_len : 0;
+        e->vtable = xmalloc((e->vtable_len + own + 1) * sizeof(int));
+        if (s) memcpy(e->vtable, s->vtable, s->vtable_len * sizeof(int));
+        for (int j = 0; j < own; j++) {
+            MethodEntry *m = &env->methods[e->method_ids[j]];
+            if (m->method_name == SYM_CTOR) continue;
+            int inherited = s ? map_get(&env->method_index, method_key(s->name, m->method_name)) : -1;
+            if (inherited >= 0 && overrides(env, &m->sig, &env->methods[inherited].sig))
+                m->slot = env->methods[inherited].slot;
+            else
+                m->slot = e->vtable_len++;
+            e->vtable[m->slot] = e->method_ids[j];
+        }
+        if (!s) continue;
+        for (int j = 0; j < s->method_id_count; j++) {
+            Symbol mname = env->methods[s->method_ids[j]].method_name;
+            if (mname == SYM_CTOR) continue;
+            if (map_get(&env->method_index, method_key(e->name, mname)) >= 0) continue;
+            int id = map_get(&env->method_index, method_key(s->name, mname));
+            map_put(&env->method_index, method_key(e->name, mname), id);
+            add_class_method(env, env->class_preorder[k], id);
         }
     }
-    return 0;
+}
+
+int lookup_method(const TypeEnv *env, Symbol cls, Symbol mname) {
+    return map_get(&env->method_index, method_key(cls, mname));
+}
+
+// Find a method signature
+static int find_method(const TypeEnv *env, Symbol cls, Symbol mname, MethodSig *out) {
+    int i = lookup_method(env, cls, mname);
+    if (i < 0) return 0;
+    *out = env->methods[i].sig;
+    return 1;
 }
 
 // Find a constructor signature
-static int find_constructor(const char *cls, MethodSig *out) {
-    return find_method(cls, "<ctor>", out);
+static int find_constructor(const TypeEnv *env, Symbol cls, MethodSig *out) {
+    return find_method(env, cls, SYM_CTOR, out);
 }
 
-// Symbol table for variables
-typedef struct VarEntry {
-    char *name;
-    Type  type;
-    struct VarEntry *next;
+// Symbol table for variables: a stack of bindings split into nested
+// scopes, with a hash index from each name to its innermost binding.
+// Every binding gets a frame slot; slots of a closed scope are reused by
+// the next sibling scope, and frame_size records the high-water mark.
+typedef struct {
+    Symbol name;
+    Type   type;
+    int    depth, slot;
+    int    shadowed;       // binding this one hides, or -1
 } VarEntry;
 
 typedef struct {
-    VarEntry *vars;
+    int bindings;          // binding count when the scope opened
+    int next_slot;         // first free slot when the scope opened
+} ScopeMark;
+
+typedef struct SymTable {
+    VarEntry  *vars;
+    int        var_count, var_cap;
+    ScopeMark *scopes;
+    int        depth, scope_cap;
+    int        next_slot, frame_size;
+    IndexMap   index;      // name -> innermost binding; < 0 when unbound
+    int        loop_depth; // enclosing While loops, for Break
 } SymTable;
 
-// Create a new symbol table
+#define UNBOUND (-2)
+
+// Create a new symbol table with its outermost scope open
 static SymTable *create_table() {
-    SymTable *t = malloc(sizeof *t);
-    t->vars = NULL;
+    SymTable *t = xcalloc(1, sizeof *t);
+    t->depth = 0;
     return t;
 }
 
 // Free a symbol table
 static void free_table(SymTable *t) {
-    VarEntry *e = t->vars;
-    while (e) {
-        VarEntry *nx = e->next;
-        free(e->name);
-        free(e);
-        e = nx;
-    }
+    free(t->vars);
+    free(t->scopes);
+    free(t->index.keys);
+    free(t->index.vals);
     free(t);
 }
 
-// Add a variable entry
-static void add_variable(SymTable *t, const char *name, Type ty) {
-    VarEntry *e = malloc(sizeof *e);
-    e->name = strdup(name);
-    e->type = ty;
-    e->next = t->vars;
-    t->vars = e;
+// Enter a nested block
+static void push_scope(SymTable *t) {
+    if (t->depth == t->scope_cap) {
+        t->scope_cap = t->scope_cap ? t->scope_cap * 2 : 8;
+        t->scopes    = xrealloc(t->scopes, t->scope_cap * sizeof *t->scopes);
+    }
+    t->scopes[t->depth].bindings  = t->var_count;
+    t->scopes[t->depth].next_slot = t->next_slot;
+    t->depth++;
 }
 
-// Lookup a variable's type
-static int lookup_variable(SymTable *t, const char *name, Type *out) {
-    for (VarEntry *e = t->vars; e; e = e->next) {
-        if (strcmp(e->name, name) == 0) {
-            *out = e->type;
-            return 1;
-        }
+// Leave a block: drop its bindings and give their slots back
+static void pop_scope(SymTable *t) {
+    t->depth--;
+    ScopeMark m = t->scopes[t->depth];
+    while (t->var_count > m.bindings) {
+        VarEntry *e = &t->vars[--t->var_count];
+        map_put(&t->index, (unsigned)e->name, e->shadowed >= 0 ? e->shadowed : UNBOUND);
     }
-    return 0;
+    t->next_slot = m.next_slot;
 }
 
-// Report a type error and exit
-static void error(const char *msg, ASTNode *n) {
-    fprintf(stderr, "Type error at '%s': %s\n", n->label, msg);
-    exit(EXIT_FAILURE);
+// Add a variable entry in the current scope; records its depth and
+// slot on 'decl' (the declaring identifier) when there is one
+static void add_variable(SymTable *t, Symbol name, Type ty, ASTNode *decl) {
+    if (t->var_count == t->var_cap) {
+        t->var_cap = t->var_cap ? t->var_cap * 2 : 16;
+        t->vars    = xrealloc(t->vars, t->var_cap * sizeof *t->vars);
+    }
+    int prev = map_get(&t->index, (unsigned)name);
+    VarEntry *e = &t->vars[t->var_count];
+    e->name     = name;
+    e->type     = ty;
+    e->depth    = t->depth;
+    e->slot     = t->next_slot++;
+    e->shadowed = prev >= 0 ? prev : -1;
+    if (t->next_slot > t->frame_size) t->frame_size = t->next_slot;
+    map_put(&t->index, (unsigned)name, t->var_count++);
+    if (decl) {
+        decl->depth = e->depth;
+        decl->slot  = e->slot;
+    }
+}
+
+// Lookup a variable's type; resolves 'ref' to the binding's depth and slot
+static int lookup_variable(SymTable *t, Symbol name, Type *out, ASTNode *ref) {
+    int i = map_get(&t->index, (unsigned)name);
+    if (i < 0) return 0;
+    *out = t->vars[i].type;
+    if (ref) {
+        ref->depth = t->vars[i].depth;
+        ref->slot  = t->vars[i].slot;
+    }
+    return 1;
+}
+
+// Report a type error: record it and unwind to whoever set ck->bail
+static _Noreturn void error(Checker *ck, const char *msg, ASTNode *n) {
+    ck->diag.phase       = DIAG_TYPE;
+    ck->diag.message     = msg;
+    ck->diag.near        = n->label;
+    ck->diag.near_length = (int)strlen(n->label);
+    longjmp(ck->bail, 1);
 }
 
 // Build a Type value
-static Type make_type(TypeKind k, const char *cls) {
+static Type make_type(TypeKind k, Symbol cls) {
     Type t;
-    t.kind       = k;
-    t.class_name = cls ? strdup(cls) : NULL;
+    t.kind = k;
+    t.cls  = cls;
     return t;
 }
 
-// Convert ASTNode type to Type
+// Convert ASTNode type to Type; the parser already resolved it
 static Type astnode_to_type(ASTNode *n) {
-    if      (strcmp(n->label, "Int")     == 0) return make_type(TYPE_INT,     NULL);
-    else if (strcmp(n->label, "Boolean") == 0) return make_type(TYPE_BOOLEAN, NULL);
-    else if (strcmp(n->label, "Void")    == 0) return make_type(TYPE_VOID,    NULL);
-    else                                       return make_type(TYPE_CLASS,   n->label);
+    return n->type;
 }
 
 // Forward declarations
-static Type  infer_exp(ASTNode *n, SymTable *tbl);
-static void  typecheck_stmt(ASTNode *n, SymTable *tbl, Type ret_t);
-static void  typecheck_constructor(ASTNode *n, Type class_t);
-static void  typecheck_method(ASTNode *n, Type class_t);
-static void  typecheck_classdef(ASTNode *c);
-
-// Expression type inference
-static Type infer_exp(ASTNode *n, SymTable *tbl) {
+static Type  infer_exp(ASTNode *n, Checker *ck);
+static void  typecheck_stmt(ASTNode *n, Checker *ck, Type ret_t);
+static void  typecheck_constructor(ASTNode *n, Checker *ck, Type class_t);
+static void  typecheck_method(ASTNode *n, Checker *ck, Type class_t);
+static void  collect_signatures(TypeEnv *env, ASTNode *c);
+static void  typecheck_class_bodies(ASTNode *c, Checker *ck);
+
+// Expression type inference; the result is also stored on the node
+static Type infer_exp(ASTNode *n, Checker *ck) {
+    SymTable      *tbl = ck->tbl;
+    const TypeEnv *env = ck->env;
+    Type t = make_type(TYPE_VOID, NO_SYMBOL);
+    switch (n->kind) {
     // this
-    if (strcmp(n->label, "this") == 0) {
-        Type t;
-        if (lookup_variable(tbl, "this", &t)) return t;
-        error("Unexpected 'this'", n);
-    }
+    case NODE_THIS:
+        if (!lookup_variable(tbl, SYM_THIS, &t, n))
+            error(ck, "Unexpected 'this'", n);
+        break;
     // Int literal
-    if (isdigit((unsigned char)n->label[0])) {
-        return make_type(TYPE_INT, NULL);
-    }
+    case NODE_INT_LIT:
+        t = make_type(TYPE_INT, NO_SYMBOL);
+        break;
     // Boolean literal
-    if (!strcmp(n->label, "true") || !strcmp(n->label, "false")) {
-        return make_type(TYPE_BOOLEAN, NULL);
-    }
-    // ! operator
-    if (!strcmp(n->label, "!")) {
-        Type A = infer_exp(n->kids[0], tbl);
-        if (A.kind != TYPE_BOOLEAN)
-            error("Logical '!' requires Boolean", n);
-        return make_type(TYPE_BOOLEAN, NULL);
-    }
-    // && and ||
-    if (!strcmp(n->label, "&&") || !strcmp(n->label, "||")) {
-        Type A = infer_exp(n->kids[0], tbl);
-        Type B = infer_exp(n->kids[1], tbl);
-        if (A.kind!=TYPE_BOOLEAN || B.kind!=TYPE_BOOLEAN)
-            error("Logical '&&' and '||' require Boolean", n);
-        return make_type(TYPE_BOOLEAN, NULL);
-    }
-    // Print/Println function
-    if (!strcmp(n->label, "Print") || !strcmp(n->label, "Println")) {
-        Type A = infer_exp(n->kids[0], tbl);
+    case NODE_TRUE:
+    case NODE_FALSE:
+        t = make_type(TYPE_BOOLEAN, NO_SYMBOL);
+        break;
+    // Println
+    case NODE_PRINTLN: {
+        Type A = infer_exp(n->kids[0], ck);
         if (A.kind != TYPE_INT)
-            error("print expects Int", n);
-        return make_type(TYPE_VOID, NULL);
+            error(ck, "print expects Int", n);
+        t = make_type(TYPE_VOID, NO_SYMBOL);
+        break;
     }
     // Arithmetic operators
-    if (!strcmp(n->label, "+") || !strcmp(n->label, "-") ||
-        !strcmp(n->label, "*") || !strcmp(n->label, "/")) {
-        Type A = infer_exp(n->kids[0], tbl);
-        Type B = infer_exp(n->kids[1], tbl);
+    case NODE_ADD:
+    case NODE_SUB:
+    case NODE_MUL:
+    case NODE_DIV: {
+        Type A = infer_exp(n->kids[0], ck);
+        Type B = infer_exp(n->kids[1], ck);
         if (A.kind!=TYPE_INT || B.kind!=TYPE_INT)
-            error("Arithmetic requires Int", n);
-        return make_type(TYPE_INT, NULL);
+            error(ck, "Arithmetic requires Int", n);
+        t = make_type(TYPE_INT, NO_SYMBOL);
+        break;
     }
     // Comparison operators
-    if (!strcmp(n->label, "<") || !strcmp(n->label, "==")) {
-        Type A = infer_exp(n->kids[0], tbl);
-        Type B = infer_exp(n->kids[1], tbl);
+    case NODE_LESS:
+    case NODE_EQUAL: {
+        Type A = infer_exp(n->kids[0], ck);
+        Type B = infer_exp(n->kids[1], ck);
         if (A.kind!=TYPE_INT || B.kind!=TYPE_INT)
-            error("Comparison requires Int", n);
-        return make_type(TYPE_BOOLEAN, NULL);
+            error(ck, "Comparison requires Int", n);
+        t = make_type(TYPE_BOOLEAN, NO_SYMBOL);
+        break;
     }
     // Method call
-    if (!strcmp(n->label, "Call")) {
-        Type recv = infer_exp(n->kids[0], tbl);
+    case NODE_CALL: {
+        Type recv = infer_exp(n->kids[0], ck);
         if (recv.kind!=TYPE_CLASS)
-            error("Call receiver must be class type", n);
-        const char *mname = n->kids[1]->label;
+            error(ck, "Call receiver must be class type", n);
+        Symbol mname = n->kids[1]->sym;
         MethodSig sig;
-        if (!find_method(recv.class_name, mname, &sig))
-            error("Unknown method", n);
+        if (!find_method(env, recv.cls, mname, &sig))
+            error(ck, "Unknown method", n);
         int argc = n->kid_count - 2;
         if (argc != sig.param_count)
-            error("Incorrect number of arguments", n);
+            error(ck, "Incorrect number of arguments", n);
         for (int i=0; i<argc; i++) {
-            Type at = infer_exp(n->kids[2+i], tbl);
-            if (!is_subtype(at, sig.param_types[i]))
-                error("Argument type mismatch", n);
+            Type at = infer_exp(n->kids[2+i], ck);
+            if (!is_subtype(env, at, sig.param_types[i]))
+                error(ck, "Argument type mismatch", n);
         }
-        return sig.return_type;
+        t = sig.return_type;
+        break;
     }
     // Object creation
-    if (!strcmp(n->label, "New")) {
-        const char *cls = n->kids[0]->label;
-        if (!find_class(cls)) error("Unknown class", n);
+    case NODE_NEW: {
+        Symbol cls = n->kids[0]->sym;
+        if (!find_class(env, cls)) error(ck, "Unknown class", n);
         MethodSig ctor;
-        if (!find_constructor(cls, &ctor))
-            error("No matching constructor", n);
+        if (!find_constructor(env, cls, &ctor))
+            error(ck, "No matching constructor", n);
         int argc = n->kid_count - 1;
         if (argc != ctor.param_count)
-            error("Wrong number of constructor args", n);
+            error(ck, "Wrong number of constructor args", n);
         for (int i=0; i<argc; i++) {
-            Type at = infer_exp(n->kids[1+i], tbl);
-            if (!is_subtype(at, ctor.param_types[i]))
-                error("Constructor argument type mismatch", n);
+            Type at = infer_exp(n->kids[1+i], ck);
+            if (!is_subtype(env, at, ctor.param_types[i]))
+                error(ck, "Constructor argument type mismatch", n);
         }
-        return make_type(TYPE_CLASS, cls);
+        t = make_type(TYPE_CLASS, cls);
+        break;
     }
-
-    // Variable reference (leaf identifiers only)
-    if (n->kid_count == 0 && isalpha((unsigned char)n->label[0])) {
-        Type t;
-        if (lookup_variable(tbl, n->label, &t)) return t;
-        error("Undefined variable", n);
+    // Variable reference
+    case NODE_IDENT:
+        if (!lookup_variable(tbl, n->sym, &t, n))
+            error(ck, "Undefined variable", n);
+        break;
+    // nothing else is an expression
+    default:
+        error(ck, "Unsupported expression", n);
     }
-
-    // nothing else matched
-    error("Unsupported expression", n);
-    return make_type(TYPE_VOID, NULL);
+    n->type = t;
+    return t;
 }
 
 // Statement type checking
-static void typecheck_stmt(ASTNode *n, SymTable *tbl, Type ret_t) {
-    static int loop_depth = 0;
+static void typecheck_stmt(ASTNode *n, Checker *ck, Type ret_t) {
+    SymTable      *tbl = ck->tbl;
+    const TypeEnv *env = ck->env;
+    switch (n->kind) {
     // Variable declaration
-    if (!strcmp(n->label, "VarDec")) {
+    case NODE_VARDEC: {
         Type ty = astnode_to_type(n->kids[0]);
-        add_variable(tbl, n->kids[1]->label, ty);
+        add_variable(tbl, n->kids[1]->sym, ty, n->kids[1]);
         return;
     }
     // Assignment
-    if (!strcmp(n->label, "Assign")) {
+    case NODE_ASSIGN: {
         Type L;
-        if (!lookup_variable(tbl, n->kids[0]->label, &L))
-            error("Assign to undeclared var", n);
-        Type R = infer_exp(n->kids[1], tbl);
-        if (!is_subtype(R, L))
-            error("Type mismatch in assignment", n);
+        if (!lookup_variable(tbl, n->kids[0]->sym, &L, n->kids[0]))
+            error(ck, "Assign to undeclared var", n);
+        n->kids[0]->type = L;
+        Type R = infer_exp(n->kids[1], ck);
+        if (!is_subtype(env, R, L))
+            error(ck, "Type mismatch in assignment", n);
         return;
     }
     // If statement
-    if (!strcmp(n->label, "If")) {
-        Type C = infer_exp(n->kids[0], tbl);
-        if (C.kind!=TYPE_BOOLEAN) error("If cond must be Boolean", n);
-        typecheck_stmt(n->kids[1], tbl, ret_t);
-        if (n->kid_count==3) typecheck_stmt(n->kids[2], tbl, ret_t);
+    case NODE_IF: {
+        Type C = infer_exp(n->kids[0], ck);
+        if (C.kind!=TYPE_BOOLEAN) error(ck, "If cond must be Boolean", n);
+        // each branch is its own block
+        push_scope(tbl);
+        typecheck_stmt(n->kids[1], ck, ret_t);
+        pop_scope(tbl);
+        if (n->kid_count==3) {
+            push_scope(tbl);
+            typecheck_stmt(n->kids[2], ck, ret_t);
+            pop_scope(tbl);
+        }
         return;
     }
     // While loop
-    if (!strcmp(n->label, "While")) {
-        Type C = infer_exp(n->kids[0], tbl);
-        if (C.kind!=TYPE_BOOLEAN) error("While cond must be Boolean", n);
-        loop_depth++;
+    case NODE_WHILE: {
+        Type C = infer_exp(n->kids[0], ck);
+        if (C.kind!=TYPE_BOOLEAN) error(ck, "While cond must be Boolean", n);
+        tbl->loop_depth++;
+        push_scope(tbl);
         for (int i=1; i<n->kid_count; i++)
-            typecheck_stmt(n->kids[i], tbl, ret_t);
-        loop_depth--;
+            typecheck_stmt(n->kids[i], ck, ret_t);
+        pop_scope(tbl);
+        tbl->loop_depth--;
         return;
     }
     // Return statement
-    if (!strcmp(n->label, "Return")) {
+    case NODE_RETURN:
         if (n->kid_count==1) {
-            Type R = infer_exp(n->kids[0], tbl);
-            if (!is_subtype(R, ret_t)) error("Return type mismatch", n);
+            Type R = infer_exp(n->kids[0], ck);
+            if (!is_subtype(env, R, ret_t)) error(ck, "Return type mismatch", n);
         } else {
-            if (ret_t.kind!=TYPE_VOID) error("Missing return value", n);
+            if (ret_t.kind!=TYPE_VOID) error(ck, "Missing return value", n);
         }
         return;
-    }
     // Break statement
-    if (!strcmp(n->label, "Break")) {
-        if (loop_depth == 0) error("Break outside loop", n);
+    case NODE_BREAK:
+        if (tbl->loop_depth == 0) error(ck, "Break outside loop", n);
         return;
-    }
     // Statement list
-    if (!strcmp(n->label, "StmtList")) {
+    case NODE_STMTLIST:
         for (int i=0; i<n->kid_count; i++)
-            typecheck_stmt(n->kids[i], tbl, ret_t);
+            typecheck_stmt(n->kids[i], ck, ret_t);
         return;
-    }
     // Expression statement
-    infer_exp(n, tbl);
+    default:
+        infer_exp(n, ck);
+    }
 }
 
 // Constructor type checking
-static void typecheck_constructor(ASTNode *n, Type class_t) {
-    SymTable *tbl = create_table();
-    add_variable(tbl, "this", class_t);
-    Type void_t = make_type(TYPE_VOID, NULL);
+static void typecheck_constructor(ASTNode *n, Checker *ck, Type class_t) {
+    const TypeEnv *env = ck->env;
+    SymTable *tbl = ck->tbl = create_table();
+    add_variable(tbl, SYM_THIS, class_t, NULL);
+    Type void_t = make_type(TYPE_VOID, NO_SYMBOL);
     for (int i=0; i<n->kid_count; i++) {
         ASTNode *kid = n->kids[i];
-        if (!strcmp(kid->label, "VarDec")) {
+        if (kid->kind == NODE_VARDEC) {
             Type ty = astnode_to_type(kid->kids[0]);
-            add_variable(tbl, kid->kids[1]->label, ty);
-        } else if (!strcmp(kid->label, "SuperCall")) {
-            ClassEntry *ce = find_class(class_t.class_name);
-            if (!ce || !ce->superclass)
-                error("Super call in class with no superclass", kid);
+            add_variable(tbl, kid->kids[1]->sym, ty, kid->kids[1]);
+        } else if (kid->kind == NODE_SUPERCALL) {
+            ClassEntry *ce = find_class(env, class_t.cls);
+            if (!ce || ce->superclass == NO_SYMBOL)
+                error(ck, "Super call in class with no superclass", kid);
             MethodSig super_ctor;
-            if (!find_constructor(ce->superclass, &super_ctor))
-                error("No matching super constructor", kid);
+            if (!find_constructor(env, ce->superclass, &super_ctor))
+                error(ck, "No matching super constructor", kid);
             if (kid->kid_count != super_ctor.param_count)
-                error("Wrong number of arguments for super", kid);
+                error(ck, "Wrong number of arguments for super", kid);
             for (int j=0; j<kid->kid_count; j++) {
-                Type arg_t = infer_exp(kid->kids[j], tbl);
-                if (!is_subtype(arg_t, super_ctor.param_types[j]))
-                    error("Super call argument type mismatch", kid);
+                Type arg_t = infer_exp(kid->kids[j], ck);
+                if (!is_subtype(env, arg_t, super_ctor.param_types[j]))
+                    error(ck, "Super call argument type mismatch", kid);
             }
         } else {
-            typecheck_stmt(kid, tbl, void_t);
+            typecheck_stmt(kid, ck, void_t);
         }
     }
+    n->frame_size = tbl->frame_size;
     free_table(tbl);
+    ck->tbl = NULL;
 }
 
 // Method type checking
-static void typecheck_method(ASTNode *n, Type class_t) {
-    SymTable *tbl = create_table();
-    add_variable(tbl, "this", class_t);
+static void typecheck_method(ASTNode *n, Checker *ck, Type class_t) {
+    SymTable *tbl = ck->tbl = create_table();
+    add_variable(tbl, SYM_THIS, class_t, NULL);
     int idx = 0;
-    while (idx<n->kid_count && !strcmp(n->kids[idx]->label,"VarDec")) {
+    while (idx<n->param_count) {
         ASTNode *p = n->kids[idx++];
         Type ty = astnode_to_type(p->kids[0]);
-        add_variable(tbl, p->kids[1]->label, ty);
+        add_variable(tbl, p->kids[1]->sym, ty, p->kids[1]);
     }
-    if (idx>=n->kid_count) error("Missing return type", n);
+    if (idx>=n->kid_count || n->kids[idx]->kind != NODE_TYPE)
+        error(ck, "Missing return type", n);
     Type ret_t = astnode_to_type(n->kids[idx++]);
     for (; idx<n->kid_count; idx++)
-        typecheck_stmt(n->kids[idx], tbl, ret_t);
+        typecheck_stmt(n->kids[idx], ck, ret_t);
+    n->frame_size = tbl->frame_size;
     free_table(tbl);
+    ck->tbl = NULL;
+}
+
+// Build a signature from the parameter VarDecs of a method or constructor
+static MethodSig collect_sig(ASTNode *m, Type return_type) {
+    int pc = m->param_count;
+    MethodSig sig;
+    sig.param_count = pc;
+    sig.param_types = xmalloc(pc * sizeof(Type));
+    for (int j=0; j<pc; j++)
+        sig.param_types[j] = astnode_to_type(m->kids[j]->kids[0]);
+    sig.return_type = return_type;
+    return sig;
 }
 
-// Class definition checking
-static void typecheck_classdef(ASTNode *c) {
-    const char *cls = c->kids[0]->label;
+// Phase 1: register the signatures a class defines
+static void collect_signatures(TypeEnv *env, ASTNode *c) {
+    Symbol cls = c->kids[0]->sym;
     for (int i=1; i<c->kid_count; i++) {
         ASTNode *m = c->kids[i];
-        if (!strcmp(m->label, "Constructor")) {
-            int pc = 0;
-            while (pc < m->kid_count && !strcmp(m->kids[pc]->label, "VarDec"))
-                pc++;
-            MethodSig sig;
-            sig.param_count = pc;
-            sig.param_types = malloc(pc * sizeof(Type));
-            for (int j=0; j<pc; j++)
-                sig.param_types[j] = astnode_to_type(m->kids[j]->kids[0]);
-            sig.return_type = make_type(TYPE_VOID, NULL);
-            add_method_sig(cls, "<ctor>", sig);
-            typecheck_constructor(m, make_type(TYPE_CLASS, cls));
-        } else if (!strcmp(m->label, "VarDec") || m->kid_count == 0) {
-            // skip fields or standalone superclass
-            continue;
-        } else {
-            int pc = 0;
-            while (pc < m->kid_count && !strcmp(m->kids[pc]->label, "VarDec")) pc++;
-            MethodSig sig;
-            sig.param_count = pc;
-            sig.param_types = malloc(pc * sizeof(Type));
-            for (int j=0; j<pc; j++)
-                sig.param_types[j] = astnode_to_type(m->kids[j]->kids[0]);
-            sig.return_type = astnode_to_type(m->kids[pc]);
-            add_method_sig(cls, m->label, sig);
-            typecheck_method(m, make_type(TYPE_CLASS, cls));
+        switch (m->kind) {
+        case NODE_CONSTRUCTOR:
+            add_method_sig(env, cls, SYM_CTOR, collect_sig(m, make_type(TYPE_VOID, NO_SYMBOL)), m);
+            break;
+        case NODE_METHOD:
+            add_method_sig(env, cls, m->sym, collect_sig(m, astnode_to_type(m->kids[m->param_count])), m);
+            break;
+        default:
+            // skip fields and the superclass name
+            break;
         }
     }
 }
 
-// Program entry point
-void typecheck_program(ASTNode *root) {
+// Phase 2: check constructor and method bodies against the finished
+// tables. Touches only this class's nodes, so classes can run in parallel.
+static void typecheck_class_bodies(ASTNode *c, Checker *ck) {
+    Symbol cls = c->kids[0]->sym;
+    for (int i=1; i<c->kid_count; i++) {
+        ASTNode *m = c->kids[i];
+        if (m->kind == NODE_CONSTRUCTOR)
+            typecheck_constructor(m, ck, make_type(TYPE_CLASS, cls));
+        else if (m->kind == NODE_METHOD)
+            typecheck_method(m, ck, make_type(TYPE_CLASS, cls));
+    }
+}
+
+// Below this many classes the pool costs more than it saves
+#define PARALLEL_MIN_CLASSES 64
+#define CLASSES_PER_TASK     16
+
+// A chunk of classes checked by one task, with its own error slot
+typedef struct {
+    TypeEnv   *env;
+    ASTNode  **defs;
+    int        begin, end;
+    int        failed;
+    Diagnostic diag;
+} BodyRange;
+
+static void check_bodies_task(void *arg) {
+    BodyRange *r = arg;
+    Checker ck;
+    ck.env = r->env;
+    ck.tbl = NULL;
+    clear_diagnostic(&ck.diag);
+    if (setjmp(ck.bail)) {
+        if (ck.tbl) free_table(ck.tbl);
+        r->failed = 1;
+        r->diag   = ck.diag;
+        return;
+    }
+    for (int i = r->begin; i < r->end; i++)
+        typecheck_class_bodies(r->defs[i], &ck);
+}
+
+// Without a pool from the caller, a temporary one is used when the
+// machine has more than one CPU. The error reported is always the first
+// in source order, as if the classes had been checked one by one.
+static void check_all_bodies(Checker *ck, ASTNode **defs, int count, ThreadPool *pool) {
+    ThreadPool *own = NULL;
+    if (count >= PARALLEL_MIN_CLASSES && !pool && default_thread_count() > 1)
+        pool = own = threadpool_create(0);
+    if (count < PARALLEL_MIN_CLASSES || !pool) {
+        for (int i = 0; i < count; i++)
+            typecheck_class_bodies(defs[i], ck);
+        return;
+    }
+    int tasks = (count + CLASSES_PER_TASK - 1) / CLASSES_PER_TASK;
+    BodyRange *ranges = xcalloc(tasks, sizeof *ranges);
+    TaskGroup group;
+    atomic_init(&group.pending, 0);
+    for (int t = 0; t < tasks; t++) {
+        ranges[t].env   = ck->env;
+        ranges[t].defs  = defs;
+        ranges[t].begin = t * CLASSES_PER_TASK;
+        ranges[t].end   = ranges[t].begin + CLASSES_PER_TASK < count
+                        ? ranges[t].begin + CLASSES_PER_TASK : count;
+        threadpool_submit(pool, &group, check_bodies_task, &ranges[t]);
+    }
+    threadpool_wait(pool, &group);
+    threadpool_destroy(own);
+    int failed = -1;
+    for (int t = 0; t < tasks && failed < 0; t++)
+        if (ranges[t].failed) failed = t;
+    if (failed >= 0) ck->diag = ranges[failed].diag;
+    free(ranges);
+    if (failed >= 0) longjmp(ck->bail, 1);
+}
+
+static void check_program(Checker *ck, ASTNode *root, ThreadPool *pool) {
+    TypeEnv *env = ck->env;
     int i = 0;
     // Register classes
-    while (i < root->kid_count && !strcmp(root->kids[i]->label, "ClassDef")) {
+    while (i < root->kid_count && root->kids[i]->kind == NODE_CLASSDEF) {
         ASTNode *c = root->kids[i++];
-        const char *cls = c->kids[0]->label;
+        Symbol cls = c->kids[0]->sym;
         ASTNode *supNode = c->kids[1];
-        const char *sup = NULL;
-        if (strcmp(supNode->label, "VarDec") != 0 &&
-            strcmp(supNode->label, "Constructor") != 0)
-            sup = supNode->label;
-        register_class(cls, sup);
+        Symbol sup = NO_SYMBOL;
+        if (supNode->kind == NODE_IDENT)
+            sup = supNode->sym;
+        register_class(env, cls, sup, c);
     }
-    // Typecheck classes
+    build_hierarchy(ck);
+
+    // Phase 1: every signature is known before any body is checked, so
+    // a class may call methods of classes declared after it
     for (int j = 0; j < i; j++)
-        typecheck_classdef(root->kids[j]);
+        collect_signatures(env, root->kids[j]);
+    inherit_methods(env);
 
-    // Check main statements
-    SymTable *main_tbl = create_table();
-    Type void_t = make_type(TYPE_VOID, NULL);
+    // Phase 2: the tables are read-only from here on
+    check_all_bodies(ck, root->kids, i, pool);
 
-    bool found_stmts = false;
+    // Check main statements
+    ck->tbl = create_table();
+    Type void_t = make_type(TYPE_VOID, NO_SYMBOL);
     while (i < root->kid_count) {
-        if (!strcmp(root->kids[i]->label, "StmtList")) {
-            found_stmts = true;
-            typecheck_stmt(root->kids[i], main_tbl, void_t);
+        if (root->kids[i]->kind == NODE_STMTLIST) {
+            typecheck_stmt(root->kids[i], ck, void_t);
             break;
         }
         i++;
     }
+    root->frame_size = ck->tbl->frame_size;
+    free_table(ck->tbl);
+    ck->tbl = NULL;
+}
 
-    free_table(main_tbl);
-
-    if (!found_stmts) {
-        // no statements to typecheck
-        printf("No statements to typecheck.\n");
+// Program entry point
+TypeEnv *typecheck_program(ASTNode *root, const InternTable *names,
+                           ThreadPool *pool, Diagnostic *diag) {
+    Checker ck;
+    ck.env = xcalloc(1, sizeof *ck.env);
+    ck.env->names = names;
+    ck.tbl = NULL;
+    clear_diagnostic(&ck.diag);
+    // error() lands here
+    if (setjmp(ck.bail)) {
+        if (ck.tbl) free_table(ck.tbl);
+        *diag = ck.diag;
+        free_type_env(ck.env);
+        return NULL;
     }
+    check_program(&ck, root, pool);
+    clear_diagnostic(diag);
+    return ck.env;
+}
 
-    printf("Type checking passed.\n");
+void free_type_env(TypeEnv *env) {
+    if (!env) return;
+    for (int c = 0; c < env->class_count; c++) {
+        free(env->classes[c].method_ids);
+        free(env->classes[c].vtable);
+    }
+    for (int m = 0; m < env->method_count; m++)
+        free(env->methods[m].sig.param_types);
+    free(env->classes);
+    free(env->methods);
+    free(env->class_index.keys);
+    free(env->class_index.vals);
+    free(env->method_index.keys);
+    free(env->method_index.vals);
+    free(env->class_by_symbol);
+    free(env->class_preorder);
+    free(env);
 }
@@ -2,10 +2,17 @@
 #define TYPECHECKER_H
 
 #include "../parser/parser.h"
+#include "../common/threadpool.h"
 
-// Walks the AST rooted at ‘root’ and verifies all types.
-// On a mismatch it will print an error and exit; otherwise,
-// it prints “Type checking passed.”
-void typecheck_program(ASTNode *root);
+// Class hierarchy and method signatures of a checked program
+typedef struct TypeEnv TypeEnv;
+
+// Walks the AST rooted at ‘root’ and verifies all types, recording
+// inferred types and variable slots on the nodes. Returns the program’s
+// environment, or NULL with ‘diag’ describing the first type error.
+// Method bodies of large programs are checked on ‘pool’, which may be NULL.
+TypeEnv *typecheck_program(ASTNode *root, const InternTable *names,
+                           ThreadPool *pool, Diagnostic *diag);
+void     free_type_env(TypeEnv *env);
 
 #endif // TYPECHECKER_H
@@ -0,0 +1,78 @@
+#ifndef TYPEENV_H
+#define TYPEENV_H
+
+#include "typechecker.h"
+
+// Layout of the environment typecheck_program returns. Later phases
+// (code generation, analyses) read it; only the typechecker writes it.
+
+// Method/constructor signature
+typedef struct {
+    int     param_count;
+    Type   *param_types;   // array of length param_count
+    Type    return_type;   // for methods; for ctors, use TYPE_VOID
+} MethodSig;
+
+// Class inheritance environment
+typedef struct ClassEntry {
+    Symbol   name;
+    Symbol   superclass;   // NO_SYMBOL if none
+    ASTNode *def;          // the ClassDef node
+    // filled in by build_hierarchy
+    int      super_index;  // -1 for roots
+    int      first_child, next_sibling;
+    int      pre, post;    // DFS interval: descendants nest inside it
+    // filled in by collect_signatures, inherited methods included
+    int     *method_ids;   // entries of 'methods' callable on this class
+    int      method_id_count, method_id_cap;
+    // filled in by inherit_methods: the method entry in each dispatch
+    // slot; a superclass's table is a prefix of its subclasses'
+    int     *vtable;
+    int      vtable_len;
+} ClassEntry;
+
+// Method signature environment
+typedef struct MethodEntry {
+    Symbol    class_name;
+    Symbol    method_name; // method name or SYM_CTOR
+    MethodSig sig;
+    ASTNode  *def;         // the Method or Constructor node
+    int       slot;        // dispatch slot, -1 for constructors
+} MethodEntry;
+
+// Open-addressing index from a 64-bit key to an entry number
+typedef struct {
+    unsigned long long *keys;
+    int      *vals;        // -1 marks an empty slot
+    unsigned  mask;
+    int       count;
+} IndexMap;
+
+// Class and method environment of one program. Entries live in growable
+// arrays; the maps index them by name.
+struct TypeEnv {
+    const InternTable *names;
+    ClassEntry  *classes;
+    int          class_count, class_cap;
+    IndexMap     class_index;
+    MethodEntry *methods;
+    int          method_count, method_cap;
+    IndexMap     method_index;
+
+    // Dense Symbol -> class index table, -1 for names that are not classes
+    int *class_by_symbol;
+    int  class_by_symbol_len;
+    // Live classes in DFS pre-order, superclasses before their subclasses
+    int *class_preorder;
+    int  class_preorder_len;
+};
+
+// Index of the class a name refers to, or -1
+int class_number(const TypeEnv *env, Symbol name);
+// Entry of the method 'mname' callable on class 'cls', inherited ones
+// included; SYM_CTOR finds the class's own constructor. -1 if none.
+int lookup_method(const TypeEnv *env, Symbol cls, Symbol mname);
+// Whether 'sub' names 'super' or one of its subclasses
+int is_subclass(const TypeEnv *env, Symbol sub, Symbol super);
+
+#endif // TYPEENV_H
@@ -0,0 +1,132 @@
+#include "vm.h"
+#include "../compiler/compiler.h"
+#include "../common/xalloc.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Inlining benchmark: loops whose body is a few calls to accessor-style
+// methods, compiled with inlining off, with depth 1 and with the default
+// budget. Times each on the VM, best of three.
+//
+//   ./bench_inline [iterations]
+
+#define CALLS 4   // call sites per iteration
+
+typedef struct {
+    char  *data;
+    size_t length, capacity;
+} Buffer;
+
+__attribute__((format(printf, 2, 3)))
+static void append(Buffer *b, const char *fmt, ...) {
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(b->data + b->length, b->capacity - b->length, fmt, ap);
+        va_end(ap);
+        if (b->length + n < b->capacity) {
+            b->length += n;
+            return;
+        }
+        b->capacity = b->capacity ? b->capacity * 2 : 1 << 12;
+        b->data = xrealloc(b->data, b->capacity);
+    }
+}
+
+typedef struct {
+    const char *name;
+    const char *classes;   // defines class P
+    const char *call;      // an Int expression over p and sum
+} Workload;
+
+static const Workload workloads[] = {
+    { "constant",
+      "(class P ()\n  (init ())\n  (method size () Int (return 8)))\n",
+      "(+ sum (call p size))" },
+    { "arithmetic",
+      "(class P ()\n  (init ())\n  (method scale ((vardec Int n)) Int (return (- (* n 3) (* n 2)))))\n",
+      "(+ (call p scale sum) 1)" },
+    { "inherited",
+      // P's subclasses keep its getter, so the call is still monomorphic
+      "(class Shape ()\n  (init ())\n  (method sides () Int (return 4)))\n"
+      "(class P Shape ()\n  (init () (super)))\n"
+      "(class R P ()\n  (init () (super)))\n",
+      "(+ sum (call p sides))" },
+    { "nested",
+      // three accessors deep, for the depth budget
+      "(class P ()\n  (init ())\n"
+      "  (method a ((vardec Int n)) Int (return (call this b (+ n 1))))\n"
+      "  (method b ((vardec Int n)) Int (return (call this c (+ n 1))))\n"
+      "  (method c ((vardec Int n)) Int (return (- n 1))))\n",
+      "(call p a sum)" },
+};
+#define WORKLOADS (int)(sizeof workloads / sizeof *workloads)
+
+static char *generate(const Workload *w, int iterations) {
+    Buffer b = { 0 };
+    append(&b, "%s(vardec P p)\n(vardec Int i)\n(vardec Int sum)\n(= p (new P))\n(= i 0)\n(= sum 0)\n"
+               "(while (< i %d)\n", w->classes, iterations);
+    for (int call = 0; call < CALLS; call++)
+        append(&b, "  (= sum %s)\n", w->call);
+    append(&b, "  (= sum (- sum (* (/ sum 1000000) 1000000)))\n  (= i (+ i 1)))\n(println sum)\n");
+    return b.data;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Compiles 'source' with 'budget' and runs it with println going
+// nowhere; returns the best time in seconds
+static double timed_run(const char *source, InlineBudget budget, InlineStats *stats) {
+    CompilerContext *ctx = compiler_create(NULL);
+    if (compile_source(ctx, source) != 0) {
+        print_diagnostic(stderr, &ctx->diag);
+        exit(EXIT_FAILURE);
+    }
+    ctx->inline_budget = budget;
+    OptReport report;
+    compiler_optimize(ctx, &report);
+    *stats = report.inlining;
+    VMProgram *prog = compile_bytecode(ctx->ast, ctx->types, VM_INLINE_CACHES);
+
+    FILE *sink = fopen("/dev/null", "w");
+    double best = 0;
+    for (int run = 0; run < 3; run++) {
+        const char *error;
+        double t0 = now();
+        int status = run_bytecode(prog, sink, &error);
+        double t = now() - t0;
+        if (status != 0) {
+            fprintf(stderr, "Runtime error: %s\n", error);
+            exit(EXIT_FAILURE);
+        }
+        if (run == 0 || t < best) best = t;
+    }
+    fclose(sink);
+    free_bytecode(prog);
+    compiler_destroy(ctx);
+    return best;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000000;
+    const InlineBudget off = { 0, 0 }, shallow = { 12, 1 }, full = DEFAULT_INLINE_BUDGET;
+    printf("%-11s %10s %10s %10s %8s %8s\n", "workload", "calls ms", "depth1 ms", "inline ms", "speedup", "inlined");
+    for (int k = 0; k < WORKLOADS; k++) {
+        char *source = generate(&workloads[k], iterations);
+        InlineStats stats;
+        double plain_time   = timed_run(source, off, &stats);
+        double shallow_time = timed_run(source, shallow, &stats);
+        double full_time    = timed_run(source, full, &stats);
+        printf("%-11s %10.1f %10.1f %10.1f %7.2fx %8d\n", workloads[k].name, plain_time * 1e3,
+               shallow_time * 1e3, full_time * 1e3, plain_time / full_time, stats.inlined);
+        free(source);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+#include "vm.h"
+#include "../compiler/compiler.h"
+#include "../common/xalloc.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Polymorphic dispatch benchmark for the inline caches: call sites in a
+// loop whose receiver rotates through K subclasses of Animal, for K from
+// 1 (monomorphic) past PIC_SIZE (megamorphic). Times the loop with and
+// without inline caches, best of three, and prints the cache counters
+// summed over the three runs.
+//
+//   ./bench_pic [iterations]
+
+static const char *const species[] = { "Cat", "Dog", "Cow", "Pig", "Hen", "Owl" };
+#define SPECIES (int)(sizeof species / sizeof *species)
+#define CALLS   4   // call sites per iteration
+
+typedef struct {
+    char  *data;
+    size_t length, capacity;
+} Buffer;
+
+__attribute__((format(printf, 2, 3)))
+static void append(Buffer *b, const char *fmt, ...) {
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(b->data + b->length, b->capacity - b->length, fmt, ap);
+        va_end(ap);
+        if (b->length + n < b->capacity) {
+            b->length += n;
+            return;
+        }
+        b->capacity = b->capacity ? b->capacity * 2 : 1 << 12;
+        b->data = xrealloc(b->data, b->capacity);
+    }
+}
+
+static char *generate(int kinds, int iterations) {
+    Buffer b = { 0 };
+    append(&b, "(class Animal ()\n  (init ())\n  (method speak ((vardec Int n)) Int (return n)))\n");
+    for (int s = 0; s < SPECIES; s++)
+        append(&b, "(class %s Animal ()\n  (init () (super))\n"
+                   "  (method speak ((vardec Int n)) Int (return (+ n %d))))\n", species[s], s + 1);
+    for (int s = 0; s < kinds; s++)
+        append(&b, "(vardec Animal a%d)\n(= a%d (new %s))\n", s, s, species[s]);
+    append(&b, "(vardec Animal x)\n(vardec Int i)\n(vardec Int k)\n(vardec Int sum)\n"
+               "(= i 0)\n(= sum 0)\n(while (< i %d)\n  (= k (- i (* (/ i %d) %d)))\n",
+           iterations, kinds, kinds);
+    for (int s = 0; s < kinds; s++)
+        append(&b, "  (if (== k %d) (= x a%d))\n", s, s);
+    for (int call = 0; call < CALLS; call++)
+        append(&b, "  (= sum (call x speak sum))\n");
+    append(&b, "  (= i (+ i 1)))\n(println sum)\n");
+    return b.data;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs 'prog' with println going nowhere; returns the best time in
+// seconds
+static double timed_run(VMProgram *prog) {
+    FILE *sink = fopen("/dev/null", "w");
+    double best = 0;
+    for (int run = 0; run < 3; run++) {
+        const char *error;
+        double t0 = now();
+        int status = run_bytecode(prog, sink, &error);
+        double t = now() - t0;
+        if (status != 0) {
+            fprintf(stderr, "Runtime error: %s\n", error);
+            exit(EXIT_FAILURE);
+        }
+        if (run == 0 || t < best) best = t;
+    }
+    fclose(sink);
+    return best;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000000;
+    printf("%-8s %-12s %10s %10s %8s %12s %10s\n", "classes", "site", "vtable ms", "cached ms",
+           "ratio", "hits", "misses");
+    for (int kinds = 1; kinds <= SPECIES; kinds++) {
+        char *source = generate(kinds, iterations);
+        CompilerContext *ctx = compiler_create(NULL);
+        if (compile_source(ctx, source) != 0) {
+            print_diagnostic(stderr, &ctx->diag);
+            return EXIT_FAILURE;
+        }
+        OptReport report;
+        compiler_optimize(ctx, &report);
+        VMProgram *plain  = compile_bytecode(ctx->ast, ctx->types, 0);
+        VMProgram *cached = compile_bytecode(ctx->ast, ctx->types, VM_INLINE_CACHES);
+        double plain_time  = timed_run(plain);
+        double cached_time = timed_run(cached);
+
+        // the loop's call sites are the only ones that see several classes
+        static const char *const states[] = { "empty", "monomorphic", "polymorphic", "megamorphic" };
+        CacheStats cs;
+        inline_cache_stats(cached, &cs);
+        int state = SITE_EMPTY;
+        for (int s = SITE_EMPTY; s <= SITE_MEGAMORPHIC; s++)
+            if (cs.sites[s]) state = s;
+        printf("%-8d %-12s %10.1f %10.1f %7.2fx %12llu %10llu\n", kinds, states[state], plain_time * 1e3,
+               cached_time * 1e3, plain_time / cached_time, (unsigned long long)cs.hits,
+               (unsigned long long)cs.misses);
+
+        free_bytecode(plain);
+        free_bytecode(cached);
+        compiler_destroy(ctx);
+        free(source);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,121 @@
+#include "vm.h"
+#include "../compiler/compiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Runs a few programs on the bytecode VM and on the tree walker, checks
+// that both print the same thing, and compares the times.
+//
+//   ./bench_vm [scale]
+//
+// 'scale' multiplies the loop counts (default 1).
+
+typedef struct {
+    const char *name;
+    const char *format;     // source, with %d for the iteration count
+    int         count;
+} Program;
+
+static const Program programs[] = {
+    { "fib", "(class Fib ()\n"
+             "  (init ())\n"
+             "  (method fib ((vardec Int n)) Int\n"
+             "    (if (< n 2) (return n))\n"
+             "    (return (+ (call this fib (- n 1)) (call this fib (- n 2))))))\n"
+             "(vardec Fib f)\n"
+             "(= f (new Fib))\n"
+             "(println (call f fib %d))\n",
+      27 },
+    { "loop", "(vardec Int i)\n"
+              "(vardec Int sum)\n"
+              "(= i 0)\n"
+              "(= sum 0)\n"
+              "(while (< i %d)\n"
+              "  (= sum (+ sum (/ (* i 7) 3)))\n"
+              "  (if (== (- i (* (/ i 5) 5)) 0) (= sum (- sum i)))\n"
+              "  (= i (+ i 1)))\n"
+              "(println sum)\n",
+      10000000 },
+    { "dispatch", "(class Animal ()\n"
+                  "  (init ())\n"
+                  "  (method speak ((vardec Int n)) Int (return (+ n 1))))\n"
+                  "(class Cat Animal ()\n"
+                  "  (init () (super))\n"
+                  "  (method speak ((vardec Int n)) Int (return (+ n 2))))\n"
+                  "(class Dog Animal ()\n"
+                  "  (init () (super))\n"
+                  "  (method speak ((vardec Int n)) Int (return (+ n 3))))\n"
+                  "(vardec Animal a)\n"
+                  "(vardec Animal b)\n"
+                  "(vardec Int i)\n"
+                  "(vardec Int sum)\n"
+                  "(= a (new Cat))\n"
+                  "(= b (new Dog))\n"
+                  "(= i 0)\n"
+                  "(= sum 0)\n"
+                  "(while (< i %d)\n"
+                  "  (= sum (call a speak sum))\n"
+                  "  (= sum (call b speak sum))\n"
+                  "  (= i (+ i 1)))\n"
+                  "(println sum)\n",
+      3000000 },
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    int scale = argc > 1 ? atoi(argv[1]) : 1;
+    if (scale < 1) scale = 1;
+    int status = EXIT_SUCCESS;
+    printf("%-10s %12s %12s %8s\n", "program", "tree ms", "vm ms", "speedup");
+    for (size_t p = 0; p < sizeof programs / sizeof *programs; p++) {
+        const Program *prog = &programs[p];
+        // fib grows exponentially, so it is not scaled
+        int count = prog->count * (strcmp(prog->name, "fib") == 0 ? 1 : scale);
+        char source[4096];
+        snprintf(source, sizeof source, prog->format, count);
+
+        CompilerContext *ctx = compiler_create(NULL);
+        if (compile_source(ctx, source) != 0) {
+            print_diagnostic(stderr, &ctx->diag);
+            return EXIT_FAILURE;
+        }
+        OptReport report;
+        compiler_optimize(ctx, &report);
+        VMProgram *code = compile_bytecode(ctx->ast, ctx->types, VM_INLINE_CACHES);
+
+        char *tree_out, *vm_out;
+        size_t tree_len, vm_len;
+        const char *error = NULL;
+        FILE *out = open_memstream(&tree_out, &tree_len);
+        double t0 = now();
+        int tree_status = run_tree(ctx->ast, ctx->types, out, &error);
+        double tree_time = now() - t0;
+        fclose(out);
+
+        out = open_memstream(&vm_out, &vm_len);
+        t0 = now();
+        int vm_status = run_bytecode(code, out, &error);
+        double vm_time = now() - t0;
+        fclose(out);
+
+        if (tree_status != vm_status || strcmp(tree_out, vm_out) != 0) {
+            fprintf(stderr, "%s: the VM and the tree walker disagree\n", prog->name);
+            status = EXIT_FAILURE;
+        } else {
+            printf("%-10s %12.1f %12.1f %7.1fx\n", prog->name, tree_time * 1e3, vm_time * 1e3,
+                   tree_time / vm_time);
+        }
+        free(tree_out);
+        free(vm_out);
+        free_bytecode(code);
+        compiler_destroy(ctx);
+    }
+    return status;
+}
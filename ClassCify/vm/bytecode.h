@@ -0,0 +1,114 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "vm.h"
+#include "../typechecker/typeenv.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Tagged values. The low 3 bits give the kind; Ints and Booleans carry
+// their payload in the upper 32 bits, so neither is ever boxed. Objects
+// are pointers, at least 8-aligned, with tag 0; null is 0.
+typedef uint64_t Value;
+enum { TAG_OBJECT = 0, TAG_INT = 1, TAG_BOOL = 2, TAG_UNIT = 3 };
+
+#define VALUE_TAG(v)  ((v) & 7)
+#define INT_VALUE(i)  (((uint64_t)(uint32_t)(i) << 32) | TAG_INT)
+#define AS_INT(v)     ((int32_t)((v) >> 32))
+#define BOOL_VALUE(b) (((uint64_t)((b) != 0) << 32) | TAG_BOOL)
+#define AS_BOOL(v)    ((int)((v) >> 32))
+#define UNIT_VALUE    ((Value)TAG_UNIT)
+#define NULL_VALUE    ((Value)0)
+
+// Heap object: the language has no field access, so fields are only
+// allocated, zeroed, to give objects their real size. The header is just
+// the class; virtual calls find the vtable through it.
+typedef struct {
+    int32_t class_index;        // TypeEnv class entry
+    Value   fields[];
+} Object;
+
+#define AS_OBJECT(v) ((Object *)(uintptr_t)(v))
+
+// Instruction set. a, b and c are registers of the current frame unless
+// noted; imm is a 32-bit immediate.
+//   CALL/CALLD: the receiver is in b and the c arguments in b+1..b+c,
+//   which become registers 0..c of the callee; the result goes to a.
+#define OPCODES(X) \
+    X(MOVE)     /* a = b */                                       \
+    X(LOADI)    /* a = Int imm */                                 \
+    X(LOADB)    /* a = Boolean imm */                             \
+    X(LOADNIL)  /* a = null */                                    \
+    X(LOADUNIT) /* a = the Void value */                          \
+    X(ADD)      /* a = b + c, wrapping */                         \
+    X(SUB)                                                        \
+    X(MUL)                                                        \
+    X(DIV)      /* traps on c == 0 */                             \
+    X(LT)       /* a = b < c */                                   \
+    X(EQ)       /* a = b == c */                                  \
+    X(JMP)      /* pc = imm */                                    \
+    X(JFALSE)   /* if !a: pc = imm */                             \
+    X(PRINT)    /* println a */                                   \
+    X(NEW)      /* a = new object of class imm, fields zeroed */  \
+    X(NEWF)     /* the same, built in registers from b on */      \
+    X(CHECK)    /* traps if a is null, for an inlined call */     \
+    X(CALL)     /* a = virtual call through vtable slot imm */    \
+    X(CALLIC)   /* a = virtual call through call site imm */      \
+    X(CALLD)    /* a = direct call of function imm */             \
+    X(RET)      /* return a */                                    \
+    X(RETVOID)                                                    \
+    X(NORET)    /* fell off the end of a non-Void method */       \
+    X(HALT)     /* end of the program */
+
+#define OPCODE_ENUM(name) OP_##name,
+typedef enum { OPCODES(OPCODE_ENUM) OP_COUNT } Opcode;
+#undef OPCODE_ENUM
+
+typedef struct {
+    uint8_t  op;
+    uint16_t a, b, c;
+    int32_t  imm;
+} Instr;
+
+typedef struct {
+    Instr *code;
+    int    code_len, code_cap;
+    int    nregs;           // locals (typechecker slots), frame objects, then temporaries
+    int    method;          // TypeEnv method entry, -1 for the program body
+    char  *name;            // "Class.method", "Class.<init>" or "<main>"
+    char  *noret_message;   // runtime error for NORET
+} Function;
+
+typedef struct {
+    int32_t *vtable;        // function index per slot
+    int      vtable_len;
+    int      field_count;   // inherited fields included
+} VMClass;
+
+// Inline cache of one CALLIC site: the functions its receivers'
+// classes dispatched to. A site starts empty, is monomorphic after its
+// first call and polymorphic from the second class on. A class beyond
+// PIC_SIZE makes it megamorphic: the entries are dropped and every call
+// goes through the vtable again. Unused entries hold class -1.
+#define PIC_SIZE 4
+
+typedef struct {
+    int32_t  classes[PIC_SIZE];  // receiver class index per entry
+    int32_t  targets[PIC_SIZE];  // function index per entry
+    int32_t  slot;               // vtable slot, for misses
+    uint8_t  entries;
+    uint8_t  state;              // SiteState
+    uint64_t hits, misses;
+} CallSite;
+
+struct VMProgram {
+    const TypeEnv *env;
+    Function      *functions;
+    int            function_count;
+    int            main;        // index of the program body
+    VMClass       *classes;     // indexed like env->classes
+    CallSite      *sites;       // CALLIC operands
+    int            site_count, site_cap;
+};
+
+#endif // BYTECODE_H
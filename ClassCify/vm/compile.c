@@ -0,0 +1,432 @@
+#include "vm.h"
+#include "bytecode.h"
+#include "../common/xalloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Compilation state of one function
+typedef struct {
+    const TypeEnv *env;
+    VMProgram     *prog;
+    int           *function_of;  // method entry -> function index, -1 if unused
+    Function      *fn;
+    int            top;          // first free temporary register
+    Type           ret;
+    int            in_main;
+    int            flags;        // compile_bytecode flags
+    int           *breaks;       // JMPs to patch to the end of their loop
+    int            break_count, break_cap;
+    int           *objects;      // frame object -> its first register
+    int            object_cap;
+} Compiler;
+
+static int emit(Compiler *c, Opcode op, int a, int b, int cc, int32_t imm) {
+    Function *fn = c->fn;
+    if (fn->code_len == fn->code_cap) {
+        fn->code_cap = fn->code_cap ? fn->code_cap * 2 : 32;
+        fn->code     = xrealloc(fn->code, fn->code_cap * sizeof *fn->code);
+    }
+    Instr *i = &fn->code[fn->code_len];
+    i->op  = (uint8_t)op;
+    i->a   = (uint16_t)a;
+    i->b   = (uint16_t)b;
+    i->c   = (uint16_t)cc;
+    i->imm = imm;
+    return fn->code_len++;
+}
+
+static int here(const Compiler *c) {
+    return c->fn->code_len;
+}
+
+static void patch(Compiler *c, int at, int target) {
+    c->fn->code[at].imm = target;
+}
+
+// Reserves 'count' consecutive temporaries and returns the first
+static int alloc_regs(Compiler *c, int count) {
+    int r = c->top;
+    c->top += count;
+    if (c->top > c->fn->nregs) c->fn->nregs = c->top;
+    return r;
+}
+
+static void compile_exp_to(Compiler *c, const ASTNode *n, int dest);
+
+// Register holding the value of 'n': a local's own slot, or a new temporary
+static int compile_exp(Compiler *c, const ASTNode *n) {
+    if (n->kind == NODE_IDENT) return n->slot;
+    if (n->kind == NODE_THIS) return 0;
+    int r = alloc_regs(c, 1);
+    compile_exp_to(c, n, r);
+    return r;
+}
+
+// Evaluates the receiver into 'base' and the arguments n->kids[first..]
+// into the registers after it
+static int compile_args(Compiler *c, const ASTNode *n, int first, int base) {
+    int argc = n->kid_count - first;
+    for (int i = 0; i < argc; i++)
+        compile_exp_to(c, n->kids[first + i], base + 1 + i);
+    return argc;
+}
+
+static int add_call_site(VMProgram *prog, int slot) {
+    if (prog->site_count == prog->site_cap) {
+        prog->site_cap = prog->site_cap ? prog->site_cap * 2 : 16;
+        prog->sites    = xrealloc(prog->sites, prog->site_cap * sizeof *prog->sites);
+    }
+    CallSite *site = &prog->sites[prog->site_count];
+    memset(site, 0, sizeof *site);
+    for (int k = 0; k < PIC_SIZE; k++) site->classes[k] = -1;
+    site->slot = slot;
+    return prog->site_count++;
+}
+
+static void compile_call(Compiler *c, const ASTNode *n, int dest) {
+    int save = c->top;
+    int base = alloc_regs(c, n->kid_count - 1);
+    compile_exp_to(c, n->kids[0], base);
+    int argc = compile_args(c, n, 2, base);
+    if (n->target >= 0) {
+        emit(c, OP_CALLD, dest, base, argc, c->function_of[n->target]);
+    } else {
+        int id = lookup_method(c->env, n->kids[0]->type.cls, n->kids[1]->sym);
+        int slot = c->env->methods[id].slot;
+        if (c->flags & VM_INLINE_CACHES)
+            emit(c, OP_CALLIC, dest, base, argc, add_call_site(c->prog, slot));
+        else
+            emit(c, OP_CALL, dest, base, argc, slot);
+    }
+    c->top = save;
+}
+
+// Runs constructor 'ctor' on the object in 'base' with the arguments
+// from n->kids[first..]
+static void compile_init(Compiler *c, const ASTNode *n, int first, int base, int ctor) {
+    int argc = compile_args(c, n, first, base);
+    // constructors return Void; the register after the arguments takes it
+    int scratch = alloc_regs(c, 1);
+    emit(c, OP_CALLD, scratch, base, argc, c->function_of[ctor]);
+}
+
+static void compile_exp_to(Compiler *c, const ASTNode *n, int dest) {
+    switch (n->kind) {
+    case NODE_INT_LIT:
+        emit(c, OP_LOADI, dest, 0, 0, n->int_value);
+        return;
+    case NODE_TRUE:
+    case NODE_FALSE:
+        emit(c, OP_LOADB, dest, 0, 0, n->kind == NODE_TRUE);
+        return;
+    case NODE_IDENT:
+    case NODE_THIS: {
+        int r = n->kind == NODE_THIS ? 0 : n->slot;
+        if (r != dest) emit(c, OP_MOVE, dest, r, 0, 0);
+        return;
+    }
+    case NODE_PRINTLN: {
+        int save = c->top;
+        emit(c, OP_PRINT, compile_exp(c, n->kids[0]), 0, 0, 0);
+        emit(c, OP_LOADUNIT, dest, 0, 0, 0);
+        c->top = save;
+        return;
+    }
+    case NODE_CALL:
+        compile_call(c, n, dest);
+        return;
+    case NODE_INLINED: {
+        // the bindings' registers are frame slots inline_calls added
+        int save = c->top;
+        int last = n->kid_count - 1;
+        for (int i = 0; i < last; i++) {
+            const ASTNode *bind = n->kids[i];
+            if (bind->kind == NODE_ASSIGN) compile_exp_to(c, bind->kids[1], bind->kids[0]->slot);
+        }
+        const ASTNode *recv = n->kids[0];
+        if (recv->kind == NODE_ASSIGN) recv = recv->kids[0];
+        if (recv->kind != NODE_THIS) emit(c, OP_CHECK, compile_exp(c, recv), 0, 0, 0);
+        compile_exp_to(c, n->kids[last], dest);
+        c->top = save;
+        return;
+    }
+    case NODE_NEW: {
+        int save = c->top;
+        Symbol cls = n->kids[0]->sym;
+        int base = alloc_regs(c, n->kid_count);
+        if (n->alloc == ALLOC_HEAP)
+            emit(c, OP_NEW, base, 0, 0, class_number(c->env, cls));
+        else
+            emit(c, OP_NEWF, base, c->objects[n->alloc], 0, class_number(c->env, cls));
+        compile_init(c, n, 1, base, lookup_method(c->env, cls, SYM_CTOR));
+        emit(c, OP_MOVE, dest, base, 0, 0);
+        c->top = save;
+        return;
+    }
+    default: {
+        int save = c->top;
+        int a = compile_exp(c, n->kids[0]);
+        int b = compile_exp(c, n->kids[1]);
+        Opcode op;
+        switch (n->kind) {
+        case NODE_ADD:  op = OP_ADD; break;
+        case NODE_SUB:  op = OP_SUB; break;
+        case NODE_MUL:  op = OP_MUL; break;
+        case NODE_DIV:  op = OP_DIV; break;
+        case NODE_LESS: op = OP_LT;  break;
+        default:        op = OP_EQ;  break;
+        }
+        emit(c, op, dest, a, b, 0);
+        c->top = save;
+        return;
+    }
+    }
+}
+
+static void compile_stmt(Compiler *c, const ASTNode *n) {
+    int save = c->top;
+    switch (n->kind) {
+    case NODE_VARDEC: {
+        int r = n->kids[1]->slot;
+        switch (n->kids[0]->type.kind) {
+        case TYPE_INT:     emit(c, OP_LOADI, r, 0, 0, 0);   break;
+        case TYPE_BOOLEAN: emit(c, OP_LOADB, r, 0, 0, 0);   break;
+        case TYPE_CLASS:   emit(c, OP_LOADNIL, r, 0, 0, 0); break;
+        default:           emit(c, OP_LOADUNIT, r, 0, 0, 0); break;
+        }
+        break;
+    }
+    case NODE_ASSIGN:
+        compile_exp_to(c, n->kids[1], n->kids[0]->slot);
+        break;
+    case NODE_IF: {
+        int skip = emit(c, OP_JFALSE, compile_exp(c, n->kids[0]), 0, 0, 0);
+        c->top = save;
+        compile_stmt(c, n->kids[1]);
+        if (n->kid_count == 3) {
+            int end = emit(c, OP_JMP, 0, 0, 0, 0);
+            patch(c, skip, here(c));
+            compile_stmt(c, n->kids[2]);
+            patch(c, end, here(c));
+        } else {
+            patch(c, skip, here(c));
+        }
+        break;
+    }
+    case NODE_WHILE: {
+        int outer = c->break_count;
+        int start = here(c);
+        int exit = emit(c, OP_JFALSE, compile_exp(c, n->kids[0]), 0, 0, 0);
+        c->top = save;
+        for (int i = 1; i < n->kid_count; i++)
+            compile_stmt(c, n->kids[i]);
+        emit(c, OP_JMP, 0, 0, 0, start);
+        patch(c, exit, here(c));
+        while (c->break_count > outer)
+            patch(c, c->breaks[--c->break_count], here(c));
+        break;
+    }
+    case NODE_BREAK:
+        if (c->break_count == c->break_cap) {
+            c->break_cap = c->break_cap ? c->break_cap * 2 : 16;
+            c->breaks    = xrealloc(c->breaks, c->break_cap * sizeof(int));
+        }
+        c->breaks[c->break_count++] = emit(c, OP_JMP, 0, 0, 0, 0);
+        break;
+    case NODE_RETURN: {
+        int r = n->kid_count == 1 ? compile_exp(c, n->kids[0]) : -1;
+        if (c->in_main)
+            emit(c, OP_HALT, 0, 0, 0, 0);
+        else if (c->ret.kind == TYPE_VOID)
+            emit(c, OP_RETVOID, 0, 0, 0, 0);
+        else
+            emit(c, OP_RET, r, 0, 0, 0);
+        break;
+    }
+    case NODE_STMTLIST:
+        for (int i = 0; i < n->kid_count; i++)
+            compile_stmt(c, n->kids[i]);
+        break;
+    default:
+        // Call or Println for its effect
+        compile_exp_to(c, n, alloc_regs(c, 1));
+        break;
+    }
+    c->top = save;
+}
+
+// Objects of every class get their inherited fields too
+static int count_fields(const TypeEnv *env, int cls) {
+    int count = 0;
+    for (; cls >= 0; cls = env->classes[cls].super_index) {
+        const ASTNode *def = env->classes[cls].def;
+        for (int i = 1; i < def->kid_count; i++)
+            count += def->kids[i]->kind == NODE_VARDEC;
+    }
+    return count;
+}
+
+// Gives each frame object in 'n' its registers from 'next' on, an
+// Object header and then its fields; returns the first register after
+// them. They sit below every temporary, so no callee window covers them.
+static int layout_frame_objects(Compiler *c, const ASTNode *n, int next) {
+    if (n->kind == NODE_NEW && n->alloc != ALLOC_HEAP) {
+        if (n->alloc >= c->object_cap) {
+            c->object_cap = n->alloc * 2 + 8;
+            c->objects    = xrealloc(c->objects, c->object_cap * sizeof *c->objects);
+        }
+        c->objects[n->alloc] = next;
+        next += 1 + count_fields(c->env, class_number(c->env, n->kids[0]->sym));
+    }
+    for (int i = 0; i < n->kid_count; i++)
+        next = layout_frame_objects(c, n->kids[i], next);
+    return next;
+}
+
+static void compile_function(Compiler *c, int f) {
+    Function *fn = &c->prog->functions[f];
+    const MethodEntry *m = &c->env->methods[fn->method];
+    const ASTNode *def = m->def;
+    c->fn      = fn;
+    c->ret     = m->sig.return_type;
+    c->in_main = 0;
+    int temps  = layout_frame_objects(c, def, def->frame_size);
+    c->top     = fn->nregs = temps;
+    int i = def->param_count;
+    if (m->method_name == SYM_CTOR) {
+        if (i < def->kid_count && def->kids[i]->kind == NODE_SUPERCALL) {
+            const ASTNode *sup = def->kids[i++];
+            const ClassEntry *cls = &c->env->classes[class_number(c->env, m->class_name)];
+            int base = alloc_regs(c, sup->kid_count + 1);
+            emit(c, OP_MOVE, base, 0, 0, 0);
+            compile_init(c, sup, 0, base, lookup_method(c->env, cls->superclass, SYM_CTOR));
+            c->top = temps;
+        }
+    } else {
+        i++;   // the return type
+    }
+    for (; i < def->kid_count; i++)
+        compile_stmt(c, def->kids[i]);
+    emit(c, c->ret.kind == TYPE_VOID ? OP_RETVOID : OP_NORET, 0, 0, 0, 0);
+}
+
+static int add_function(VMProgram *prog, int method, char *name) {
+    Function *fn = &prog->functions[prog->function_count];
+    memset(fn, 0, sizeof *fn);
+    fn->method = method;
+    fn->name   = name;
+    return prog->function_count++;
+}
+
+VMProgram *compile_bytecode(const ASTNode *root, const TypeEnv *env, int flags) {
+    VMProgram *prog = xcalloc(1, sizeof *prog);
+    prog->env       = env;
+    prog->functions = xmalloc((env->method_count + 1) * sizeof *prog->functions);
+    prog->classes   = xcalloc(env->class_count + 1, sizeof *prog->classes);
+
+    Compiler c;
+    memset(&c, 0, sizeof c);
+    c.env   = env;
+    c.prog  = prog;
+    c.flags = flags;
+    c.function_of = xmalloc((env->method_count + 1) * sizeof(int));
+    for (int id = 0; id < env->method_count; id++) c.function_of[id] = -1;
+
+    // a function for each method reachable through a vtable or a new
+    for (int k = 0; k < env->class_preorder_len; k++) {
+        const ClassEntry *cls = &env->classes[env->class_preorder[k]];
+        int ctor = lookup_method(env, cls->name, SYM_CTOR);
+        for (int s = -1; s < cls->vtable_len; s++) {
+            int id = s < 0 ? ctor : cls->vtable[s];
+            if (id < 0 || c.function_of[id] >= 0) continue;
+            const MethodEntry *m = &env->methods[id];
+            c.function_of[id] = add_function(prog, id, xformat("%s.%s", symbol_name(env->names, m->class_name),
+                                             m->method_name == SYM_CTOR ? "<init>" : symbol_name(env->names, m->method_name)));
+        }
+    }
+    for (int k = 0; k < env->class_preorder_len; k++) {
+        int ci = env->class_preorder[k];
+        const ClassEntry *cls = &env->classes[ci];
+        VMClass *vc = &prog->classes[ci];
+        vc->vtable_len  = cls->vtable_len;
+        vc->vtable      = xmalloc((cls->vtable_len + 1) * sizeof(int32_t));
+        vc->field_count = count_fields(env, ci);
+        for (int s = 0; s < cls->vtable_len; s++)
+            vc->vtable[s] = c.function_of[cls->vtable[s]];
+    }
+
+    int methods = prog->function_count;
+    for (int f = 0; f < methods; f++) {
+        compile_function(&c, f);
+        Function *fn = &prog->functions[f];
+        fn->noret_message = xformat("%s returned no value", fn->name);
+    }
+
+    // the statements after the classes are the entry point
+    prog->main = add_function(prog, -1, xformat("<main>"));
+    c.fn      = &prog->functions[prog->main];
+    c.in_main = 1;
+    c.top     = c.fn->nregs = root->frame_size;
+    for (int i = 0; i < root->kid_count; i++) {
+        if (root->kids[i]->kind == NODE_STMTLIST) {
+            c.top = c.fn->nregs = layout_frame_objects(&c, root->kids[i], root->frame_size);
+            compile_stmt(&c, root->kids[i]);
+            break;
+        }
+    }
+    emit(&c, OP_HALT, 0, 0, 0, 0);
+
+    free(c.function_of);
+    free(c.breaks);
+    free(c.objects);
+    // instructions address registers with 16 bits
+    for (int f = 0; f < prog->function_count; f++) {
+        if (prog->functions[f].nregs > UINT16_MAX) {
+            free_bytecode(prog);
+            return NULL;
+        }
+    }
+    return prog;
+}
+
+void free_bytecode(VMProgram *prog) {
+    if (!prog) return;
+    for (int f = 0; f < prog->function_count; f++) {
+        free(prog->functions[f].code);
+        free(prog->functions[f].name);
+        free(prog->functions[f].noret_message);
+    }
+    for (int c = 0; c < prog->env->class_count; c++)
+        free(prog->classes[c].vtable);
+    free(prog->functions);
+    free(prog->classes);
+    free(prog->sites);
+    free(prog);
+}
+
+#define OPCODE_NAME(name) #name,
+static const char *opcode_names[] = { OPCODES(OPCODE_NAME) };
+#undef OPCODE_NAME
+
+void dump_bytecode(FILE *out, const VMProgram *prog) {
+    for (int f = 0; f < prog->function_count; f++) {
+        const Function *fn = &prog->functions[f];
+        fprintf(out, "function %d %s (%d registers)\n", f, fn->name, fn->nregs);
+        for (int pc = 0; pc < fn->code_len; pc++) {
+            const Instr *i = &fn->code[pc];
+            fprintf(out, "  %4d  %-8s a=%d b=%d c=%d imm=%d", pc, opcode_names[i->op], i->a, i->b, i->c, i->imm);
+            if (i->op == OP_CALLIC) fprintf(out, "  (slot %d)", prog->sites[i->imm].slot);
+            fputc('\n', out);
+        }
+    }
+}
+
+void inline_cache_stats(const VMProgram *prog, CacheStats *stats) {
+    memset(stats, 0, sizeof *stats);
+    for (int s = 0; s < prog->site_count; s++) {
+        const CallSite *site = &prog->sites[s];
+        stats->sites[site->state]++;
+        stats->hits   += site->hits;
+        stats->misses += site->misses;
+    }
+}
@@ -0,0 +1,237 @@
+#include "vm.h"
+#include "bytecode.h"
+#include "../common/arena.h"
+#include <stdlib.h>
+
+// Computed goto jumps straight from one handler to the next; other
+// compilers get a switch
+#if defined(__GNUC__) && !defined(VM_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+#define STACK_VALUES (1 << 22)
+#define MAX_DEPTH    (1 << 18)
+
+// Where a call returns to
+typedef struct {
+    const Function *fn;
+    const Instr    *ip;     // next instruction of the caller
+    Value          *regs;
+    int             dest;
+} CallFrame;
+
+// Slow path of CALLIC: dispatch through the vtable and remember the
+// class while the site has room
+static int32_t cache_miss(const VMProgram *prog, CallSite *site, int cls) {
+    int32_t target = prog->classes[cls].vtable[site->slot];
+    site->misses++;
+    if (site->state == SITE_MEGAMORPHIC) return target;
+    if (site->entries == PIC_SIZE) {
+        // too many classes; stop probing
+        for (int k = 0; k < PIC_SIZE; k++) site->classes[k] = -1;
+        site->entries = 0;
+        site->state   = SITE_MEGAMORPHIC;
+        return target;
+    }
+    site->classes[site->entries] = cls;
+    site->targets[site->entries] = target;
+    site->entries++;
+    site->state = site->entries == 1 ? SITE_MONOMORPHIC : SITE_POLYMORPHIC;
+    return target;
+}
+
+int run_bytecode(VMProgram *prog, FILE *out, const char **error) {
+    Value     *stack  = malloc(STACK_VALUES * sizeof(Value));
+    CallFrame *frames = malloc(MAX_DEPTH * sizeof(CallFrame));
+    Value     *stack_end = NULL;
+    Arena      heap = ARENA_INIT;   // objects live until the program ends
+    int        depth = 0, status = 0;
+
+    const Function *fn = &prog->functions[prog->main];
+    const Instr    *ip = fn->code;
+    Value          *R  = stack;
+    const Function *callee;
+
+#ifdef VM_COMPUTED_GOTO
+#define OPCODE_LABEL(name) &&L_##name,
+    static void *const labels[] = { OPCODES(OPCODE_LABEL) };
+#undef OPCODE_LABEL
+#define OP(name)   L_##name:
+#define DISPATCH() goto *labels[ip->op]
+#else
+#define OP(name)   case OP_##name:
+#define DISPATCH() goto dispatch
+#endif
+#define FAIL(msg)  do { *error = (msg); status = -1; goto done; } while (0)
+
+    if (!stack || !frames) FAIL("out of memory");
+    stack_end = stack + STACK_VALUES;
+    if (fn->nregs > STACK_VALUES) FAIL("stack overflow");
+#ifdef VM_COMPUTED_GOTO
+    DISPATCH();
+#else
+dispatch:
+    switch ((Opcode)ip->op) {
+#endif
+    OP(MOVE)
+        R[ip->a] = R[ip->b];
+        ip++;
+        DISPATCH();
+    OP(LOADI)
+        R[ip->a] = INT_VALUE(ip->imm);
+        ip++;
+        DISPATCH();
+    OP(LOADB)
+        R[ip->a] = BOOL_VALUE(ip->imm);
+        ip++;
+        DISPATCH();
+    OP(LOADNIL)
+        R[ip->a] = NULL_VALUE;
+        ip++;
+        DISPATCH();
+    OP(LOADUNIT)
+        R[ip->a] = UNIT_VALUE;
+        ip++;
+        DISPATCH();
+    OP(ADD)
+        R[ip->a] = INT_VALUE((uint32_t)AS_INT(R[ip->b]) + (uint32_t)AS_INT(R[ip->c]));
+        ip++;
+        DISPATCH();
+    OP(SUB)
+        R[ip->a] = INT_VALUE((uint32_t)AS_INT(R[ip->b]) - (uint32_t)AS_INT(R[ip->c]));
+        ip++;
+        DISPATCH();
+    OP(MUL)
+        R[ip->a] = INT_VALUE((uint32_t)AS_INT(R[ip->b]) * (uint32_t)AS_INT(R[ip->c]));
+        ip++;
+        DISPATCH();
+    OP(DIV) {
+        int32_t x = AS_INT(R[ip->b]), y = AS_INT(R[ip->c]);
+        if (y == 0) FAIL("division by zero");
+        R[ip->a] = INT_VALUE(x == INT32_MIN && y == -1 ? x : x / y);
+        ip++;
+        DISPATCH();
+    }
+    OP(LT)
+        R[ip->a] = BOOL_VALUE(AS_INT(R[ip->b]) < AS_INT(R[ip->c]));
+        ip++;
+        DISPATCH();
+    OP(EQ)
+        R[ip->a] = BOOL_VALUE(AS_INT(R[ip->b]) == AS_INT(R[ip->c]));
+        ip++;
+        DISPATCH();
+    OP(JMP)
+        ip = fn->code + ip->imm;
+        DISPATCH();
+    OP(JFALSE)
+        ip = AS_BOOL(R[ip->a]) ? ip + 1 : fn->code + ip->imm;
+        DISPATCH();
+    OP(PRINT)
+        fprintf(out, "%d\n", (int)AS_INT(R[ip->a]));
+        ip++;
+        DISPATCH();
+    OP(NEW) {
+        const VMClass *cls = &prog->classes[ip->imm];
+        Object *o = arena_alloc(&heap, sizeof(Object) + cls->field_count * sizeof(Value));
+        o->class_index = ip->imm;
+        for (int f = 0; f < cls->field_count; f++) o->fields[f] = NULL_VALUE;
+        R[ip->a] = (Value)(uintptr_t)o;
+        ip++;
+        DISPATCH();
+    }
+    OP(NEWF) {
+        // escape analysis found it dies with this frame
+        const VMClass *cls = &prog->classes[ip->imm];
+        Object *o = (Object *)&R[ip->b];
+        o->class_index = ip->imm;
+        for (int f = 0; f < cls->field_count; f++) o->fields[f] = NULL_VALUE;
+        R[ip->a] = (Value)(uintptr_t)o;
+        ip++;
+        DISPATCH();
+    }
+    OP(CHECK)
+        if (R[ip->a] == NULL_VALUE) FAIL("method call on a null object");
+        ip++;
+        DISPATCH();
+    OP(CALL) {
+        Value recv = R[ip->b];
+        if (recv == NULL_VALUE) FAIL("method call on a null object");
+        callee = &prog->functions[prog->classes[AS_OBJECT(recv)->class_index].vtable[ip->imm]];
+        goto call;
+    }
+    OP(CALLIC) {
+        Value recv = R[ip->b];
+        if (recv == NULL_VALUE) FAIL("method call on a null object");
+        CallSite *site = &prog->sites[ip->imm];
+        int32_t cls = AS_OBJECT(recv)->class_index;
+        // the first entry is checked alone: most sites are monomorphic
+        int k = 0;
+        if (site->classes[0] != cls) {
+            k = 1;
+            while (k < site->entries && site->classes[k] != cls) k++;
+        }
+        if (k < site->entries) {
+            site->hits++;
+            callee = &prog->functions[site->targets[k]];
+        } else {
+            callee = &prog->functions[cache_miss(prog, site, cls)];
+        }
+        goto call;
+    }
+    OP(CALLD)
+        if (R[ip->b] == NULL_VALUE) FAIL("method call on a null object");
+        callee = &prog->functions[ip->imm];
+        goto call;
+    OP(RET) {
+        Value v = R[ip->a];
+        CallFrame *f = &frames[--depth];
+        fn = f->fn;
+        ip = f->ip;
+        R  = f->regs;
+        R[f->dest] = v;
+        DISPATCH();
+    }
+    OP(RETVOID) {
+        CallFrame *f = &frames[--depth];
+        fn = f->fn;
+        ip = f->ip;
+        R  = f->regs;
+        R[f->dest] = UNIT_VALUE;
+        DISPATCH();
+    }
+    OP(NORET)
+        FAIL(fn->noret_message);
+    OP(HALT)
+        goto done;
+#ifndef VM_COMPUTED_GOTO
+    default:
+        FAIL("bad opcode");
+    }
+#endif
+
+call: {
+    // the callee's registers start at the receiver, so the arguments are
+    // already in place as its parameters
+    Value *regs = R + ip->b;
+    if (depth == MAX_DEPTH || regs + callee->nregs > stack_end) FAIL("stack overflow");
+    CallFrame *f = &frames[depth++];
+    f->fn   = fn;
+    f->ip   = ip + 1;
+    f->regs = R;
+    f->dest = ip->a;
+    fn = callee;
+    ip = callee->code;
+    R  = regs;
+    DISPATCH();
+}
+
+done:
+    fflush(out);
+    arena_free(&heap);
+    free(frames);
+    free(stack);
+    return status;
+#undef OP
+#undef DISPATCH
+#undef FAIL
+}
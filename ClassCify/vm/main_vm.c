@@ -0,0 +1,86 @@
+#include "vm.h"
+#include "../compiler/compiler.h"
+#include "../tokenizer/source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Typechecks a program and runs it on the bytecode VM.
+//
+//   ./main_vm [-t] [-d] [-s] [-n] [-O0] [-i size,depth] [source]
+//
+// -t walks the AST instead, -d prints the bytecode before running it,
+// -s prints inline cache statistics after it, -n compiles virtual calls
+// without inline caches, -O0 skips the optimization passes, -i sets the
+// inlining budget (see InlineBudget; -i 0,0 turns inlining off).
+int main(int argc, char **argv) {
+    int tree = 0, dump = 0, stats = 0, flags = VM_INLINE_CACHES, optimize = 1;
+    const char *path = "../typechecker/sample_typecheck_input.txt";
+    InlineBudget budget = DEFAULT_INLINE_BUDGET;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0)
+            tree = 1;
+        else if (strcmp(argv[i], "-d") == 0)
+            dump = 1;
+        else if (strcmp(argv[i], "-s") == 0)
+            stats = 1;
+        else if (strcmp(argv[i], "-n") == 0)
+            flags &= ~VM_INLINE_CACHES;
+        else if (strcmp(argv[i], "-O0") == 0)
+            optimize = 0;
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%d,%d", &budget.max_size, &budget.max_depth) != 2) {
+                fprintf(stderr, "-i takes size,depth\n");
+                return EXIT_FAILURE;
+            }
+        } else
+            path = argv[i];
+    }
+    SourceFile src;
+    if (load_source(path, &src) != 0) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    CompilerContext *ctx = compiler_create(NULL);
+    ctx->inline_budget = budget;
+    int status = EXIT_SUCCESS;
+    if (compile_source(ctx, src.data) != 0) {
+        print_diagnostic(stderr, &ctx->diag);
+        status = EXIT_FAILURE;
+    } else {
+        OptReport report;
+        if (optimize) compiler_optimize(ctx, &report);
+        const char *error = NULL;
+        VMProgram *prog = NULL;
+        int result;
+        if (tree) {
+            result = run_tree(ctx->ast, ctx->types, stdout, &error);
+        } else if (!(prog = compile_bytecode(ctx->ast, ctx->types, flags))) {
+            error  = "a method needs more than 65535 registers";
+            result = -1;
+        } else {
+            if (dump) dump_bytecode(stdout, prog);
+            result = run_bytecode(prog, stdout, &error);
+            if (stats) {
+                CacheStats cs;
+                inline_cache_stats(prog, &cs);
+                fprintf(stderr, "call sites: %d empty, %d monomorphic, %d polymorphic, %d megamorphic\n",
+                        cs.sites[SITE_EMPTY], cs.sites[SITE_MONOMORPHIC], cs.sites[SITE_POLYMORPHIC],
+                        cs.sites[SITE_MEGAMORPHIC]);
+                fprintf(stderr, "inline cache: %llu hits, %llu misses\n",
+                        (unsigned long long)cs.hits, (unsigned long long)cs.misses);
+            }
+        }
+        if (result != 0) {
+            fprintf(stderr, "Runtime error: %s\n", error);
+            status = EXIT_FAILURE;
+        }
+        free_bytecode(prog);
+    }
+
+    // Cleanup
+    compiler_destroy(ctx);
+    release_source(&src);
+    return status;
+}
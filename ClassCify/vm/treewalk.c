@@ -0,0 +1,201 @@
+#include "vm.h"
+#include "bytecode.h"
+#include "../common/arena.h"
+#include "../common/xalloc.h"
+#include <setjmp.h>
+#include <stdlib.h>
+
+// Deep recursion runs on the C stack here, so calls nest less deeply
+// than in the VM
+#define MAX_DEPTH 10000
+
+typedef enum { FLOW_NEXT, FLOW_BREAK, FLOW_RETURN } Flow;
+
+typedef struct {
+    const TypeEnv *env;
+    FILE          *out;
+    Arena          heap;
+    int            depth;
+    Value          result;   // value of the last Return
+    const char    *error;
+    jmp_buf        bail;
+} Walker;
+
+static _Noreturn void fail(Walker *w, const char *msg) {
+    w->error = msg;
+    longjmp(w->bail, 1);
+}
+
+static Value eval(Walker *w, const ASTNode *n, Value *frame);
+static Flow  exec(Walker *w, const ASTNode *n, Value *frame);
+
+// Runs a method or constructor body on a fresh frame: slot 0 is the
+// receiver, slots 1..argc the arguments
+static Value invoke(Walker *w, int id, Value recv, const Value *args, int argc) {
+    static _Thread_local char message[256];
+    const MethodEntry *m = &w->env->methods[id];
+    const ASTNode *def = m->def;
+    if (recv == NULL_VALUE) fail(w, "method call on a null object");
+    if (w->depth == MAX_DEPTH) fail(w, "stack overflow");
+    w->depth++;
+    Value frame[def->frame_size + 1];
+    frame[0] = recv;
+    for (int i = 0; i < argc; i++) frame[1 + i] = args[i];
+
+    int i = def->param_count;
+    if (m->method_name == SYM_CTOR) {
+        if (i < def->kid_count && def->kids[i]->kind == NODE_SUPERCALL) {
+            const ASTNode *sup = def->kids[i++];
+            Value sargs[sup->kid_count + 1];
+            for (int k = 0; k < sup->kid_count; k++) sargs[k] = eval(w, sup->kids[k], frame);
+            const ClassEntry *cls = &w->env->classes[class_number(w->env, m->class_name)];
+            invoke(w, lookup_method(w->env, cls->superclass, SYM_CTOR), recv, sargs, sup->kid_count);
+        }
+    } else {
+        i++;   // the return type
+    }
+    Value result = UNIT_VALUE;
+    for (; i < def->kid_count; i++) {
+        if (exec(w, def->kids[i], frame) == FLOW_RETURN) {
+            result = w->result;
+            break;
+        }
+    }
+    if (i == def->kid_count && m->sig.return_type.kind != TYPE_VOID) {
+        snprintf(message, sizeof message, "%s.%s returned no value",
+                 symbol_name(w->env->names, m->class_name), symbol_name(w->env->names, m->method_name));
+        fail(w, message);
+    }
+    w->depth--;
+    return m->sig.return_type.kind == TYPE_VOID ? UNIT_VALUE : result;
+}
+
+static Value eval(Walker *w, const ASTNode *n, Value *frame) {
+    const TypeEnv *env = w->env;
+    switch (n->kind) {
+    case NODE_INT_LIT: return INT_VALUE(n->int_value);
+    case NODE_TRUE:    return BOOL_VALUE(1);
+    case NODE_FALSE:   return BOOL_VALUE(0);
+    case NODE_THIS:    return frame[0];
+    case NODE_IDENT:   return frame[n->slot];
+    case NODE_PRINTLN:
+        fprintf(w->out, "%d\n", (int)AS_INT(eval(w, n->kids[0], frame)));
+        return UNIT_VALUE;
+    case NODE_CALL: {
+        Value recv = eval(w, n->kids[0], frame);
+        int argc = n->kid_count - 2;
+        Value args[argc + 1];
+        for (int i = 0; i < argc; i++) args[i] = eval(w, n->kids[2 + i], frame);
+        // resolved by name on every call, then dispatched on the receiver
+        int id = lookup_method(env, n->kids[0]->type.cls, n->kids[1]->sym);
+        if (recv == NULL_VALUE) fail(w, "method call on a null object");
+        const ClassEntry *dyn = &env->classes[AS_OBJECT(recv)->class_index];
+        return invoke(w, dyn->vtable[env->methods[id].slot], recv, args, argc);
+    }
+    case NODE_INLINED: {
+        int last = n->kid_count - 1;
+        for (int i = 0; i < last; i++)
+            if (n->kids[i]->kind == NODE_ASSIGN) exec(w, n->kids[i], frame);
+        const ASTNode *recv = n->kids[0];
+        if (recv->kind == NODE_ASSIGN) recv = recv->kids[0];
+        if (eval(w, recv, frame) == NULL_VALUE) fail(w, "method call on a null object");
+        return eval(w, n->kids[last], frame);
+    }
+    case NODE_NEW: {
+        int c = class_number(env, n->kids[0]->sym);
+        int fields = 0;
+        for (int k = c; k >= 0; k = env->classes[k].super_index) {
+            const ASTNode *def = env->classes[k].def;
+            for (int i = 1; i < def->kid_count; i++) fields += def->kids[i]->kind == NODE_VARDEC;
+        }
+        Object *o = arena_alloc(&w->heap, sizeof(Object) + fields * sizeof(Value));
+        o->class_index = c;
+        for (int f = 0; f < fields; f++) o->fields[f] = NULL_VALUE;
+        int argc = n->kid_count - 1;
+        Value args[argc + 1];
+        for (int i = 0; i < argc; i++) args[i] = eval(w, n->kids[1 + i], frame);
+        Value obj = (Value)(uintptr_t)o;
+        invoke(w, lookup_method(env, n->kids[0]->sym, SYM_CTOR), obj, args, argc);
+        return obj;
+    }
+    default: {
+        int32_t a = AS_INT(eval(w, n->kids[0], frame));
+        int32_t b = AS_INT(eval(w, n->kids[1], frame));
+        switch (n->kind) {
+        case NODE_ADD:  return INT_VALUE((uint32_t)a + (uint32_t)b);
+        case NODE_SUB:  return INT_VALUE((uint32_t)a - (uint32_t)b);
+        case NODE_MUL:  return INT_VALUE((uint32_t)a * (uint32_t)b);
+        case NODE_DIV:
+            if (b == 0) fail(w, "division by zero");
+            return INT_VALUE(a == INT32_MIN && b == -1 ? a : a / b);
+        case NODE_LESS: return BOOL_VALUE(a < b);
+        default:        return BOOL_VALUE(a == b);
+        }
+    }
+    }
+}
+
+static Flow exec(Walker *w, const ASTNode *n, Value *frame) {
+    switch (n->kind) {
+    case NODE_VARDEC:
+        frame[n->kids[1]->slot] = n->kids[0]->type.kind == TYPE_INT ? INT_VALUE(0)
+                                : n->kids[0]->type.kind == TYPE_BOOLEAN ? BOOL_VALUE(0)
+                                : n->kids[0]->type.kind == TYPE_CLASS ? NULL_VALUE : UNIT_VALUE;
+        return FLOW_NEXT;
+    case NODE_ASSIGN:
+        frame[n->kids[0]->slot] = eval(w, n->kids[1], frame);
+        return FLOW_NEXT;
+    case NODE_IF:
+        if (AS_BOOL(eval(w, n->kids[0], frame)))
+            return exec(w, n->kids[1], frame);
+        return n->kid_count == 3 ? exec(w, n->kids[2], frame) : FLOW_NEXT;
+    case NODE_WHILE:
+        while (AS_BOOL(eval(w, n->kids[0], frame))) {
+            for (int i = 1; i < n->kid_count; i++) {
+                Flow f = exec(w, n->kids[i], frame);
+                if (f == FLOW_BREAK) return FLOW_NEXT;
+                if (f == FLOW_RETURN) return f;
+            }
+        }
+        return FLOW_NEXT;
+    case NODE_BREAK:
+        return FLOW_BREAK;
+    case NODE_RETURN:
+        w->result = n->kid_count == 1 ? eval(w, n->kids[0], frame) : UNIT_VALUE;
+        return FLOW_RETURN;
+    case NODE_STMTLIST:
+        for (int i = 0; i < n->kid_count; i++) {
+            Flow f = exec(w, n->kids[i], frame);
+            if (f != FLOW_NEXT) return f;
+        }
+        return FLOW_NEXT;
+    default:
+        eval(w, n, frame);
+        return FLOW_NEXT;
+    }
+}
+
+int run_tree(const ASTNode *root, const TypeEnv *env, FILE *out, const char **error) {
+    Walker w;
+    w.env    = env;
+    w.out    = out;
+    w.depth  = 0;
+    w.result = UNIT_VALUE;
+    w.error  = NULL;
+    w.heap   = (Arena)ARENA_INIT;
+    Value *frame = xcalloc(root->frame_size + 1, sizeof(Value));
+    if (!setjmp(w.bail)) {
+        for (int i = 0; i < root->kid_count; i++) {
+            if (root->kids[i]->kind == NODE_STMTLIST) {
+                exec(&w, root->kids[i], frame);
+                break;
+            }
+        }
+    }
+    fflush(out);
+    arena_free(&w.heap);
+    free(frame);
+    if (!w.error) return 0;
+    *error = w.error;
+    return -1;
+}
@@ -0,0 +1,48 @@
+#ifndef VM_H
+#define VM_H
+
+#include "../typechecker/typechecker.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Bytecode execution. A typechecked program is compiled to register
+// bytecode: one function per reachable method and constructor, locals in
+// the frame slots the typechecker assigned, and per-class dispatch tables
+// taken from the typechecker's vtable layout. Calls the devirtualize pass
+// bound become direct calls.
+
+typedef struct VMProgram VMProgram;
+
+// compile_bytecode flags
+enum {
+    // Virtual calls go through per-site polymorphic inline caches keyed
+    // by receiver class; a hit skips the vtable
+    VM_INLINE_CACHES = 1,
+};
+
+// NULL if a function needs more than 65535 registers
+VMProgram *compile_bytecode(const ASTNode *root, const TypeEnv *env, int flags);
+void       free_bytecode(VMProgram *prog);
+void       dump_bytecode(FILE *out, const VMProgram *prog);
+
+// Run the program; println writes to 'out'. Return 0, or -1 with
+// '*error' set to a runtime error message. It lives as long as 'prog',
+// or until the thread's next run_tree. The inline caches fill as the
+// program runs and stay filled for later runs.
+int run_bytecode(VMProgram *prog, FILE *out, const char **error);
+// Reference interpreter that walks the AST directly, looking every call
+// up in the method index as it runs. The baseline the VM is measured
+// against.
+int run_tree(const ASTNode *root, const TypeEnv *env, FILE *out, const char **error);
+
+typedef enum { SITE_EMPTY, SITE_MONOMORPHIC, SITE_POLYMORPHIC, SITE_MEGAMORPHIC } SiteState;
+
+// Inline cache totals over every call site of 'prog'
+typedef struct {
+    int      sites[4];       // call sites per SiteState
+    uint64_t hits, misses;   // megamorphic calls count as misses
+} CacheStats;
+
+void inline_cache_stats(const VMProgram *prog, CacheStats *stats);
+
+#endif // VM_H